@@ -984,14 +984,18 @@ static bool _init_artefact_properties(item_def &item)
     return true;
 }
 
+// Checked for every artefact property the player or a monster looks up.
+static const static_prop_key artefact_props_key(ARTEFACT_PROPS_KEY);
+static const static_prop_key known_props_key(KNOWN_PROPS_KEY);
+
 void artefact_known_properties(const item_def &item,
                                artefact_known_props_t &known)
 {
     ASSERT(is_artefact(item));
-    if (!item.props.exists(KNOWN_PROPS_KEY)) // randbooks
+    if (!item.props.exists(known_props_key)) // randbooks
         return;
 
-    const CrawlStoreValue &_val = item.props[KNOWN_PROPS_KEY];
+    const CrawlStoreValue &_val = item.props[known_props_key];
     ASSERT(_val.get_type() == SV_VEC);
     const CrawlVector &known_vec = _val.get_vector();
     ASSERT(known_vec.get_type()     == SV_BOOL);
@@ -1014,12 +1018,12 @@ void artefact_properties(const item_def &item,
                          artefact_properties_t  &proprt)
 {
     ASSERT(is_artefact(item));
-    ASSERT(item.props.exists(ARTEFACT_PROPS_KEY) || is_unrandom_artefact(item));
+    ASSERT(item.props.exists(artefact_props_key) || is_unrandom_artefact(item));
 
-    if (item.props.exists(ARTEFACT_PROPS_KEY))
+    if (item.props.exists(artefact_props_key))
     {
         const CrawlVector &rap_vec =
-            item.props[ARTEFACT_PROPS_KEY].get_vector();
+            item.props[artefact_props_key].get_vector();
         ASSERT(rap_vec.get_type()     == SV_SHORT);
         ASSERT(rap_vec.size()         == ART_PROPERTIES);
         ASSERT(rap_vec.get_max_size() == ART_PROPERTIES);
@@ -1039,12 +1043,12 @@ void artefact_properties(const item_def &item,
 int artefact_property(const item_def &item, artefact_prop_type prop)
 {
     ASSERT(is_artefact(item));
-    ASSERT(item.props.exists(ARTEFACT_PROPS_KEY) || is_unrandom_artefact(item));
+    ASSERT(item.props.exists(artefact_props_key) || is_unrandom_artefact(item));
 
-    if (item.props.exists(ARTEFACT_PROPS_KEY))
+    if (item.props.exists(artefact_props_key))
     {
         const CrawlVector &rap_vec =
-            item.props[ARTEFACT_PROPS_KEY].get_vector();
+            item.props[artefact_props_key].get_vector();
         return rap_vec[prop].get_short();
     }
     else // if (is_unrandom_artefact(item))
@@ -1064,10 +1068,10 @@ bool artefact_property_known(const item_def &item, artefact_prop_type prop)
     if (item_ident(item, ISFLAG_KNOW_PROPERTIES))
         return true;
 
-    if (!item.props.exists(KNOWN_PROPS_KEY)) // randbooks
+    if (!item.props.exists(known_props_key)) // randbooks
         return false;
 
-    const CrawlVector &known_vec = item.props[KNOWN_PROPS_KEY].get_vector();
+    const CrawlVector &known_vec = item.props[known_props_key].get_vector();
     ASSERT(known_vec.get_type()     == SV_BOOL);
     ASSERT(known_vec.size()         == ART_PROPERTIES);
 
@@ -25,6 +25,7 @@
 #include "cloud.h"
 #include "colour.h"
 #include "coordit.h"
+#include "dbg-prof.h"
 #include "delay.h"
 #include "directn.h"
 #include "dungeon.h"
@@ -2020,6 +2021,8 @@ int silver_damages_victim(actor* victim, int damage, string &dmg_msg)
 void fire_tracer(const monster* mons, bolt &pbolt, bool explode_only,
                  bool explosion_hole)
 {
+    PROFILE_MONSTER_COUNT(MCOUNT_TRACER);
+
     // Don't fiddle with any input parameters other than tracer stuff!
     pbolt.is_tracer     = true;
     pbolt.source        = mons->pos();
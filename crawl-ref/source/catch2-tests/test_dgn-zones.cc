@@ -0,0 +1,95 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "dgn-zones.h"
+#include "random.h"
+
+// Number the zones by flood filling from each unlabelled cell in turn, the
+// way the dungeon builder used to.
+static FixedArray<int, GXM, GYM> _flood_zones(const passability_map &pass,
+                                              int &nzones)
+{
+    FixedArray<int, GXM, GYM> zones(0);
+    nzones = 0;
+    for (int y = 0; y < GYM; ++y)
+        for (int x = 0; x < GXM; ++x)
+        {
+            if (zones[x][y] || !pass(coord_def(x, y)))
+                continue;
+
+            zones[x][y] = ++nzones;
+            vector<coord_def> todo = { coord_def(x, y) };
+            while (!todo.empty())
+            {
+                const coord_def c = todo.back();
+                todo.pop_back();
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        const coord_def n(c.x + dx, c.y + dy);
+                        if (n.x < 0 || n.x >= GXM || n.y < 0 || n.y >= GYM
+                            || zones(n) || !pass(n))
+                        {
+                            continue;
+                        }
+                        zones(n) = nzones;
+                        todo.push_back(n);
+                    }
+            }
+        }
+    return zones;
+}
+
+TEST_CASE("Zone labels match flood filling", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+
+    // From scattered specks to almost everything open.
+    for (int density = 10; density <= 90; density += 10)
+    {
+        for (int trial = 0; trial < 10; ++trial)
+        {
+            passability_map pass;
+            for (int y = 0; y < GYM; ++y)
+                for (int x = 0; x < GXM; ++x)
+                    if (x_chance_in_y(density, 100))
+                        pass.set(coord_def(x, y));
+            const zone_map zones(pass);
+
+            int nzones;
+            const auto expected = _flood_zones(pass, nzones);
+
+            CAPTURE(density);
+            REQUIRE(zones.count() == nzones);
+            for (int y = 0; y < GYM; ++y)
+                for (int x = 0; x < GXM; ++x)
+                    REQUIRE(zones(coord_def(x, y)) == expected[x][y]);
+        }
+    }
+}
+
+TEST_CASE("Zones touching only diagonally are joined", "[single-file]")
+{
+    passability_map pass;
+    // Runs meeting corner to corner across a word boundary, then a
+    // separate cell.
+    pass.set(coord_def(60, 5));
+    pass.set(coord_def(61, 5));
+    pass.set(coord_def(62, 5));
+    pass.set(coord_def(63, 6));
+    pass.set(coord_def(64, 7));
+    pass.set(coord_def(65, 7));
+    pass.set(coord_def(GXM - 1, 7));
+
+    const zone_map zones(pass);
+    REQUIRE(zones.count() == 2);
+    REQUIRE(zones(coord_def(60, 5)) == 1);
+    REQUIRE(zones(coord_def(65, 7)) == 1);
+    REQUIRE(zones(coord_def(GXM - 1, 7)) == 2);
+    REQUIRE(zones(coord_def(0, 0)) == 0);
+
+    const vector<bool> far_right = zones.zones_where(
+        [](const coord_def &c) { return c.x >= 64; });
+    REQUIRE(far_right == vector<bool>({ false, true, true }));
+}
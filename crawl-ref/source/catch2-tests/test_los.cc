@@ -0,0 +1,151 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "coordit.h"
+#include "env.h"
+#include "feature.h"
+#include "fixedarray.h"
+#include "los.h"
+#include "losglobal.h"
+#include "losparam.h"
+#include "random.h"
+
+// Random opacities around the centre of the map.
+struct opacity_window : public opacity_func
+{
+    FixedArray<opacity_type, GXM, GYM> opc;
+
+    opacity_window(int opaque, int half) : opc(OPC_CLEAR)
+    {
+        for (int x = 0; x < GXM; ++x)
+            for (int y = 0; y < GYM; ++y)
+            {
+                const int roll = random2(100);
+                opc[x][y] = roll < opaque ? OPC_OPAQUE
+                          : roll < opaque + half ? OPC_HALF
+                                                 : OPC_CLEAR;
+            }
+    }
+
+    CLONE(opacity_window)
+
+    opacity_type operator()(const coord_def& p) const override
+    {
+        return opc(p);
+    }
+};
+
+TEST_CASE("Every LOS ray kernel gives the scalar result", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    const coord_def centre(GXM / 2, GYM / 2);
+    // The whole window, not just the current LOS radius.
+    const circle_def bounds(LOS_MAX_RANGE, C_SQUARE);
+
+    // Make sure the rays are precomputed, as that picks a kernel itself.
+    los_grid warm;
+    losight(warm, centre, opacity_window(0, 0));
+
+    const vector<string> kernels = los_ray_kernels();
+    REQUIRE(kernels.front() == "scalar");
+
+    for (int opaque = 0; opaque <= 40; opaque += 10)
+        for (int half = 0; half <= 40; half += 20)
+            for (int trial = 0; trial < 20; ++trial)
+            {
+                const opacity_window window(opaque, half);
+
+                REQUIRE(los_set_ray_kernel("scalar"));
+                los_grid expected;
+                losight(expected, centre, window, bounds);
+
+                for (const string &kernel : kernels)
+                {
+                    CAPTURE(kernel);
+                    CAPTURE(opaque);
+                    CAPTURE(half);
+                    REQUIRE(los_set_ray_kernel(kernel));
+                    los_grid sh;
+                    losight(sh, centre, window, bounds);
+                    for (int x = -LOS_MAX_RANGE; x <= LOS_MAX_RANGE; ++x)
+                        for (int y = -LOS_MAX_RANGE; y <= LOS_MAX_RANGE; ++y)
+                            REQUIRE(sh(coord_def(x, y))
+                                    == expected(coord_def(x, y)));
+                }
+            }
+
+    REQUIRE(los_set_ray_kernel(kernels.back()));
+}
+
+// Open, opaque, see-through wall and see-through solid terrain, so that the
+// los_types disagree about what blocks.
+static dungeon_feature_type _random_los_feat()
+{
+    static const dungeon_feature_type feats[] =
+    {
+        DNGN_FLOOR, DNGN_FLOOR, DNGN_FLOOR, DNGN_FLOOR, DNGN_ROCK_WALL,
+        DNGN_TREE, DNGN_CLOSED_DOOR, DNGN_CLEAR_ROCK_WALL, DNGN_GRATE,
+    };
+    return feats[random2(ARRAYSZ(feats))];
+}
+
+TEST_CASE("Cached LOS agrees with a ray search as terrain changes",
+          "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    init_show_table();
+    env.mgrid.init(NON_MONSTER);
+    env.cloud.clear();
+
+    // Random terrain around the centre of the map, reaching a little
+    // beyond LOS of the cells looked from.
+    const coord_def centre(GXM / 2, GYM / 2);
+    const int look = 4;
+    const int patch = look + LOS_MAX_RANGE + 1;
+    env.grid.init(DNGN_FLOOR);
+    for (rectangle_iterator ri(centre, patch); ri; ++ri)
+        env.grid(*ri) = _random_los_feat();
+    invalidate_los();
+
+    const int radius = get_los_radius();
+    const vector<pair<los_type, const opacity_func *>> types =
+    {
+        { LOS_DEFAULT, &opc_default },
+        { LOS_NO_TRANS, &opc_no_trans },
+        { LOS_SOLID, &opc_solid },
+        { LOS_SOLID_SEE, &opc_solid_see },
+    };
+
+    for (int change = 0; change < 50; ++change)
+    {
+        // Look around from a few cells, filling the cache and checking
+        // what it gives...
+        for (int i = 0; i < 4; ++i)
+        {
+            const coord_def p = centre + coord_def(random_range(-look, look),
+                                                   random_range(-look, look));
+            CAPTURE(change, p.x, p.y);
+            for (rectangle_iterator ri(p, LOS_MAX_RANGE); ri; ++ri)
+                for (const auto &type : types)
+                {
+                    const bool expected = *ri == p
+                        || exists_ray(p, *ri, *type.second, radius);
+                    if (cell_see_cell(p, *ri, type.first) != expected)
+                    {
+                        CAPTURE(ri->x, ri->y, type.first);
+                        REQUIRE(cell_see_cell(p, *ri, type.first)
+                                == expected);
+                    }
+                }
+        }
+
+        // ...then change a cell and tell the cache about it.
+        const coord_def c = centre + coord_def(random_range(-patch, patch),
+                                               random_range(-patch, patch));
+        env.grid(c) = _random_los_feat();
+        invalidate_los_around(c);
+    }
+
+    invalidate_los();
+}
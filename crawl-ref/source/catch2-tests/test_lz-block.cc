@@ -0,0 +1,100 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "lz-block.h"
+#include "random.h"
+#include "stringutil.h"
+
+static void _check_round_trip(const string &data)
+{
+    CAPTURE(data.size());
+    vector<char> packed(lz_compress_bound(data.size()));
+    const size_t len = lz_compress(data.data(), data.size(), packed.data());
+    REQUIRE(len <= packed.size());
+
+    string out(data.size(), '\0');
+    REQUIRE(lz_decompress(packed.data(), len, &out[0], out.size())
+            == (int)data.size());
+    REQUIRE(out == data);
+
+    // Too little room is an error, not an overrun.
+    if (!data.empty())
+    {
+        string small(data.size() - 1, '\0');
+        REQUIRE(lz_decompress(packed.data(), len, &small[0], small.size())
+                == -1);
+    }
+}
+
+TEST_CASE("LZ blocks round trip", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+
+    for (const char *text : { "", "a", "abcabcabcabc", "aaaaaaaaaaaaaaaa",
+                              "The orc hits you. The orc hits you. The orc"
+                              " misses you." })
+    {
+        _check_round_trip(text);
+    }
+
+    // Noise, runs, and repeats near and far, at lengths around the
+    // limits on where matches can start and end.
+    for (int i = 0; i < 500; ++i)
+    {
+        string data;
+        const int len = i < 100 ? i : random2(100000);
+        const int alphabet = 1 + random2(256);
+        while ((int)data.size() < len)
+        {
+            if (!data.empty() && coinflip())
+            {
+                const size_t from = random2(data.size());
+                const size_t n = 1 + random2(300);
+                for (size_t j = 0; j < n; ++j)
+                    data += data[from + j];
+            }
+            else
+                data += (char)random2(alphabet);
+        }
+        data.resize(len);
+        _check_round_trip(data);
+    }
+}
+
+TEST_CASE("LZ blocks shrink repetitive data", "[single-file]")
+{
+    string data;
+    for (int i = 0; i < 1000; ++i)
+        data += "You hear the shouts of distant orcs. ";
+    vector<char> packed(lz_compress_bound(data.size()));
+    REQUIRE(lz_compress(data.data(), data.size(), packed.data())
+            < data.size() / 20);
+}
+
+TEST_CASE("Damaged LZ blocks are rejected", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    string data;
+    for (int i = 0; i < 200; ++i)
+        data += make_stringf("orc %d, goblin %d; ", i, i % 7);
+    vector<char> packed(lz_compress_bound(data.size()));
+    const size_t len = lz_compress(data.data(), data.size(), packed.data());
+
+    string out(data.size(), '\0');
+    // Cut short...
+    for (size_t cut = 0; cut < len; ++cut)
+    {
+        CAPTURE(cut);
+        REQUIRE(lz_decompress(packed.data(), cut, &out[0], out.size())
+                != (int)data.size());
+    }
+    // ...or scribbled on, which mustn't read or write out of bounds.
+    for (int i = 0; i < 2000; ++i)
+    {
+        vector<char> bad(packed.begin(), packed.begin() + len);
+        for (int j = 1 + random2(4); j > 0; --j)
+            bad[random2(len)] = random2(256);
+        lz_decompress(bad.data(), bad.size(), &out[0], out.size());
+    }
+}
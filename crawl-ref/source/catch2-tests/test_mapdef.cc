@@ -0,0 +1,35 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "mapdef.h"
+
+static map_lines _lines()
+{
+    map_lines lines;
+    for (int y = 0; y < 4; ++y)
+        lines.add_line("xxxxx");
+    lines.normalise();
+    return lines;
+}
+
+TEST_CASE("Filling a rectangle sets exactly its cells", "[single-file]")
+{
+    map_lines lines = _lines();
+    lines.fill_rect(coord_def(1, 1), coord_def(3, 2), '.');
+    REQUIRE(lines.get_lines() == vector<string>{
+        "xxxxx", "x...x", "x...x", "xxxxx" });
+
+    lines.fill_rect(coord_def(4, 3), coord_def(4, 3), '+');
+    REQUIRE(lines.get_line(3) == "xxxx+");
+}
+
+TEST_CASE("Filling an inverted rectangle does nothing", "[single-file]")
+{
+    // dgn.make_box asks for these when a box is thinner than its walls.
+    map_lines lines = _lines();
+    lines.fill_rect(coord_def(2, 0), coord_def(1, 3), '.');
+    lines.fill_rect(coord_def(0, 2), coord_def(4, 1), '.');
+    lines.fill_rect(coord_def(4, 3), coord_def(0, 0), '.');
+    REQUIRE(lines.get_lines() == _lines().get_lines());
+}
@@ -0,0 +1,222 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include <memory>
+
+#include "mapped-db.h"
+#include "pattern.h"
+#include "random.h"
+#include "stringutil.h"
+#include "syscalls.h"
+
+#define TEST_DB_PATH "test_mapped_db.tdb"
+
+// Entries in the style of the description databases, with punctuation for
+// the escapes to match and some non-ASCII text.
+static map<string, string> _entries()
+{
+    map<string, string> entries = {
+        { "orc", "A hulking orc, armed with a club.\n" },
+        { "Orc warrior", "An ORC of some renown.\nIt fights with axes.\n" },
+        { "dragon", "A fire-breathing dragon. It's 12 metres long.\n" },
+        { "fire dragon", "A DRAGON wreathed in flame (and smoke).\n" },
+        { "quick blade", "A short blade (quick) [+3].\n" },
+        { "ice beast", "Brrr... colour: white.\n" },
+        { "Orb of Zot", "The Orb of Zot lies beyond.\n" },
+        { "caf\xc3\xa9", "Ein Caf\xc3\xa9. \xc3\x89LAN, \xc3\xa9lan.\n" },
+        { "wand of digging", "Digs tunnels: 1d8 of them?\n" },
+        { "slash", "a\\b and a|b and {x}\n" },
+        { "empty", "" },
+        { "ab", "ab" },
+    };
+
+    // And plenty of noise, so that the posting lists overlap.
+    const string chars = "abcdeABCDE .-()[]?*+{}|\\^$19";
+    for (int i = 0; i < 300; ++i)
+    {
+        string body;
+        for (int j = random2(40); j > 0; --j)
+            body += chars[random2(chars.size())];
+        entries[make_stringf("noise %d", i)] = body;
+    }
+    return entries;
+}
+
+static unique_ptr<MappedDB> _write_and_open(const map<string, string> &entries)
+{
+    REQUIRE(MappedDB::write(TEST_DB_PATH, entries));
+    unique_ptr<MappedDB> db(MappedDB::open(TEST_DB_PATH));
+    // The file is mapped (or read in), so it can go straight away.
+    unlink_u(TEST_DB_PATH);
+    REQUIRE(db);
+    return db;
+}
+
+// Every entry that a regex matches, by key or by body, has to be among the
+// candidates the index returns for it.
+static void _check_candidates(const MappedDB &db, const string &regex,
+                              bool icase)
+{
+    CAPTURE(regex, icase);
+
+    vector<uint32_t> cands;
+    if (!db.candidates(regex, cands))
+        return;
+    REQUIRE(is_sorted(cands.begin(), cands.end()));
+
+    const text_pattern tpat(regex, icase);
+    for (int i = 0; i < db.size(); ++i)
+    {
+        const db_text key = db.key(i);
+        const db_text body = db.body(i);
+        const string key_str(key.ptr, key.len);
+        if (tpat.matches(key_str) || tpat.matches(string(body.ptr, body.len)))
+        {
+            CAPTURE(key_str);
+            REQUIRE(binary_search(cands.begin(), cands.end(), i));
+        }
+    }
+}
+
+TEST_CASE("Regex candidates include every full scan match", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    const auto db = _write_and_open(_entries());
+
+    const vector<string> patterns = {
+        // Plain literals.
+        "dragon", "Orc", "ORC warrior", "orb of zot", "lies beyond",
+        // Escapes.
+        "\\.", "fire\\-breathing", "\\(quick\\)", "\\[\\+3\\]",
+        "\\d+ metres", "\\bdig", "metres\\b", "Brrr\\.\\.\\.",
+        "colour\\: white", "a\\\\b and", "a\\|b", "\\{x\\}", "\\x41n ORC",
+        // Classes.
+        "[Oo]rc", "dra[gk]on", "[^a-z]RC of", "[]x]ic", "[^]x]hite",
+        "bla[a-z]e", "[[:alpha:]]ire dragon", "ice[ ]beast",
+        // Groups.
+        "(fire )?dragon", "(orc|ogre) warrior", "A (hulking) orc",
+        "wand (of )+digging", "(?i)orc", "Orc warrior|ogre", "hulk(ing)*",
+        "((sh)ort) blade", "An (ORC) of",
+        // Quantifiers.
+        "drag?on", "dra*gon", "drago+n", "dr.gon", "dragon{1,2}",
+        "orc{2}", "Zot{0}", "dragon{0,1}", "^Zot$", "^The Orb", "long\\.$",
+        "Z.*t lies", "diggi?ng", "1d8?", "drago+?n", "drago+*n",
+        "\\<dragon\\>", "\\`The Orb",
+        // Outside ASCII.
+        "caf\xc3\xa9", "CAF\xc3\x89", "\xc3\xa9lan", "\xc3\x89LAN",
+        "Ein Caf.",
+    };
+    for (const string &pattern : patterns)
+        for (bool icase : { false, true })
+            _check_candidates(*db, pattern, icase);
+
+    // Runs taken from the entries, with their case shuffled and regex
+    // syntax dropped in.
+    const string syntax = ".?*+|^$()[]{}\\";
+    for (int i = 0; i < 2000; ++i)
+    {
+        const db_text body = db->body(random2(db->size()));
+        if (body.len < 3)
+            continue;
+        const size_t start = random2(body.len - 2);
+        string pattern(body.ptr + start,
+                       min<size_t>(body.len - start, 3 + random2(8)));
+        for (char &c : pattern)
+            if (one_chance_in(3))
+                c = isaupper(c) ? toalower(c) : toupper_safe(c);
+        for (int j = random2(3); j > 0; --j)
+        {
+            pattern.insert(random2(pattern.size() + 1), 1,
+                           syntax[random2(syntax.size())]);
+        }
+        _check_candidates(*db, pattern, coinflip());
+    }
+}
+
+TEST_CASE("Regex candidates narrow literal searches down", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    const auto db = _write_and_open(_entries());
+
+    vector<uint32_t> cands;
+    REQUIRE(db->candidates("dragon", cands));
+    REQUIRE(cands.size() == 2);
+    REQUIRE(db->candidates("(fire )?DRAGON", cands));
+    REQUIRE(cands.size() == 2);
+    REQUIRE(db->candidates("no such text", cands));
+    REQUIRE(cands.empty());
+
+    // Alternatives inside a group are skipped with the group...
+    REQUIRE(db->candidates("(orc|ogre) warrior", cands));
+    REQUIRE(cands.size() == 1);
+    // ...but alternation at the top and inline options could match anything.
+    REQUIRE_FALSE(db->candidates("Orc warrior|ogre", cands));
+    REQUIRE_FALSE(db->candidates("(?i)orc", cands));
+    // As could a regex without three literal characters in a row.
+    REQUIRE_FALSE(db->candidates("or?c", cands));
+}
+
+TEST_CASE("Mapped databases round trip", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    const map<string, string> entries = _entries();
+    const auto db = _write_and_open(entries);
+
+    // Entries are in key order, and every key can be looked up.
+    REQUIRE(db->size() == (int) entries.size());
+    int i = 0;
+    for (const auto &kv : entries)
+    {
+        CAPTURE(kv.first);
+        const db_text key = db->key(i);
+        const db_text body = db->body(i);
+        REQUIRE(string(key.ptr, key.len) == kv.first);
+        REQUIRE(string(body.ptr, body.len) == kv.second);
+
+        const db_text found = db->fetch(kv.first);
+        REQUIRE(found.ptr);
+        REQUIRE(string(found.ptr, found.len) == kv.second);
+        ++i;
+    }
+
+    for (const char *missing : { "", "Dragon", "dragon ", "noise 300" })
+    {
+        CAPTURE(missing);
+        REQUIRE_FALSE(db->fetch(missing).ptr);
+    }
+
+    // An empty database is still a database.
+    const auto empty = _write_and_open({});
+    REQUIRE(empty->size() == 0);
+    REQUIRE_FALSE(empty->fetch("orc").ptr);
+    vector<uint32_t> cands;
+    REQUIRE(empty->candidates("dragon", cands));
+    REQUIRE(cands.empty());
+}
+
+TEST_CASE("Damaged database files are rejected", "[single-file]")
+{
+    REQUIRE(MappedDB::write(TEST_DB_PATH, { { "orc", "An orc." } }));
+    FILE *f = fopen_u(TEST_DB_PATH, "rb");
+    REQUIRE(f);
+    string data(4096, '\0');
+    data.resize(fread(&data[0], 1, data.size(), f));
+    fclose(f);
+    REQUIRE(data.size() > 8);
+
+    // Cut short, then empty.
+    for (size_t len : { data.size() - 1, (size_t) 0 })
+    {
+        CAPTURE(len);
+        f = fopen_u(TEST_DB_PATH, "wb");
+        REQUIRE(f);
+        fwrite(data.data(), 1, len, f);
+        fclose(f);
+        unique_ptr<MappedDB> db(MappedDB::open(TEST_DB_PATH));
+        REQUIRE_FALSE(db);
+    }
+    unlink_u(TEST_DB_PATH);
+
+    REQUIRE_FALSE(MappedDB::open(TEST_DB_PATH));
+}
@@ -0,0 +1,187 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "env.h"
+#include "feature.h"
+#include "mon-behv.h"
+#include "mon-movetarget.h"
+#include "mon-pathfind.h"
+#include "mon-util.h"
+#include "monster.h"
+
+// A level of rock with a floor corridor along y = 10 from x = 10 to x = 20,
+// then a wall cell, then a separate pocket of floor from x = 22 to x = 25.
+static void _corridor_level()
+{
+    init_show_table();
+    env.grid.init(DNGN_ROCK_WALL);
+    env.mgrid.init(NON_MONSTER);
+    for (int x = 10; x <= 25; ++x)
+        if (x != 21)
+            env.grid[x][10] = DNGN_FLOOR;
+}
+
+TEST_CASE("Multi-target pathfinding reaches every target", "[single-file]")
+{
+    _corridor_level();
+
+    monster_pathfind mp;
+    const vector<coord_def> dests = { coord_def(15, 10), coord_def(20, 10) };
+    REQUIRE(mp.init_pathfind(coord_def(10, 10), dests));
+
+    for (const coord_def &dest : dests)
+    {
+        REQUIRE(mp.reached(dest));
+        const vector<coord_def> path = mp.backtrack(dest);
+        REQUIRE(path.front() == coord_def(10, 10));
+        REQUIRE(path.back() == dest);
+        REQUIRE((int)path.size() == dest.x - 10 + 1);
+    }
+}
+
+TEST_CASE("Multi-target pathfinding doesn't pass through a walled target",
+          "[single-file]")
+{
+    _corridor_level();
+
+    monster_pathfind mp;
+    const coord_def in_wall(21, 10);
+    const coord_def beyond(23, 10);
+    REQUIRE_FALSE(mp.init_pathfind(coord_def(10, 10),
+                                   vector<coord_def>{ in_wall, beyond }));
+
+    // The target in the wall is reached, as a single-target search would
+    // reach it, but the pocket on its far side isn't reached through it.
+    REQUIRE(mp.reached(in_wall));
+    REQUIRE(mp.backtrack(in_wall).size() == 12);
+    REQUIRE_FALSE(mp.reached(beyond));
+    REQUIRE(mp.backtrack(beyond).empty());
+}
+
+TEST_CASE("Multi-target pathfinding respects the search range",
+          "[single-file]")
+{
+    _corridor_level();
+
+    monster_pathfind mp;
+    mp.set_range(3);
+    const coord_def near(13, 10);
+    const coord_def far(20, 10);
+    REQUIRE_FALSE(mp.init_pathfind(coord_def(10, 10),
+                                   vector<coord_def>{ near, far }));
+
+    REQUIRE(mp.reached(near));
+    REQUIRE_FALSE(mp.reached(far));
+    // Nothing more than the range from the nearest unreached target was
+    // searched.
+    REQUIRE_FALSE(mp.reached(coord_def(16, 10)));
+}
+
+// A corridor that bends twice, so that there is only one shortest way along
+// it: east along y = 10 to x = 20, south to y = 20, then east to x = 30.
+static void _bent_corridor_level()
+{
+    init_show_table();
+    env.grid.init(DNGN_ROCK_WALL);
+    env.mgrid.init(NON_MONSTER);
+    for (int x = 10; x <= 20; ++x)
+        env.grid[x][10] = DNGN_FLOOR;
+    for (int y = 10; y <= 20; ++y)
+        env.grid[20][y] = DNGN_FLOOR;
+    for (int x = 20; x <= 30; ++x)
+        env.grid[x][20] = DNGN_FLOOR;
+}
+
+static monster &_hostile(int index, monster_type type, const coord_def &pos)
+{
+    monster &mon = env.mons[index];
+    mon.reset();
+    mon.type = type;
+    mon.base_monster = MONS_NO_MONSTER;
+    mon.attitude = ATT_HOSTILE;
+    mon.position = pos;
+    return mon;
+}
+
+static vector<coord_def> _private_waypoints(const monster &mon,
+                                            const coord_def &dest, int range)
+{
+    monster_pathfind mp;
+    mp.set_range(range);
+    REQUIRE(mp.init_pathfind(&mon, dest));
+    return mp.calc_waypoints();
+}
+
+TEST_CASE("Shared distance fields give the same paths as private searches",
+          "[single-file]")
+{
+    init_monsters();
+    _bent_corridor_level();
+    invalidate_shared_paths();
+
+    const coord_def dest(30, 20);
+    const int range = 1000;
+    monster &first = _hostile(0, MONS_ORC, coord_def(10, 10));
+    monster &second = _hostile(1, MONS_ORC, coord_def(14, 10));
+
+    // The first monster to ask is left to search on its own.
+    vector<coord_def> waypoints;
+    REQUIRE_FALSE(shared_path_waypoints(&first, dest, range, waypoints));
+
+    // The second builds the field, and both then follow it.
+    for (const monster *mon : { &second, &first })
+    {
+        CAPTURE(mon->pos());
+        REQUIRE(shared_path_waypoints(mon, dest, range, waypoints));
+        REQUIRE(waypoints == _private_waypoints(*mon, dest, range));
+    }
+
+    // A flier moves differently, so it doesn't get the orcs' field.
+    monster &bat = _hostile(2, MONS_BAT, coord_def(12, 10));
+    REQUIRE_FALSE(shared_path_waypoints(&bat, dest, range, waypoints));
+
+    for (int i = 0; i < 3; ++i)
+        env.mons[i].reset();
+    invalidate_shared_paths();
+}
+
+TEST_CASE("Monsters leave by the exit nearest on foot", "[single-file]")
+{
+    init_monsters();
+    init_show_table();
+    env.grid.init(DNGN_ROCK_WALL);
+    env.mgrid.init(NON_MONSTER);
+
+    // From (10, 10), a corridor runs east to (20, 10), then loops back round
+    // through (20, 20) and (10, 20) to (10, 14).
+    for (int x = 10; x <= 20; ++x)
+    {
+        env.grid[x][10] = DNGN_FLOOR;
+        env.grid[x][20] = DNGN_FLOOR;
+    }
+    for (int y = 10; y <= 20; ++y)
+        env.grid[20][y] = DNGN_FLOOR;
+    for (int y = 14; y <= 20; ++y)
+        env.grid[10][y] = DNGN_FLOOR;
+
+    // Stairs sealed in rock right next to the monster, at the near end of
+    // the loop, and at the corner of the corridor.
+    const coord_def sealed(10, 12), round_loop(10, 14), corner(20, 10);
+    for (const coord_def &c : { sealed, round_loop, corner })
+        env.grid(c) = DNGN_STONE_STAIRS_DOWN_I;
+
+    monster &mon = _hostile(0, MONS_ORC, coord_def(10, 10));
+    vector<level_exit> exits;
+    const int i = mons_find_nearest_level_exit(&mon, exits);
+    REQUIRE(exits.size() == 3);
+    REQUIRE(i != -1);
+    REQUIRE(exits[i].target == corner);
+
+    // With the corridor cut, only the sealed stairs are left, and those
+    // can't be reached at all.
+    env.grid[15][10] = DNGN_ROCK_WALL;
+    REQUIRE(mons_find_nearest_level_exit(&mon, exits) == -1);
+
+    mon.reset();
+}
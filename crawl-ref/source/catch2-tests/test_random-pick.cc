@@ -0,0 +1,152 @@
+#include <cmath>
+
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "branch.h"
+#include "mon-pick.h"
+#include "mon-pick-data.h"
+#include "random.h"
+
+// Vetoes every other monster type, to exercise the filtered picks.
+class odd_monster_picker : public monster_picker
+{
+public:
+    virtual bool veto(monster_type mon) override { return mon % 2; }
+};
+
+// The chance of each monster today: its rarity at the level over the total.
+static map<monster_type, double> _expected_chances(const pop_entry *pop,
+                                                   int depth)
+{
+    monster_picker picker;
+    map<monster_type, double> rarities;
+    double total = 0;
+    for (; pop->rarity; pop++)
+    {
+        if (depth < pop->minr || depth > pop->maxr)
+            continue;
+        const int rar = picker.rarity_at(pop, depth);
+        rarities[pop->value] += rar;
+        total += rar;
+    }
+
+    for (auto &entry : rarities)
+        entry.second /= total;
+    return rarities;
+}
+
+// Pearson's chi-squared statistic for the observed counts against the
+// expected chances, lumping together monsters too rare to expect five of.
+static double _chi_squared(const map<monster_type, double> &chances,
+                           map<monster_type, int> &counts, int samples,
+                           int &dof)
+{
+    double chi2 = 0;
+    double rare_expected = 0;
+    int rare_observed = 0;
+    dof = -1;
+    for (const auto &entry : chances)
+    {
+        const double expected = entry.second * samples;
+        const int observed = counts[entry.first];
+        if (expected < 5)
+        {
+            rare_expected += expected;
+            rare_observed += observed;
+            continue;
+        }
+        chi2 += (observed - expected) * (observed - expected) / expected;
+        dof++;
+    }
+    if (rare_expected > 0)
+    {
+        chi2 += (rare_observed - rare_expected)
+                * (rare_observed - rare_expected) / rare_expected;
+        dof++;
+    }
+    return chi2;
+}
+
+TEST_CASE("Alias table picks match population rarities", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+    const int samples = 50000;
+
+    for (branch_iterator it; it; ++it)
+    {
+        const branch_type br = it->id;
+        if (!population[br].count)
+            continue;
+
+        for (int depth = 1; depth <= branches[br].numlevels; depth++)
+        {
+            CAPTURE(br);
+            CAPTURE(depth);
+
+            const pop_entry *pop = population[br].pop;
+            const auto chances = _expected_chances(pop, depth);
+            const auto table = monster_picker().level_table(pop, depth);
+
+            if (chances.empty())
+            {
+                REQUIRE(table.pick(MONS_0) == MONS_0);
+                continue;
+            }
+
+            map<monster_type, int> counts;
+            for (int i = 0; i < samples; i++)
+            {
+                const monster_type mon = table.pick(MONS_0);
+                REQUIRE(chances.count(mon));
+                counts[mon]++;
+            }
+
+            int dof;
+            const double chi2 = _chi_squared(chances, counts, samples, dof);
+            CAPTURE(chi2);
+            CAPTURE(dof);
+            // Five standard deviations out; the seed is fixed, so this can
+            // only start failing if the distribution changes.
+            if (dof > 0)
+                REQUIRE(chi2 < dof + 5 * sqrt(2.0 * dof));
+        }
+    }
+}
+
+TEST_CASE("Vetoed picks from a table match picks from the list",
+          "[single-file]")
+{
+    odd_monster_picker picker;
+
+    for (branch_iterator it; it; ++it)
+    {
+        const branch_type br = it->id;
+        if (!population[br].count)
+            continue;
+
+        for (int depth = 1; depth <= branches[br].numlevels; depth++)
+        {
+            CAPTURE(br);
+            CAPTURE(depth);
+
+            const pop_entry *pop = population[br].pop;
+            const auto table = picker.level_table(pop, depth);
+
+            vector<monster_type> from_list, from_table;
+            {
+                rng::subgenerator subgen(br, depth);
+                for (int i = 0; i < 200; i++)
+                    from_list.push_back(picker.pick(pop, depth, MONS_0));
+            }
+            {
+                rng::subgenerator subgen(br, depth);
+                for (int i = 0; i < 200; i++)
+                    from_table.push_back(picker.pick(table, MONS_0));
+            }
+
+            REQUIRE(from_list == from_table);
+        }
+    }
+}
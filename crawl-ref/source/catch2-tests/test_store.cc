@@ -0,0 +1,156 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "random.h"
+#include "store.h"
+#include "stringutil.h"
+#include "tag-version.h"
+#include "tags.h"
+
+static string _key(int i)
+{
+    return make_stringf("test_store_key_%d", i);
+}
+
+// Every key of the model, and no other, is in the table with its value.
+static void _check_table(const CrawlHashTable &table,
+                         const map<string, int> &model, int nkeys)
+{
+    REQUIRE(table.size() == model.size());
+    for (int i = 0; i < nkeys; ++i)
+    {
+        auto found = model.find(_key(i));
+        CAPTURE(i);
+        REQUIRE(table.exists(_key(i)) == (found != model.end()));
+        if (found != model.end())
+            REQUIRE(table[_key(i)].get_int() == found->second);
+    }
+
+    size_t seen = 0;
+    for (const auto &entry : table)
+    {
+        REQUIRE(model.count(entry.first));
+        REQUIRE(entry.second.get_int() == model.at(entry.first));
+        ++seen;
+    }
+    REQUIRE(seen == model.size());
+}
+
+TEST_CASE("Hash table insertion and erasure match std::map", "[single-file]")
+{
+    rng::subgenerator subgen(0, 0);
+
+    // Enough keys for long probe runs, so erasure has to shift entries
+    // back past wrapped and unrelated runs.
+    const int nkeys = 200;
+    CrawlHashTable table;
+    map<string, int> model;
+    for (int step = 0; step < 5000; ++step)
+    {
+        const string key = _key(random2(nkeys));
+        if (x_chance_in_y(3, 5))
+        {
+            const int value = random2(1000);
+            table[key].get_int() = value;
+            model[key] = value;
+        }
+        else
+            REQUIRE(table.erase(key) == model.erase(key));
+
+        if (step % 50 == 0)
+            _check_table(table, model, nkeys);
+    }
+    _check_table(table, model, nkeys);
+
+    table.clear();
+    model.clear();
+    _check_table(table, model, nkeys);
+}
+
+TEST_CASE("Erasing keeps every probe run reachable", "[single-file]")
+{
+    // Fill to the maximum load, then take out every other key and then the
+    // rest, which empties out long runs a slot at a time.
+    const int nkeys = 96;
+    CrawlHashTable table;
+    map<string, int> model;
+    for (int i = 0; i < nkeys; ++i)
+    {
+        table[_key(i)].get_int() = i;
+        model[_key(i)] = i;
+    }
+    _check_table(table, model, nkeys);
+
+    for (int start : { 0, 1 })
+    {
+        for (int i = start; i < nkeys; i += 2)
+        {
+            REQUIRE(table.erase(_key(i)) == 1);
+            model.erase(_key(i));
+            _check_table(table, model, nkeys);
+        }
+    }
+    REQUIRE(table.empty());
+}
+
+TEST_CASE("Atoms are released with the last key", "[single-file]")
+{
+    const string name = "test_store_released_key";
+    REQUIRE_FALSE(prop_key(name).interned());
+
+    CrawlHashTable a;
+    REQUIRE_FALSE(a.exists(name));
+    // Looking a key up doesn't intern it.
+    REQUIRE_FALSE(prop_key(name).interned());
+
+    a[name].get_int() = 1;
+    REQUIRE(prop_key(name).interned());
+    {
+        CrawlHashTable b(a);
+        a.erase(name);
+        REQUIRE(prop_key(name).interned());
+    }
+    REQUIRE_FALSE(prop_key(name).interned());
+
+    static const static_prop_key pinned("test_store_pinned_key");
+    a[pinned].get_int() = 2;
+    a.erase(pinned);
+    REQUIRE(pinned.interned());
+    REQUIRE(prop_key("test_store_pinned_key").atom() == pinned.atom());
+}
+
+TEST_CASE("Hash tables are written in key order", "[single-file]")
+{
+    CrawlHashTable table;
+    const vector<string> keys = { "zebra", "apple", "mango", "banana",
+                                  "cherry", "kiwi", "fig", "date" };
+    for (int i = 0, size = keys.size(); i < size; ++i)
+        table[keys[i]].get_int() = i;
+
+    vector<unsigned char> buf;
+    writer w(&buf);
+    table.write(w);
+
+    // The keys are marshalled as they are, so their order in the buffer is
+    // the order they were written in.
+    const string written(buf.begin(), buf.end());
+    vector<string> sorted = keys;
+    sort(sorted.begin(), sorted.end());
+    size_t last = 0;
+    for (const string &key : sorted)
+    {
+        CAPTURE(key);
+        const size_t pos = written.find(key);
+        REQUIRE(pos != string::npos);
+        REQUIRE(pos >= last);
+        last = pos;
+    }
+
+    reader r(buf, TAG_MINOR_VERSION);
+    CrawlHashTable copy;
+    copy.read(r);
+    REQUIRE(copy.size() == keys.size());
+    for (int i = 0, size = keys.size(); i < size; ++i)
+        REQUIRE(copy[keys[i]].get_int() == i);
+}
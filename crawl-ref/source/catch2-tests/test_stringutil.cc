@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include "AppHdr.h"
+
+#include "stringutil.h"
+
+static string _varint(uint64_t v)
+{
+    string out;
+    append_varint(out, v);
+    return out;
+}
+
+TEST_CASE("Varints are little-endian base 128", "[single-file]")
+{
+    REQUIRE(_varint(0) == string("\x00", 1));
+    REQUIRE(_varint(127) == "\x7f");
+    REQUIRE(_varint(128) == "\x80\x01");
+    REQUIRE(_varint(300) == "\xac\x02");
+    REQUIRE(_varint(0xFFFFFFFF) == "\xff\xff\xff\xff\x0f");
+    REQUIRE(_varint(UINT64_MAX) == string(9, '\xff') + "\x01");
+}
+
+TEST_CASE("Base64 encoding matches RFC 4648", "[single-file]")
+{
+    REQUIRE(base64_encode("") == "");
+    REQUIRE(base64_encode("f") == "Zg==");
+    REQUIRE(base64_encode("fo") == "Zm8=");
+    REQUIRE(base64_encode("foo") == "Zm9v");
+    REQUIRE(base64_encode("foob") == "Zm9vYg==");
+    REQUIRE(base64_encode("fooba") == "Zm9vYmE=");
+    REQUIRE(base64_encode("foobar") == "Zm9vYmFy");
+    REQUIRE(base64_encode(string("\xff\x00\xfe", 3)) == "/wD+");
+}
+
+// A packed map cell string as tileweb.cc writes it. The same string is
+// decoded by webserver/packed_map_test.py, with both the webserver's
+// decoder and game_data/static/packed_map.js, so changing it here means
+// changing it there.
+TEST_CASE("Packed map cells encode as the decoders expect", "[single-file]")
+{
+    string data;
+    // Header: format version, map width, origin.
+    for (uint64_t v : { 1, 80, 3, 4 })
+        append_varint(data, v);
+
+    // Skip to cell 85, then a run of two cells.
+    append_varint(data, 85);
+    append_varint(data, 2);
+    // f, g, col and a 64-bit fg.
+    append_varint(data, 1 << 0 | 1 << 4 | 1 << 5 | 1 << 6);
+    append_varint(data, 7);
+    append_varint(data, '#');
+    append_varint(data, (uint32_t) -1);
+    append_varint(data, 0x100000005ULL);
+    // A monster id, flavour, overlays and extra 0.
+    append_varint(data, 1 << 2 | 1 << 24 | 1 << 25 | 1 << 26);
+    append_varint(data, 300);
+    append_varint(data, 2);
+    append_varint(data, 0);
+    append_varint(data, 2);
+    append_varint(data, 1000);
+    append_varint(data, 2);
+    append_varint(data, 0);
+
+    // Skip to cell 90 for a monster that's gone.
+    append_varint(data, 3);
+    append_varint(data, 1);
+    append_varint(data, 1 << 1);
+
+    REQUIRE(base64_encode(data)
+            == "AVADBFUCcQcj/////w+FgICAEISAgDisAgIAAugHAgADAQI=");
+}
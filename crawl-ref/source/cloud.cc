@@ -15,6 +15,7 @@
 #include "art-enum.h"
 #include "colour.h"
 #include "coordit.h"
+#include "dbg-prof.h"
 #include "dungeon.h"
 #include "english.h"
 #include "god-conduct.h"
@@ -607,6 +608,8 @@ static void _handle_spectral_cloud(const cloud_struct& cloud)
 
 void manage_clouds()
 {
+    PROFILE_STAGE(PROF_MANAGE_CLOUDS);
+
     // We can't iterate over env.cloud directly because _dissipate_cloud
     // will remove this cloud and invalidate our iterator.
     vector<cloud_struct *> cloud_ptrs;
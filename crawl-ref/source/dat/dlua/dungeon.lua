@@ -203,15 +203,28 @@ function dgn_map_meta_wrap(map, tab)
    end
 
    -- We must set this each time - the map may have the same name, but
-   -- be a different C++ object.
-   for fn, val in pairs(tab) do
-      meta[fn] = function (...)
-                    return crawl.err_trace(val, map, ...)
-                 end
+   -- be a different C++ object. The prelude, map and main chunks of one
+   -- run_lua all share a map object, though, so they can share the
+   -- wrappers too; they're only rebuilt for a new object.
+   if not rawequal(rawget(meta, 'wrapped_instance'), map)
+      or rawget(meta, '_wrapped_table') ~= tab then
+      local wrappers = { }
+      for fn, val in pairs(tab) do
+         wrappers[fn] = function (...)
+                           return crawl.err_trace(val, map, ...)
+                        end
+      end
+      meta._wrappers = wrappers
+      meta._wrapped_table = tab
+      -- Convenience global variable, e.g. mapgrd[x][y] = 'x'
+      meta._mapgrd = dgn.mapgrd_table(map)
    end
 
-   -- Convenience global variable, e.g. mapgrd[x][y] = 'x'
-   meta['mapgrd'] = dgn.mapgrd_table(map)
+   -- Reassign them anyway, in case a chunk overwrote one.
+   for fn, wrapper in pairs(meta._wrappers) do
+      meta[fn] = wrapper
+   end
+   meta['mapgrd'] = meta._mapgrd
 
    meta['_G'] = meta
    meta.wrapped_instance = map
@@ -458,17 +458,33 @@ function procedural.minmax_map(val,min,max)
 end
 
 -- Render functions
+
+-- Sets each cell of the box to fcell(x,y) unless that's nil, visiting cells
+-- column by column as mapgrd loops do, but reading and writing the map in
+-- one call each rather than once per cell.
+function procedural.render_area(e,x1,y1,x2,y2,fcell)
+  local box = { x1 = x1, y1 = y1, x2 = x2, y2 = y2 }
+  local area = e.get_area(box)
+  local width = x2 - x1 + 1
+  local glyphs = {}
+  for x = x1,x2,1 do
+    for y = y1,y2,1 do
+      local i = (y - y1) * width + x - x1 + 1
+      local r = fcell(x,y)
+      if r == nil then r = string.sub(area, i, i) end
+      glyphs[i] = r
+    end
+  end
+  box.glyphs = table.concat(glyphs)
+  e.set_area(box)
+end
+
 function procedural.render_map(e, fval, fresult)
 
   local gxm,gym = dgn.max_bounds()
   e.extend_map { width = gxm, height = gym, fill = 'x' }
-  for x = 1,gxm-2,1 do
-    for y = 1,gym-2,1 do
-      local val = fval(x,y)
-      local r = fresult(val,x,y)
-      if r ~= nil then e.mapgrd[x][y] = r end
-    end
-  end
+  procedural.render_area(e, 1, 1, gxm-2, gym-2,
+                         function(x,y) return fresult(fval(x,y),x,y) end)
 
 end
 
@@ -139,6 +139,21 @@ function zonify.fill_smallest_zones(zonemap, num_to_keep, fgroup, ffill, min_zon
   end
 end
 
+-- A cell function for zonify.map giving the glyphs of the current map,
+-- which it reads in one go rather than through mapgrd for every cell.
+function zonify.map_glyphs(e)
+  local width,height = e.width(),e.height()
+  local area = e.get_area { }
+  return function(x,y)
+    if not dgn.in_bounds(x,y) then return nil end
+    if x < width and y < height then
+      local i = y * width + x + 1
+      return { glyph = string.sub(area, i, i) }
+    end
+    return { glyph = e.mapgrd[x][y] }
+  end
+end
+
 -- Zonifies the current map based on solidity
 function zonify.map_map(e)
 
@@ -151,9 +166,7 @@ function zonify.map_map(e)
   local gxm,gym = dgn.max_bounds()
   return zonify.map(
     { x1 = 1, y1 = 1, x2 = gxm-2, y2 = gym-2 },
-    function(x,y)
-      return dgn.in_bounds(x,y) and { glyph = e.mapgrd[x][y] } or nil
-    end,
+    zonify.map_glyphs(e),
     function(val)
       return string.find(wall,val.glyph,1,true) and "wall" or "floor"
     end
@@ -182,9 +195,7 @@ function zonify.map_fill_lava_zones(e, num_to_keep, glyph, min_zone_size)
   local gxm,gym = dgn.max_bounds()
   local zonemap = zonify.map(
     { x1 = 1, y1 = 1, x2 = gxm-2, y2 = gym-2 },
-    function(x,y)
-      return dgn.in_bounds(x,y) and { glyph = e.mapgrd[x][y] } or nil
-    end,
+    zonify.map_glyphs(e),
     function(val)
       return string.find(wall,val.glyph,1,true) and "wall" or "floor"
     end
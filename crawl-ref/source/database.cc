@@ -19,6 +19,7 @@
 #include "end.h"
 #include "files.h"
 #include "libutil.h"
+#include "mapped-db.h"
 #include "options.h"
 #include "random.h"
 #include "stringutil.h"
@@ -37,11 +38,9 @@ public:
     ~TextDB() { shutdown(true); delete translation; }
     void init();
     void shutdown(bool recursive = false);
-    DBM* get() { return _db; }
+    MappedDB* get() { return _db; }
 
-    // Make it easier to migrate from raw DBM* to TextDB
     operator bool() const { return _db != 0; }
-    operator DBM*() const { return _db; }
 
  private:
     bool _needs_update() const;
@@ -52,7 +51,7 @@ public:
     const char* const _db_name;
     string _directory;
     vector<string> _input_files;
-    DBM* _db;
+    MappedDB* _db;
     string timestamp;
     TextDB *_parent;
     const char* lang() { return _parent ? Options.lang_name : 0; }
@@ -60,13 +59,12 @@ public:
     TextDB *translation;
 };
 
-// Convenience functions for (read-only) access to generic
-// berkeley DB databases.
-static void _store_text_db(const string &in, DBM *db);
+// Convenience functions for (read-only) access to the text databases.
+static void _store_text_db(const string &in, map<string, string> &db);
 
 static string _query_database(TextDB &db, string key, bool canonicalise_key,
                               bool run_lua, bool untranslated = false);
-static void _add_entry(DBM *db, const string &k, string &v);
+static void _add_entry(map<string, string> &db, const string &k, string &v);
 
 static TextDB AllDBs[] =
 {
@@ -179,8 +177,8 @@ bool TextDB::open_db()
     if (_db)
         return true;
 
-    const string full_db_path = _db_cache_path(_db_name, lang());
-    _db = dbm_open(full_db_path.c_str(), O_RDONLY, 0660);
+    const string full_db_path = _db_cache_path(_db_name, lang()) + ".tdb";
+    _db = MappedDB::open(full_db_path);
     if (!_db)
         return false;
 
@@ -216,7 +214,7 @@ void TextDB::shutdown(bool recursive)
 {
     if (_db)
     {
-        dbm_close(_db);
+        delete _db;
         _db = nullptr;
     }
     if (recursive && translation)
@@ -277,7 +275,7 @@ void TextDB::_regenerate_db()
     }
 
     string db_path = _db_cache_path(_db_name, lang());
-    string full_db_path = db_path + ".db";
+    string full_db_path = db_path + ".tdb";
 
     {
         string output_dir = get_parent_directory(db_path);
@@ -285,14 +283,12 @@ void TextDB::_regenerate_db()
             end(1, false, "Cannot create db directory '%s'.", output_dir.c_str());
     }
 
+    // The new file replaces the old one by a rename, so processes that
+    // have the old one open keep a consistent copy.
     file_lock lock(db_path + ".lk", "wb");
-#ifndef DGL_REWRITE_PROTECT_DB_FILES
-    unlink_u(full_db_path.c_str());
-#endif
 
     string ts;
-    if (!(_db = dbm_open(db_path.c_str(), O_RDWR | O_CREAT, 0660)))
-        end(1, true, "Unable to open DB: %s", db_path.c_str());
+    map<string, string> entries;
     for (const string &file : _input_files)
     {
         string full_input_path = _directory + file;
@@ -309,13 +305,13 @@ void TextDB::_regenerate_db()
 #endif
             || !_parent) // english is mandatory
         {
-            _store_text_db(full_input_path, _db);
+            _store_text_db(full_input_path, entries);
         }
     }
-    _add_entry(_db, "TIMESTAMP", ts);
+    _add_entry(entries, "TIMESTAMP", ts);
 
-    dbm_close(_db);
-    _db = 0;
+    if (!MappedDB::write(full_db_path, entries))
+        end(1, true, "Unable to write DB: %s", full_db_path.c_str());
 }
 
 // ----------------------------------------------------------------------
@@ -339,24 +335,31 @@ void databaseSystemShutdown()
 ////////////////////////////////////////////////////////////////////////////
 // Main DB functions
 
-static datum _database_fetch(DBM *database, const string &key)
+static db_text _database_fetch(const MappedDB *database, const string &key)
 {
-    datum result;
-    result.dptr = nullptr;
-    result.dsize = 0;
-    datum dbKey;
-
-    dbKey.dptr = (DPTR_COERCE) key.c_str();
-    dbKey.dsize = key.length();
-
     // Don't use the database if called from "monster".
-    if (database)
-        result = dbm_fetch(database, dbKey);
+    if (!database)
+        return { nullptr, 0 };
+
+    return database->fetch(key);
+}
 
-    return result;
+// Entries worth matching against a regex: all of them, unless the
+// trigram index can rule some out.
+static vector<uint32_t> _database_candidates(const MappedDB *database,
+                                             const string &regex)
+{
+    vector<uint32_t> indices;
+    if (!database->candidates(regex, indices))
+    {
+        indices.resize(database->size());
+        for (int i = 0; i < database->size(); ++i)
+            indices[i] = i;
+    }
+    return indices;
 }
 
-static vector<string> _database_find_keys(DBM *database,
+static vector<string> _database_find_keys(const MappedDB *database,
                                           const string &regex,
                                           bool ignore_case,
                                           db_find_filter filter = nullptr)
@@ -364,11 +367,10 @@ static vector<string> _database_find_keys(DBM *database,
     text_pattern             tpat(regex, ignore_case);
     vector<string> matches;
 
-    datum dbKey = dbm_firstkey(database);
-
-    while (dbKey.dptr != nullptr)
+    for (uint32_t i : _database_candidates(database, regex))
     {
-        string key((const char *)dbKey.dptr, dbKey.dsize);
+        const db_text dbKey = database->key(i);
+        string key(dbKey.ptr, dbKey.len);
 
         if (tpat.matches(key)
             && key.find("__") == string::npos
@@ -376,14 +378,12 @@ static vector<string> _database_find_keys(DBM *database,
         {
             matches.push_back(key);
         }
-
-        dbKey = dbm_nextkey(database);
     }
 
     return matches;
 }
 
-static vector<string> _database_find_bodies(DBM *database,
+static vector<string> _database_find_bodies(const MappedDB *database,
                                             const string &regex,
                                             bool ignore_case,
                                             db_find_filter filter = nullptr)
@@ -391,14 +391,12 @@ static vector<string> _database_find_bodies(DBM *database,
     text_pattern             tpat(regex, ignore_case);
     vector<string> matches;
 
-    datum dbKey = dbm_firstkey(database);
-
-    while (dbKey.dptr != nullptr)
+    for (uint32_t i : _database_candidates(database, regex))
     {
-        string key((const char *)dbKey.dptr, dbKey.dsize);
-
-        datum dbBody = dbm_fetch(database, dbKey);
-        string body((const char *)dbBody.dptr, dbBody.dsize);
+        const db_text dbKey = database->key(i);
+        const db_text dbBody = database->body(i);
+        string key(dbKey.ptr, dbKey.len);
+        string body(dbBody.ptr, dbBody.len);
 
         if (tpat.matches(body)
             && key.find("__") == string::npos
@@ -406,8 +404,6 @@ static vector<string> _database_find_bodies(DBM *database,
         {
             matches.push_back(key);
         }
-
-        dbKey = dbm_nextkey(database);
     }
 
     return matches;
@@ -479,21 +475,13 @@ static void _trim_leading_newlines(string &s)
     s.erase(0, s.find_first_not_of("\n"));
 }
 
-static void _add_entry(DBM *db, const string &k, string &v)
+static void _add_entry(map<string, string> &db, const string &k, string &v)
 {
     _trim_leading_newlines(v);
-    datum key, value;
-    key.dptr = (char *) k.c_str();
-    key.dsize = k.length();
-
-    value.dptr = (char *) v.c_str();
-    value.dsize = v.length();
-
-    if (dbm_store(db, key, value, DBM_REPLACE))
-        end(1, true, "Error storing %s", k.c_str());
+    db[k] = v;
 }
 
-static void _parse_text_db(LineInput &inf, DBM *db)
+static void _parse_text_db(LineInput &inf, map<string, string> &db)
 {
     string key;
     string value;
@@ -536,7 +524,7 @@ static void _parse_text_db(LineInput &inf, DBM *db)
         _add_entry(db, key, value);
 }
 
-static void _store_text_db(const string &in, DBM *db)
+static void _store_text_db(const string &in, map<string, string> &db)
 {
     UTF8FileLineInput inf(in.c_str());
     if (inf.error())
@@ -616,14 +604,14 @@ static string _getWeightedString(TextDB &db, const string &key,
     lowercase(canonical_key);
 
     // Query the DB.
-    datum result;
+    db_text result = { nullptr, 0 };
 
     if (db.translation)
         result = _database_fetch(db.translation->get(), canonical_key);
-    if (result.dsize <= 0)
+    if (!result.len)
         result = _database_fetch(db.get(), canonical_key);
 
-    if (result.dsize <= 0)
+    if (!result.len)
     {
         // Try ignoring the suffix.
         canonical_key = key;
@@ -632,15 +620,14 @@ static string _getWeightedString(TextDB &db, const string &key,
         // Query the DB.
         if (db.translation)
             result = _database_fetch(db.translation->get(), canonical_key);
-        if (result.dsize <= 0)
+        if (!result.len)
             result = _database_fetch(db.get(), canonical_key);
 
-        if (result.dsize <= 0)
+        if (!result.len)
             return "";
     }
 
-    // Cons up a (C++) string to return. The caller must release it.
-    string str = string((const char *)result.dptr, result.dsize);
+    string str = string(result.ptr, result.len);
 
     return _chooseStrByWeight(str, fixed_weight);
 }
@@ -730,17 +717,17 @@ static string _query_database(TextDB &db, string key, bool canonicalise_key,
     }
 
     // Query the DB.
-    datum result;
+    db_text result = { nullptr, 0 };
 
     if (db.translation && !untranslated)
         result = _database_fetch(db.translation->get(), key);
-    if (result.dsize <= 0)
+    if (!result.len)
         result = _database_fetch(db.get(), key);
 
-    if (result.dsize <= 0)
+    if (!result.len)
         return "";
 
-    string str((const char *)result.dptr, result.dsize);
+    string str(result.ptr, result.len);
 
     // <foo> is an alias to key foo
     if (str[0] == '<' && str[str.size() - 2] == '>'
@@ -801,8 +788,7 @@ vector<string> getLongDescBodiesByRegex(const string &regex,
     // On partial translations, this will match only translated descriptions.
     // Not good, but otherwise we'd have to check hundreds of keys, with
     // two queries for each.
-    // SQL can do this in one go, DBM can't.
-    DBM *database = DescriptionDB.translation ?
+    const MappedDB *database = DescriptionDB.translation ?
         DescriptionDB.translation->get() : DescriptionDB.get();
     return _database_find_bodies(database, regex, true, filter);
 }
@@ -7,6 +7,9 @@
 
 #include "dbg-maps.h"
 
+#include <chrono>
+#include <cinttypes>
+
 #include "branch.h"
 #include "chardump.h"
 #include "crash.h"
@@ -19,9 +22,11 @@
 #include "message.h"
 #include "ng-init.h"
 #include "player.h"
+#include "random.h"
 #include "shopping.h"
 #include "state.h"
 #include "stringutil.h"
+#include "version.h"
 #include "view.h"
 
 #ifdef DEBUG_STATISTICS
@@ -46,6 +51,17 @@ static int build_attempts = 0, level_vetoes = 0;
 // Map from message to counts.
 static map<string, int> veto_messages;
 
+// One builder() call, for -bench-levelgen.
+struct levelgen_sample
+{
+    level_id place;
+    string method;
+    string layout;
+    double msecs;
+    int vetoes;
+};
+static vector<levelgen_sample> levelgen_samples;
+
 void mapstat_report_map_build_start()
 {
     build_attempts++;
@@ -71,6 +87,15 @@ static bool _is_disconnected_level()
     return dgn_count_disconnected_zones(true);
 }
 
+// A string level property, or "" if the level doesn't have it; looking it
+// up with operator[] would add it.
+static string _level_prop_string(const string &key)
+{
+    if (!env.properties.exists(key))
+        return "";
+    return env.properties[key].get_string();
+}
+
 static bool _do_build_level()
 {
     clear_messages();
@@ -92,7 +117,19 @@ static bool _do_build_level()
     }
 
     ++levels_tried;
-    if (!builder())
+    const int vetoes_before = level_vetoes;
+    const auto build_start = chrono::steady_clock::now();
+    const bool built = builder();
+    if (crawl_state.levelgen_bench)
+    {
+        const chrono::duration<double, milli> took =
+            chrono::steady_clock::now() - build_start;
+        levelgen_samples.push_back({ level_id::current(),
+            built ? _level_prop_string(BUILD_METHOD_KEY) : "failed",
+            built ? _level_prop_string(LAYOUT_TYPE_KEY) : "",
+            took.count(), level_vetoes - vetoes_before });
+    }
+    if (!built)
     {
         ++levels_failed;
         // Abort level build failure in objstat since the statistics will be
@@ -260,6 +297,9 @@ bool mapstat_build_levels()
              build_attempts ? level_vetoes * 100.0 / build_attempts : 0.0);
         printf("%d..", i + 1);
         fflush(stdout);
+        // Rebuild the same dungeon every time, so only the timing varies.
+        if (crawl_state.levelgen_bench)
+            rng::seed(crawl_state.seed);
         dlua.callfn("dgn_clear_data", "");
         you.uniq_map_tags.clear();
         you.uniq_map_names.clear();
@@ -489,6 +529,82 @@ static void _write_map_stats()
     printf("\n");
 }
 
+struct levelgen_timing
+{
+    vector<double> msecs;
+    int vetoes = 0;
+};
+
+// Nearest-rank percentile of sorted samples.
+static double _percentile(const vector<double> &sorted, int pct)
+{
+    ASSERT(!sorted.empty());
+    size_t rank = (sorted.size() * pct + 99) / 100;
+    return sorted[max<size_t>(rank, 1) - 1];
+}
+
+static void _write_levelgen_timings(FILE *outf, const char *group,
+                                    map<string, levelgen_timing> &timings)
+{
+    for (auto &entry : timings)
+    {
+        vector<double> &ms = entry.second.msecs;
+        sort(ms.begin(), ms.end());
+        double total = 0;
+        for (double t : ms)
+            total += t;
+        fprintf(outf, "%s\t%s\t%u\t%d\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n",
+                group, entry.first.c_str(), (unsigned int)ms.size(),
+                entry.second.vetoes, total, total / ms.size(),
+                _percentile(ms, 50), _percentile(ms, 90),
+                _percentile(ms, 99), ms.back());
+    }
+}
+
+// Write -bench-levelgen results as tab-separated values, one row per branch,
+// build method, layout type and overall. Times are milliseconds spent in
+// builder(), including vetoed attempts.
+static void _write_levelgen_bench()
+{
+    const char *out_file = "levelgen-bench.tsv";
+    FILE *outf = fopen(out_file, "w");
+    if (!outf)
+    {
+        printf("Can't open %s for writing.\n", out_file);
+        return;
+    }
+    printf("Writing level generation timings to %s...", out_file);
+    fflush(stdout);
+
+    map<string, levelgen_timing> by_branch, by_method, by_layout, all;
+    for (const levelgen_sample &sample : levelgen_samples)
+    {
+        for (levelgen_timing *t :
+             { &by_branch[branches[sample.place.branch].abbrevname],
+               &by_method[sample.method.empty() ? "none" : sample.method],
+               &by_layout[sample.layout.empty() ? "none" : sample.layout],
+               &all["all"] })
+        {
+            t->msecs.push_back(sample.msecs);
+            t->vetoes += sample.vetoes;
+        }
+    }
+
+    fprintf(outf, "# version\t%s\n", Version::Long);
+    fprintf(outf, "# seed\t%" PRIu64 "\n", crawl_state.seed);
+    fprintf(outf, "# iterations\t%d\n", SysEnv.map_gen_iters);
+    fprintf(outf, "group\tkey\tlevels\tvetoes\ttotal_ms\tmean_ms"
+                  "\tp50_ms\tp90_ms\tp99_ms\tmax_ms\n");
+    _write_levelgen_timings(outf, "branch", by_branch);
+    _write_levelgen_timings(outf, "method", by_method);
+    _write_levelgen_timings(outf, "layout", by_layout);
+    if (!all.empty())
+        _write_levelgen_timings(outf, "all", all);
+
+    fclose(outf);
+    printf("\n");
+}
+
 bool mapstat_find_forced_map()
 {
     const map_def *map = find_map_by_name(crawl_state.force_map);
@@ -526,6 +642,11 @@ void mapstat_generate_stats()
     run_map_global_preludes();
     run_map_local_preludes();
 
+    // Pick the seed every iteration will be built from: -seed, or a random
+    // one that is then reported.
+    if (crawl_state.levelgen_bench)
+        rng::reset();
+
     _dungeon_places();
 
     clear_messages();
@@ -537,6 +658,13 @@ void mapstat_generate_stats()
 
     mapstat_build_levels();
 
+    if (crawl_state.levelgen_bench)
+    {
+        _write_levelgen_bench();
+        printf("Level generation benchmark complete.\n");
+        return;
+    }
+
     _write_map_stats();
     printf("Map stats complete.\n");
 }
@@ -0,0 +1,358 @@
+/**
+ * @file
+ * @brief Per-turn timing of the main game loop's stages.
+**/
+
+#include "AppHdr.h"
+
+#include "dbg-prof.h"
+
+#ifdef TURN_PROFILE
+
+#include <cinttypes>
+
+#include "chardump.h"
+#include "message.h"
+#include "mon-util.h"
+#include "monster.h"
+#include "player.h"
+#include "stringutil.h"
+#include "syscalls.h"
+#include "version.h"
+
+static const char *stage_names[] =
+{
+    "world_reacts", "handle_monsters", "manage_clouds", "viewwindow",
+    "update_monsters_in_view", "tileweb_send",
+};
+COMPILE_CHECK(ARRAYSZ(stage_names) == NUM_PROF_STAGES);
+
+// Bucket 0 is under 1us; bucket n is [2^(n-1), 2^n) us; the last bucket
+// takes everything from 2^(NUM_PROF_BUCKETS - 2) us (about 4s) up.
+#define NUM_PROF_BUCKETS 24
+#define NUM_SLOW_TURNS 10
+
+struct prof_stage_stats
+{
+    int depth = 0;             // timers of this stage currently running
+    uint64_t turn_us = 0;      // time in the current turn
+    bool ran = false;          // was this stage entered this turn?
+
+    uint64_t turns = 0;        // turns in which the stage ran
+    uint64_t total_us = 0;
+    uint64_t max_us = 0;
+    int max_turn = 0;
+    uint64_t buckets[NUM_PROF_BUCKETS] = {};
+};
+
+struct prof_slow_turn
+{
+    int turn;
+    string place;
+    uint64_t us[NUM_PROF_STAGES];
+};
+
+static prof_stage_stats stages[NUM_PROF_STAGES];
+// The slowest turns by world_reacts() time, with their breakdowns.
+static vector<prof_slow_turn> slow_turns;
+
+static int _prof_bucket(uint64_t us)
+{
+    int bucket = 0;
+    while (us && bucket < NUM_PROF_BUCKETS - 1)
+    {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static void _prof_note_slow_turn()
+{
+    const uint64_t us = stages[PROF_WORLD_REACTS].turn_us;
+    auto fastest = min_element(slow_turns.begin(), slow_turns.end(),
+        [](const prof_slow_turn &a, const prof_slow_turn &b)
+        { return a.us[PROF_WORLD_REACTS] < b.us[PROF_WORLD_REACTS]; });
+
+    if (slow_turns.size() == NUM_SLOW_TURNS
+        && fastest->us[PROF_WORLD_REACTS] >= us)
+    {
+        return;
+    }
+
+    prof_slow_turn turn;
+    turn.turn = you.num_turns;
+    turn.place = level_id::current().describe();
+    for (int i = 0; i < NUM_PROF_STAGES; ++i)
+        turn.us[i] = stages[i].turn_us;
+
+    if (slow_turns.size() == NUM_SLOW_TURNS)
+        *fastest = turn;
+    else
+        slow_turns.push_back(turn);
+}
+
+static void _prof_end_turn()
+{
+    _prof_note_slow_turn();
+
+    for (prof_stage_stats &st : stages)
+    {
+        if (st.ran)
+        {
+            ++st.turns;
+            st.total_us += st.turn_us;
+            if (st.turn_us > st.max_us)
+            {
+                st.max_us = st.turn_us;
+                st.max_turn = you.num_turns;
+            }
+            ++st.buckets[_prof_bucket(st.turn_us)];
+        }
+        st.turn_us = 0;
+        st.ran = false;
+    }
+}
+
+prof_timer::prof_timer(prof_stage _stage)
+    : stage(_stage), outermost(!stages[_stage].depth++)
+{
+    if (outermost)
+        start = chrono::steady_clock::now();
+}
+
+prof_timer::~prof_timer()
+{
+    prof_stage_stats &st = stages[stage];
+    --st.depth;
+    if (!outermost)
+        return;
+
+    st.turn_us += chrono::duration_cast<chrono::microseconds>(
+                      chrono::steady_clock::now() - start).count();
+    st.ran = true;
+
+    if (stage == PROF_WORLD_REACTS)
+        _prof_end_turn();
+}
+
+static const char *mon_action_names[] =
+{
+    "turn", "movement", "spell", "throw", "move",
+};
+COMPILE_CHECK(ARRAYSZ(mon_action_names) == NUM_MON_ACTIONS);
+
+struct prof_mon_stats
+{
+    uint64_t calls = 0;
+    uint64_t total_us = 0;
+    uint64_t counts[NUM_MON_COUNTERS] = {};
+};
+
+static prof_mon_stats mon_actions[NUM_MONSTERS][NUM_MON_ACTIONS];
+// Innermost last.
+static vector<prof_mon_timer *> mon_timers;
+
+prof_mon_timer::prof_mon_timer(const monster *mons, mon_action_kind _kind)
+    : type(mons->type), kind(_kind), outermost(true)
+{
+    ASSERT_RANGE(type, 0, NUM_MONSTERS);
+    for (const prof_mon_timer *timer : mon_timers)
+        if (timer->type == type && timer->kind == kind)
+            outermost = false;
+
+    ++mon_actions[type][kind].calls;
+    mon_timers.push_back(this);
+    if (outermost)
+        start = chrono::steady_clock::now();
+}
+
+prof_mon_timer::~prof_mon_timer()
+{
+    ASSERT(!mon_timers.empty() && mon_timers.back() == this);
+    mon_timers.pop_back();
+    if (outermost)
+    {
+        mon_actions[type][kind].total_us +=
+            chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start).count();
+    }
+}
+
+void prof_mon_timer::count(mon_action_counter what)
+{
+    if (outermost)
+        ++mon_actions[type][kind].counts[what];
+}
+
+/// Charge a tracer or path search to every monster action now running.
+void prof_count_mon_action(mon_action_counter what)
+{
+    for (prof_mon_timer *timer : mon_timers)
+        timer->count(what);
+}
+
+static const char *event_names[] =
+{
+    "los_cache_hit", "los_cache_miss",
+};
+COMPILE_CHECK(ARRAYSZ(event_names) == NUM_PROF_EVENTS);
+
+static uint64_t events[NUM_PROF_EVENTS];
+
+void prof_count_event(prof_event what)
+{
+    ++events[what];
+}
+
+static string _prof_bucket_name(int bucket)
+{
+    if (bucket == NUM_PROF_BUCKETS - 1)
+        return make_stringf("ge_%" PRIu64 "us", (uint64_t)1 << (bucket - 1));
+    return make_stringf("lt_%" PRIu64 "us", (uint64_t)1 << bucket);
+}
+
+/**
+ * Write the profile so far as tab-separated tables: per-stage totals and
+ * histograms of time per turn, then a blank line and the slowest turns.
+ *
+ * @return the file written, or the empty string if it couldn't be.
+ */
+string prof_dump_turns()
+{
+    const string filename = morgue_directory() + "turn-profile-"
+                            + strip_filename_unsafe_chars(you.your_name)
+                            + ".tsv";
+    FILE *f = fopen_u(filename.c_str(), "w");
+    if (!f)
+        return "";
+
+    fprintf(f, "# %s turn profile, %d turns\n",
+            Version::Long, you.num_turns);
+
+    fprintf(f, "stage\tturns\ttotal_us\tmax_us\tmax_turn");
+    for (int b = 0; b < NUM_PROF_BUCKETS; ++b)
+        fprintf(f, "\t%s", _prof_bucket_name(b).c_str());
+    fprintf(f, "\n");
+
+    for (int i = 0; i < NUM_PROF_STAGES; ++i)
+    {
+        const prof_stage_stats &st = stages[i];
+        fprintf(f, "%s\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%d",
+                stage_names[i], st.turns, st.total_us, st.max_us,
+                st.max_turn);
+        for (uint64_t count : st.buckets)
+            fprintf(f, "\t%" PRIu64, count);
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "\nturn\tplace");
+    for (const char *name : stage_names)
+        fprintf(f, "\t%s_us", name);
+    fprintf(f, "\n");
+
+    vector<prof_slow_turn> sorted = slow_turns;
+    sort(sorted.begin(), sorted.end(),
+         [](const prof_slow_turn &a, const prof_slow_turn &b)
+         { return a.us[PROF_WORLD_REACTS] > b.us[PROF_WORLD_REACTS]; });
+    for (const prof_slow_turn &turn : sorted)
+    {
+        fprintf(f, "%d\t%s", turn.turn, turn.place.c_str());
+        for (uint64_t us : turn.us)
+            fprintf(f, "\t%" PRIu64, us);
+        fprintf(f, "\n");
+    }
+
+    fclose(f);
+    return filename;
+}
+
+/**
+ * Write the time spent in, and tracers and path searches done by, each kind
+ * of action of each monster type, most expensive first, tab-separated.
+ *
+ * @return the file written, or the empty string if it couldn't be.
+ */
+string prof_dump_monsters()
+{
+    const string filename = morgue_directory() + "monster-actions-"
+                            + strip_filename_unsafe_chars(you.your_name)
+                            + ".tsv";
+    FILE *f = fopen_u(filename.c_str(), "w");
+    if (!f)
+        return "";
+
+    fprintf(f, "# %s monster action profile, %d turns\n",
+            Version::Long, you.num_turns);
+    fprintf(f, "monster\taction\tcalls\ttotal_us\tmean_us\ttracers"
+               "\tpathfinds\n");
+
+    vector<pair<int, int>> used;
+    for (int mt = 0; mt < NUM_MONSTERS; ++mt)
+        for (int act = 0; act < NUM_MON_ACTIONS; ++act)
+            if (mon_actions[mt][act].calls)
+                used.emplace_back(mt, act);
+    sort(used.begin(), used.end(),
+         [](const pair<int, int> &a, const pair<int, int> &b)
+         {
+             return mon_actions[a.first][a.second].total_us
+                    > mon_actions[b.first][b.second].total_us;
+         });
+
+    for (const auto &entry : used)
+    {
+        const prof_mon_stats &st = mon_actions[entry.first][entry.second];
+        fprintf(f, "%s\t%s\t%" PRIu64 "\t%" PRIu64 "\t%.1f\t%" PRIu64
+                   "\t%" PRIu64 "\n",
+                mons_type_name((monster_type)entry.first, DESC_PLAIN).c_str(),
+                mon_action_names[entry.second], st.calls, st.total_us,
+                (double)st.total_us / st.calls, st.counts[MCOUNT_TRACER],
+                st.counts[MCOUNT_PATHFIND]);
+    }
+
+    fclose(f);
+    return filename;
+}
+
+/// A line per stage of mean and worst time per turn, then a line per event
+/// count, for the wizard command.
+string prof_summary()
+{
+    string summary;
+    for (int i = 0; i < NUM_PROF_STAGES; ++i)
+    {
+        const prof_stage_stats &st = stages[i];
+        summary += make_stringf("%-24s %8" PRIu64 " turns, mean %6" PRIu64
+                                "us, max %8" PRIu64 "us (turn %d)\n",
+                                stage_names[i], st.turns,
+                                st.turns ? st.total_us / st.turns : 0,
+                                st.max_us, st.max_turn);
+    }
+
+    const uint64_t turns = stages[PROF_WORLD_REACTS].turns;
+    for (int i = 0; i < NUM_PROF_EVENTS; ++i)
+    {
+        summary += make_stringf("%-24s %8" PRIu64 " total, %.1f per turn\n",
+                                event_names[i], events[i],
+                                turns ? (double)events[i] / turns : 0.0);
+    }
+    return summary;
+}
+
+#ifdef WIZARD
+void wizard_dump_turn_profile()
+{
+    for (const string &line : split_string("\n", prof_summary()))
+        mprf(MSGCH_DIAGNOSTICS, "%s", line.c_str());
+
+    for (const string &filename : { prof_dump_turns(), prof_dump_monsters() })
+    {
+        if (filename.empty())
+            mprf(MSGCH_ERROR, "Couldn't write the profile.");
+        else
+            mprf("Wrote %s.", filename.c_str());
+    }
+}
+#endif
+
+#endif
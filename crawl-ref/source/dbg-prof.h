@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief Per-turn timing of the main game loop's stages.
+**/
+
+#pragma once
+
+// The stages timed by TURN_PROFILE builds. Times are inclusive, so a stage
+// run from inside another (monster turns inside world_reacts(), say) is
+// counted in both.
+enum prof_stage
+{
+    PROF_WORLD_REACTS,     // world_reacts(); one call is one turn
+    PROF_HANDLE_MONSTERS,  // handle_monsters()
+    PROF_MANAGE_CLOUDS,    // manage_clouds()
+    PROF_VIEWWINDOW,       // viewwindow()
+    PROF_MONSTERS_IN_VIEW, // update_monsters_in_view()
+    PROF_TILEWEB_SEND,     // TilesFramework::redraw()
+    NUM_PROF_STAGES
+};
+
+// The parts of a monster's turn that TURN_PROFILE builds account for per
+// monster type. Also inclusive: MACT_TURN covers all the others.
+enum mon_action_kind
+{
+    MACT_TURN,             // handle_monster_move()
+    MACT_MOVEMENT,         // _handle_movement(), picking where to go
+    MACT_SPELL,            // _do_mon_spell()
+    MACT_THROW,            // handle_throw()
+    MACT_MOVE,             // _monster_move()
+    NUM_MON_ACTIONS
+};
+
+// Expensive operations counted against the monster actions running when
+// they happen.
+enum mon_action_counter
+{
+    MCOUNT_TRACER,         // fire_tracer()
+    MCOUNT_PATHFIND,       // monster_pathfind and shared path searches
+    NUM_MON_COUNTERS
+};
+
+// Frequent, cheap events counted over the whole game and reported per turn.
+enum prof_event
+{
+    PEV_LOS_CACHE_HIT,     // cell_see_cell() answered from the cache
+    PEV_LOS_CACHE_MISS,    // cell_see_cell() recomputing LOS with losight()
+    NUM_PROF_EVENTS
+};
+
+#ifdef TURN_PROFILE
+
+#include <chrono>
+
+// Times its scope as part of a stage. Only the outermost timer of a stage
+// counts, so recursion isn't double counted; when the outermost
+// PROF_WORLD_REACTS timer finishes, the turn's totals go into the
+// histograms.
+class prof_timer
+{
+public:
+    prof_timer(prof_stage _stage);
+    ~prof_timer();
+
+private:
+    prof_stage stage;
+    bool outermost;
+    chrono::steady_clock::time_point start;
+};
+
+class monster;
+
+// Times a monster action and collects the counters hit inside it. As with
+// prof_timer, only the outermost timer for a given monster type and action
+// is timed.
+class prof_mon_timer
+{
+public:
+    prof_mon_timer(const monster *mons, mon_action_kind _kind);
+    ~prof_mon_timer();
+
+    void count(mon_action_counter what);
+
+private:
+    int type;
+    mon_action_kind kind;
+    bool outermost;
+    chrono::steady_clock::time_point start;
+};
+
+void prof_count_mon_action(mon_action_counter what);
+void prof_count_event(prof_event what);
+
+string prof_dump_turns();
+string prof_dump_monsters();
+string prof_summary();
+#ifdef WIZARD
+void wizard_dump_turn_profile();
+#endif
+
+# define PROF_CONCAT_(a, b) a##b
+# define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+# define PROFILE_STAGE(stage) \
+    prof_timer PROF_CONCAT(prof_timer_, __LINE__)(stage)
+# define PROFILE_MONSTER_ACTION(mons, kind) \
+    prof_mon_timer PROF_CONCAT(prof_mon_timer_, __LINE__)(mons, kind)
+# define PROFILE_MONSTER_COUNT(what) prof_count_mon_action(what)
+# define PROFILE_COUNT(what) prof_count_event(what)
+#else
+# define PROFILE_STAGE(stage) ((void) 0)
+# define PROFILE_MONSTER_ACTION(mons, kind) ((void) 0)
+# define PROFILE_MONSTER_COUNT(what) ((void) 0)
+# define PROFILE_COUNT(what) ((void) 0)
+#endif
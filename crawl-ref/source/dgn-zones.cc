@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @brief Labelling the connected zones of the level.
+**/
+
+#include "AppHdr.h"
+
+#include "dgn-zones.h"
+
+// Index of the lowest set bit of a nonzero word.
+static int _lowest_bit(uint64_t word)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    for (; !(word & 1); word >>= 1)
+        ++bit;
+    return bit;
+#endif
+}
+
+// The first x >= from whose bit is set (or clear, if !set), or GXM.
+static int _next_bit(const uint64_t *row, int from, bool set)
+{
+    for (int w = from / 64; w < ZONE_ROW_WORDS; ++w)
+    {
+        uint64_t word = set ? row[w] : ~row[w];
+        if (w == from / 64)
+            word &= ~(uint64_t)0 << (from % 64);
+        if (word)
+            return min(GXM, w * 64 + _lowest_bit(word));
+    }
+    return GXM;
+}
+
+static int _find_root(vector<int> &parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Join two sets, keeping the earlier run as the root.
+static void _unite(vector<int> &parent, int a, int b)
+{
+    a = _find_root(parent, a);
+    b = _find_root(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+zone_map::zone_map(const passability_map &pass)
+    : runs(), zones(0), nzones(0)
+{
+    vector<int> parent;
+    int prev_begin = 0;
+    for (int y = 0; y < GYM; ++y)
+    {
+        const int prev_end = runs.size();
+        const uint64_t *row = pass.row(y);
+
+        int prev = prev_begin;
+        for (int x = _next_bit(row, 0, true); x < GXM;
+             x = _next_bit(row, x, true))
+        {
+            const int end = _next_bit(row, x, false);
+            const int id = runs.size();
+            runs.push_back({y, x, end - 1, 0});
+            parent.push_back(id);
+
+            // Runs in the row above touch this one (diagonals included)
+            // if they overlap [x - 1, end]. Both rows' runs are in order,
+            // so a run left behind here can't touch any later run either.
+            while (prev < prev_end && runs[prev].x2 < x - 1)
+                ++prev;
+            for (int p = prev; p < prev_end && runs[p].x1 <= end; ++p)
+                _unite(parent, p, id);
+
+            x = end;
+        }
+        prev_begin = prev_end;
+    }
+
+    // Roots are the earliest run of their zone, so numbering zones as
+    // their roots come up follows the row-major scan order.
+    vector<int> number(runs.size(), 0);
+    for (int i = 0, size = runs.size(); i < size; ++i)
+    {
+        const int root = _find_root(parent, i);
+        if (!number[root])
+            number[root] = ++nzones;
+        zone_run &run = runs[i];
+        run.zone = number[root];
+        for (int x = run.x1; x <= run.x2; ++x)
+            zones[x][run.y] = run.zone;
+    }
+}
+
+void zone_map::copy_to(travel_distance_grid_t &grid) const
+{
+    for (int x = 0; x < GXM; ++x)
+        for (int y = 0; y < GYM; ++y)
+            grid[x][y] = zones[x][y];
+}
@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief Labelling the connected zones of the level.
+**/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "fixedarray.h"
+#include "travel-defs.h"
+
+#define ZONE_ROW_WORDS ((GXM + 63) / 64)
+
+// One bit per cell of the level, packed a row at a time, saying which cells
+// connectivity checks may pass through.
+class passability_map
+{
+public:
+    passability_map() : bits() { }
+
+    // Mark the cells of the rectangle [tl, br] for which passable(c).
+    template <typename P>
+    passability_map(const coord_def &tl, const coord_def &br, P passable)
+        : bits()
+    {
+        for (int y = tl.y; y <= br.y; ++y)
+            for (int x = tl.x; x <= br.x; ++x)
+                if (passable(coord_def(x, y)))
+                    set(coord_def(x, y));
+    }
+
+    void set(const coord_def &c)
+    {
+        bits[c.y][c.x / 64] |= (uint64_t)1 << (c.x % 64);
+    }
+
+    bool operator()(const coord_def &c) const
+    {
+        return bits[c.y][c.x / 64] >> (c.x % 64) & 1;
+    }
+
+    const uint64_t *row(int y) const { return bits[y]; }
+
+private:
+    uint64_t bits[GYM][ZONE_ROW_WORDS];
+};
+
+// The 8-connected zones of a passability_map, all found in one pass: the
+// runs of passable cells in each row are picked out a word at a time, and
+// joined with union-find to the runs they touch in the row above.
+//
+// Zones are numbered from 1 in the order a row-major scan first reaches
+// them, just as flood filling from each unlabelled cell of such a scan
+// would number them. Impassable cells are in zone 0.
+class zone_map
+{
+public:
+    explicit zone_map(const passability_map &pass);
+
+    int count() const { return nzones; }
+    int operator()(const coord_def &c) const { return zones(c); }
+
+    // Which zones (indexed from 1) have a cell for which wanted(c).
+    template <typename P>
+    vector<bool> zones_where(P wanted) const
+    {
+        vector<bool> found(nzones + 1, false);
+        for (const zone_run &run : runs)
+        {
+            if (found[run.zone])
+                continue;
+            for (int x = run.x1; x <= run.x2; ++x)
+                if (wanted(coord_def(x, run.y)))
+                {
+                    found[run.zone] = true;
+                    break;
+                }
+        }
+        return found;
+    }
+
+    // Call f(c, zone) for every passable cell, in row-major order.
+    template <typename F>
+    void for_each_cell(F f) const
+    {
+        for (const zone_run &run : runs)
+            for (int x = run.x1; x <= run.x2; ++x)
+                f(coord_def(x, run.y), run.zone);
+    }
+
+    // Write the labels over a whole travel_point_distance-style grid.
+    void copy_to(travel_distance_grid_t &grid) const;
+
+private:
+    struct zone_run
+    {
+        int y, x1, x2;
+        int zone;
+    };
+
+    vector<zone_run> runs;
+    FixedArray<short, GXM, GYM> zones;
+    int nzones;
+};
@@ -178,6 +178,68 @@ int dlua_chunk::load(CLua &interp)
     return err;
 }
 
+// Functions loaded by load_cached(), keyed by their bytecode, in the
+// registry of the Lua state they belong to.
+#define DLUA_CHUNK_CACHE "dlua_chunk_cache"
+
+static void _push_chunk_cache(lua_State *ls)
+{
+    lua_getfield(ls, LUA_REGISTRYINDEX, DLUA_CHUNK_CACHE);
+    if (lua_istable(ls, -1))
+        return;
+
+    lua_pop(ls, 1);
+    lua_newtable(ls);
+    lua_pushvalue(ls, -1);
+    lua_setfield(ls, LUA_REGISTRYINDEX, DLUA_CHUNK_CACHE);
+}
+
+// Push the function cached for compiled, if there is one.
+static bool _fetch_cached_chunk(lua_State *ls, const string &compiled)
+{
+    _push_chunk_cache(ls);
+    lua_pushlstring(ls, compiled.data(), compiled.length());
+    lua_rawget(ls, -2);
+    lua_remove(ls, -2);
+    if (lua_isfunction(ls, -1))
+        return true;
+
+    lua_pop(ls, 1);
+    return false;
+}
+
+// Cache the function on top of the stack, leaving it there.
+static void _store_cached_chunk(lua_State *ls, const string &compiled)
+{
+    _push_chunk_cache(ls);
+    lua_pushlstring(ls, compiled.data(), compiled.length());
+    lua_pushvalue(ls, -3);
+    lua_rawset(ls, -3);
+    lua_pop(ls, 1);
+}
+
+// As load(), but reusing the function from an earlier load of the same
+// code if there was one, as there is whenever a vault is resolved again
+// after a failed placement. The function is shared, so it must be given
+// its environment (as dgn_run_map does) each time it is run.
+int dlua_chunk::load_cached(CLua &interp)
+{
+    if (!compiled.empty() && _fetch_cached_chunk(interp, compiled))
+        return 0;
+
+    const int err = load(interp);
+    if (!err && !compiled.empty())
+        _store_cached_chunk(interp, compiled);
+    return err;
+}
+
+// Forget the functions kept by load_cached().
+void dlua_flush_chunk_cache()
+{
+    lua_pushnil(dlua);
+    lua_setfield(dlua, LUA_REGISTRYINDEX, DLUA_CHUNK_CACHE);
+}
+
 int dlua_chunk::run(CLua &interp)
 {
     int err = load(interp);
@@ -56,6 +56,7 @@ public:
     void set_chunk(const string &s);
 
     int load(CLua &interp);
+    int load_cached(CLua &interp);
     int run(CLua &interp);
     int load_call(CLua &interp, const char *function);
     void set_file(const string &s);
@@ -73,3 +74,4 @@ public:
 };
 
 void init_dungeon_lua();
+void dlua_flush_chunk_cache();
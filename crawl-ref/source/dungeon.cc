@@ -33,6 +33,8 @@
 #include "dgn-height.h"
 #include "dgn-overview.h"
 #include "dgn-shoals.h"
+#include "dgn-zones.h"
+#include "dlua.h"
 #include "end.h"
 #include "files.h"
 #include "flood-find.h"
@@ -277,6 +279,10 @@ bool builder(bool enable_random_maps)
     unwind_bool levelgen(crawl_state.generating_level, true);
     rng::generator levelgen_rng(you.where_are_you);
 
+    // Vault Lua loaded while building the last level isn't worth keeping;
+    // this level's retries will load their own.
+    dlua_flush_chunk_cache();
+
 #ifdef DEBUG_DIAGNOSTICS // no point in enabling unless dprf works
     CrawlHashTable &debug_logs = you.props["debug_builder_logs"].get_table();
     string &cur_level_log = debug_logs[level_id::current().describe()].get_string();
@@ -793,52 +799,6 @@ static bool _dgn_square_is_ever_passable(const coord_def &c)
     return _dgn_square_is_passable(c);
 }
 
-static inline void _dgn_point_record_stub(const coord_def &) { }
-
-template <class point_record>
-static bool _dgn_fill_zone(
-    const coord_def &start, int zone,
-    point_record &record_point,
-    bool (*passable)(const coord_def &) = _dgn_square_is_passable,
-    bool (*iswanted)(const coord_def &) = nullptr)
-{
-    bool ret = false;
-    list<coord_def> points[2];
-    int cur = 0;
-
-    // No bounds checks, assuming the level has at least one layer of
-    // rock border.
-
-    for (points[cur].push_back(start); !points[cur].empty();)
-    {
-        for (const auto &c : points[cur])
-        {
-            travel_point_distance[c.x][c.y] = zone;
-
-            if (iswanted && iswanted(c))
-                ret = true;
-
-            for (adjacent_iterator ai(c); ai; ++ai)
-            {
-                const coord_def& cp = *ai;
-                if (!map_bounds(cp)
-                    || travel_point_distance[cp.x][cp.y] || !passable(cp))
-                {
-                    continue;
-                }
-
-                travel_point_distance[cp.x][cp.y] = zone;
-                record_point(cp);
-                points[!cur].push_back(cp);
-            }
-        }
-
-        points[cur].clear();
-        cur = !cur;
-    }
-    return ret;
-}
-
 static bool _is_perm_down_stair(const coord_def &c)
 {
     switch (grd(c))
@@ -946,80 +906,50 @@ static bool _is_exit_stair(const coord_def &c)
 //
 // If fill is non-zero, it fills any disconnected regions with fill.
 //
-static int _process_disconnected_zones(int x1, int y1, int x2, int y2,
-                bool choose_stairless,
+static int _process_disconnected_zones(bool choose_stairless,
                 dungeon_feature_type fill,
                 bool (*passable)(const coord_def &) = _dgn_square_is_passable)
 {
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    int ngood = 0;
-    for (int y = y1; y <= y2 ; ++y)
+    const zone_map zones(passability_map(coord_def(0, 0),
+                                         coord_def(GXM - 1, GYM - 1),
+                                         passable));
+    zones.copy_to(travel_point_distance);
+
+    vector<bool> has_exit_stair(zones.count() + 1, false);
+    if (choose_stairless)
     {
-        for (int x = x1; x <= x2; ++x)
-        {
-            if (!map_bounds(x, y)
-                || travel_point_distance[x][y]
-                || !passable(coord_def(x, y)))
-            {
-                continue;
-            }
+        has_exit_stair = zones.zones_where(at_branch_bottom() ?
+                                           _is_upwards_exit_stair :
+                                           _is_exit_stair);
+    }
 
-            const bool found_exit_stair =
-                _dgn_fill_zone(coord_def(x, y), ++nzones,
-                               _dgn_point_record_stub,
-                               passable,
-                               choose_stairless ? (at_branch_bottom() ?
-                                                   _is_upwards_exit_stair :
-                                                   _is_exit_stair) : nullptr);
-
-            // If we want only stairless zones, screen out zones that did
-            // have stairs.
-            if (choose_stairless && found_exit_stair)
-                ++ngood;
-            else if (fill)
-            {
-                // Don't fill in areas connected to vaults.
-                // We want vaults to be accessible; if the area is disconneted
-                // from the rest of the level, this will cause the level to be
-                // vetoed later on.
-                bool veto = false;
-                vector<coord_def> coords;
-                for (int fy = y1; fy <= y2 ; ++fy)
-                {
-                    for (int fx = x1; fx <= x2; ++fx)
-                    {
-                        if (travel_point_distance[fx][fy] == nzones)
-                        {
-                            if (map_masked(coord_def(fx, fy), MMT_VAULT))
-                            {
-                                veto = true;
-                                break;
-                            }
-                            else
-                                coords.emplace_back(fx, fy);
-                        }
-                    }
-                    if (veto)
-                        break;
-                }
-                if (!veto)
-                {
-                    for (auto c : coords)
-                        _set_grd(c, fill);
-                }
-            }
-        }
+    // If we want only stairless zones, screen out zones that did have
+    // stairs.
+    const int ngood = count(has_exit_stair.begin(), has_exit_stair.end(),
+                            true);
+
+    if (fill)
+    {
+        // Don't fill in areas connected to vaults.
+        // We want vaults to be accessible; if the area is disconneted
+        // from the rest of the level, this will cause the level to be
+        // vetoed later on.
+        const vector<bool> has_vault = zones.zones_where(
+            [](const coord_def &c) { return map_masked(c, MMT_VAULT); });
+        zones.for_each_cell([&](const coord_def &c, int zone)
+        {
+            if (!has_exit_stair[zone] && !has_vault[zone])
+                _set_grd(c, fill);
+        });
     }
 
-    return nzones - ngood;
+    return zones.count() - ngood;
 }
 
 int dgn_count_disconnected_zones(bool choose_stairless,
                                  dungeon_feature_type fill)
 {
-    return _process_disconnected_zones(0, 0, GXM-1, GYM-1, choose_stairless,
-                                       fill);
+    return _process_disconnected_zones(choose_stairless, fill);
 }
 
 static void _fixup_hell_stairs()
@@ -1853,88 +1783,70 @@ static bool _fixup_stone_stairs(bool preserve_vault_stairs)
 static bool _add_feat_if_missing(bool (*iswanted)(const coord_def &),
                                  dungeon_feature_type feat)
 {
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    for (int y = 0; y < GYM; ++y)
-        for (int x = 0; x < GXM; ++x)
-        {
-            // [ds] Use dgn_square_is_passable instead of
-            // dgn_square_travel_ok here, for we'll otherwise
-            // fail on floorless isolated pocket in vaults (like the
-            // altar surrounded by deep water), and trigger the assert
-            // downstairs.
-            const coord_def gc(x, y);
-            if (!map_bounds(x, y)
-                || travel_point_distance[x][y] // already covered previously
-                || !_dgn_square_is_passable(gc))
-            {
-                continue;
-            }
+    // [ds] Use dgn_square_is_passable instead of
+    // dgn_square_travel_ok here, for we'll otherwise
+    // fail on floorless isolated pocket in vaults (like the
+    // altar surrounded by deep water), and trigger the assert
+    // downstairs.
+    const zone_map zones(passability_map(coord_def(0, 0),
+                                         coord_def(GXM - 1, GYM - 1),
+                                         _dgn_square_is_passable));
+    zones.copy_to(travel_point_distance);
 
-            if (_dgn_fill_zone(gc, ++nzones, _dgn_point_record_stub,
-                               _dgn_square_is_passable, iswanted))
-            {
-                continue;
-            }
+    const vector<bool> has_wanted = zones.zones_where(iswanted);
+    const vector<bool> has_feat = zones.zones_where(
+        [feat](const coord_def &c) { return grd(c) == feat; });
 
-            bool found_feature = false;
-            for (rectangle_iterator ri(0); ri; ++ri)
-            {
-                if (grd(*ri) == feat
-                    && travel_point_distance[ri->x][ri->y] == nzones)
-                {
-                    found_feature = true;
-                    break;
-                }
-            }
+    for (int zone = 1; zone <= zones.count(); ++zone)
+    {
+        if (has_wanted[zone] || has_feat[zone])
+            continue;
 
-            if (found_feature)
+        bool found_feature = false;
+        int i = 0;
+        while (i++ < 2000)
+        {
+            coord_def rnd;
+            rnd.x = random2(GXM);
+            rnd.y = random2(GYM);
+            if (grd(rnd) != DNGN_FLOOR)
                 continue;
 
-            int i = 0;
-            while (i++ < 2000)
-            {
-                coord_def rnd;
-                rnd.x = random2(GXM);
-                rnd.y = random2(GYM);
-                if (grd(rnd) != DNGN_FLOOR)
-                    continue;
+            if (zones(rnd) != zone)
+                continue;
 
-                if (travel_point_distance[rnd.x][rnd.y] != nzones)
-                    continue;
+            _set_grd(rnd, feat);
+            found_feature = true;
+            break;
+        }
 
-                _set_grd(rnd, feat);
-                found_feature = true;
-                break;
-            }
+        if (found_feature)
+            continue;
 
-            if (found_feature)
+        for (rectangle_iterator ri(0); ri; ++ri)
+        {
+            if (grd(*ri) != DNGN_FLOOR)
                 continue;
 
-            for (rectangle_iterator ri(0); ri; ++ri)
-            {
-                if (grd(*ri) != DNGN_FLOOR)
-                    continue;
-
-                if (travel_point_distance[ri->x][ri->y] != nzones)
-                    continue;
+            if (zones(*ri) != zone)
+                continue;
 
-                _set_grd(*ri, feat);
-                found_feature = true;
-                break;
-            }
+            _set_grd(*ri, feat);
+            found_feature = true;
+            break;
+        }
 
-            if (found_feature)
-                continue;
+        if (found_feature)
+            continue;
 
 #ifdef DEBUG_DIAGNOSTICS
-            dump_map("debug.map", true, true);
+        dump_map("debug.map", true, true);
 #endif
-            // [ds] Too many normal cases trigger this ASSERT, including
-            // rivers that surround a stair with deep water.
-            // die("Couldn't find region.");
-            return false;
-        }
+        // [ds] Too many normal cases trigger this ASSERT, including
+        // rivers that surround a stair with deep water.
+        // die("Couldn't find region.");
+        return false;
+    }
 
     return true;
 }
@@ -4259,13 +4171,13 @@ static const vault_placement *_build_vault_impl(const map_def *vault,
     if (!build_only && (placed_vault_orientation != MAP_ENCOMPASS || is_layout)
         && player_in_branch(BRANCH_SWAMP))
     {
-        _process_disconnected_zones(0, 0, GXM-1, GYM-1, true, DNGN_TREE);
+        _process_disconnected_zones(true, DNGN_TREE);
         // do a second pass to remove tele closets consisting of deep water
         // created by the first pass -- which will not fill in deep water
         // because it is treated as impassable.
         // TODO: get zonify to prevent these?
         // TODO: does this come up anywhere outside of swamp?
-        _process_disconnected_zones(0, 0, GXM-1, GYM-1, true, DNGN_TREE,
+        _process_disconnected_zones(true, DNGN_TREE,
                                     _dgn_square_is_ever_passable);
     }
 
@@ -6500,20 +6412,10 @@ static bool _fixup_interlevel_connectivity()
     has_down[0] = has_down[1] = has_down[2] = false;
 
     // Find up stairs and down stairs on the current level.
-    memset(travel_point_distance, 0, sizeof(travel_distance_grid_t));
-    int nzones = 0;
-    for (rectangle_iterator ri(0); ri; ++ri)
-    {
-        if (!map_bounds(ri->x, ri->y)
-            || travel_point_distance[ri->x][ri->y]
-            || !dgn_square_travel_ok(*ri))
-        {
-            continue;
-        }
-
-        _dgn_fill_zone(*ri, ++nzones, _dgn_point_record_stub,
-                       dgn_square_travel_ok, nullptr);
-    }
+    const zone_map zones(passability_map(coord_def(0, 0),
+                                         coord_def(GXM - 1, GYM - 1),
+                                         dgn_square_travel_ok));
+    zones.copy_to(travel_point_distance);
 
     int max_region = 0;
     for (rectangle_iterator ri(0); ri; ++ri)
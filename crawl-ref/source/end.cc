@@ -14,6 +14,7 @@
 #include "colour.h"
 #include "crash.h"
 #include "database.h"
+#include "dbg-prof.h"
 #include "describe.h"
 #include "dungeon.h"
 #include "files.h"
@@ -201,6 +202,10 @@ NORETURN void end(int exit_code, bool print_error, const char *format, ...)
 #ifdef DEBUG_PROPS
         dump_prop_accesses();
 #endif
+#ifdef TURN_PROFILE
+        prof_dump_turns();
+        prof_dump_monsters();
+#endif
 
         if (!error.empty())
         {
@@ -1783,6 +1783,13 @@ bool pregen_dungeon(const level_id &stopping_point)
         // is possible to call this in a way that doesn't lead to generation.
         bool generated = false;
 
+        // Levels must be built one at a time, in exactly this order. The
+        // builder works directly on the global `env` and `you`, runs vault
+        // code in the single shared lua state, and each level depends on
+        // what earlier levels placed: uniques, unrand artefacts, uniq_ and
+        // chance_ vault tags, and the per-branch rng state. Building
+        // branches concurrently into separate buffers would change which
+        // vaults and uniques each level gets for a given seed.
         for (const level_id &new_level : to_generate)
         {
             string status = "\nbuilding ";
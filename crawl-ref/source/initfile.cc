@@ -17,6 +17,7 @@
 #include "json-wrapper.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cinttypes>
 #include <cctype>
 #include <cstdio>
@@ -3865,6 +3866,7 @@ enum commandline_option_type
     CLO_MAPSTAT,
     CLO_MAPSTAT_DUMP_DISCONNECT,
     CLO_OBJSTAT,
+    CLO_BENCH_LEVELGEN,
     CLO_ITERATIONS,
     CLO_FORCE_MAP,
     CLO_ARENA,
@@ -3896,6 +3898,7 @@ enum commandline_option_type
     CLO_SAVE_JSON,
     CLO_GAMETYPES_JSON,
     CLO_EDIT_BONES,
+    CLO_BENCH_SAVE,
 #ifdef USE_TILE_WEB
     CLO_WEBTILES_SOCKET,
     CLO_AWAIT_CONNECTION,
@@ -3909,12 +3912,12 @@ static const char *cmd_ops[] =
 {
     "scores", "name", "species", "background", "dir", "rc", "rcdir", "tscores",
     "vscores", "scorefile", "morgue", "macro", "mapstat", "dump-disconnect",
-    "objstat", "iters", "force-map", "arena", "dump-maps", "test", "script",
+    "objstat", "bench-levelgen", "iters", "force-map", "arena", "dump-maps", "test", "script",
     "builddb", "help", "version", "seed", "pregen", "save-version", "sprint",
     "extra-opt-first", "extra-opt-last", "sprint-map", "edit-save",
     "print-charset", "tutorial", "wizard", "explore", "no-save", "gdb",
     "no-gdb", "nogdb", "throttle", "no-throttle", "playable-json",
-    "branches-json", "save-json", "gametypes-json", "bones",
+    "branches-json", "save-json", "gametypes-json", "bones", "bench-save",
 #ifdef USE_TILE_WEB
     "webtiles-socket", "await-connection", "print-webtiles-options",
 #endif
@@ -4444,6 +4447,103 @@ static void _edit_bones(int argc, char **argv)
     }
 }
 
+static double _mb_per_sec(size_t bytes, chrono::steady_clock::duration t)
+{
+    const double secs = chrono::duration<double>(t).count();
+    return secs > 0 ? bytes / secs / (1024 * 1024) : 0;
+}
+
+// Round-trip every chunk of the given saves through each codec, timing it.
+static void _bench_save(int argc, char **argv)
+{
+    if (argc < 1 || !strcmp(argv[0], "help"))
+    {
+        printf("Usage: crawl --bench-save <name> [<name>...]\n"
+               "  Reports compression and decompression speed and ratio for\n"
+               "  each save codec, using the chunks of the given saves.\n");
+        return;
+    }
+
+    vector<vector<char>> corpus;
+    size_t total = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        try
+        {
+            string filename = argv[i];
+            // Check for the exact filename first, then go by char name.
+            if (!file_exists(filename))
+                filename = get_savedir_filename(filename);
+            package save(filename.c_str(), false);
+
+            for (const string &chunk : save.list_chunks())
+            {
+                chunk_reader in(&save, chunk);
+                corpus.emplace_back();
+                in.read_all(corpus.back());
+                total += corpus.back().size();
+            }
+        }
+        catch (ext_fail_exception &fe)
+        {
+            fprintf(stderr, "Error: %s: %s\n", argv[i], fe.what());
+        }
+    }
+    if (!total)
+        FAIL("No save data to benchmark.\n");
+
+    printf("%u chunks, %u bytes uncompressed\n", (unsigned int)corpus.size(),
+           (unsigned int)total);
+    printf("%-10s %12s %12s %8s\n", "codec", "pack MB/s", "unpack MB/s",
+           "ratio");
+
+    vector<char> buf;
+    for (int c = 0; c < NUM_CODECS; c++)
+    {
+        const chunk_codec codec = static_cast<chunk_codec>(c);
+        try
+        {
+            package scratch; // an unlinked temporary file
+
+            const auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < corpus.size(); i++)
+            {
+                chunk_writer out(&scratch, to_string(i), codec);
+                if (!corpus[i].empty())
+                    out.write(&corpus[i][0], corpus[i].size());
+            }
+            const auto packed = chrono::steady_clock::now();
+
+            for (size_t i = 0; i < corpus.size(); i++)
+            {
+                chunk_reader in(&scratch, to_string(i));
+                buf.resize(corpus[i].size() + 1);
+                if (in.read(&buf[0], buf.size()) != corpus[i].size()
+                    || !equal(corpus[i].begin(), corpus[i].end(), buf.begin()))
+                {
+                    FAIL("%s: chunk %u did not round-trip!\n",
+                         codec_name(codec), (unsigned int)i);
+                }
+            }
+            const auto unpacked = chrono::steady_clock::now();
+
+            scratch.commit();
+            size_t size = 0;
+            for (size_t i = 0; i < corpus.size(); i++)
+                size += scratch.get_chunk_compressed_length(to_string(i));
+
+            printf("%-10s %12.1f %12.1f %8.3f\n", codec_name(codec),
+                   _mb_per_sec(total, packed - start),
+                   _mb_per_sec(total, unpacked - packed),
+                   (double)size / total);
+        }
+        catch (ext_fail_exception &fe)
+        {
+            FAIL("Error: %s\n", fe.what());
+        }
+    }
+}
+
 #undef FAIL
 
 #ifdef USE_TILE_WEB
@@ -4642,8 +4742,8 @@ bool parse_args(int argc, char **argv, bool rc_only)
     COMPILE_CHECK(ARRAYSZ(cmd_ops) == CLO_NOPS);
 
 #ifndef DEBUG_STATISTICS
-    const char *dbg_stat_err = "mapstat and objstat are available only in "
-                               "DEBUG_STATISTICS builds.\n";
+    const char *dbg_stat_err = "mapstat, objstat and bench-levelgen are "
+                               "available only in DEBUG_STATISTICS builds.\n";
 #endif
 
     if (crawl_state.command_line_arguments.empty())
@@ -4788,9 +4888,15 @@ bool parse_args(int argc, char **argv, bool rc_only)
 
         case CLO_MAPSTAT:
         case CLO_OBJSTAT:
+        case CLO_BENCH_LEVELGEN:
 #ifdef DEBUG_STATISTICS
             if (o == CLO_MAPSTAT)
                 crawl_state.map_stat_gen = true;
+            else if (o == CLO_BENCH_LEVELGEN)
+            {
+                crawl_state.map_stat_gen = true;
+                crawl_state.levelgen_bench = true;
+            }
             else
                 crawl_state.obj_stat_gen = true;
 #ifdef USE_TILE_LOCAL
@@ -4798,7 +4904,7 @@ bool parse_args(int argc, char **argv, bool rc_only)
 #endif
 
             if (!SysEnv.map_gen_iters)
-                SysEnv.map_gen_iters = 100;
+                SysEnv.map_gen_iters = crawl_state.levelgen_bench ? 10 : 100;
             if (next_is_param)
             {
                 SysEnv.map_gen_range.reset(new depth_ranges);
@@ -5039,6 +5145,10 @@ bool parse_args(int argc, char **argv, bool rc_only)
             _edit_bones(argc - current - 1, argv + current + 1);
             end(0);
 
+        case CLO_BENCH_SAVE:
+            _bench_save(argc - current - 1, argv + current + 1);
+            end(0);
+
         case CLO_SEED:
             if (!next_is_param)
             {
@@ -344,28 +344,28 @@ static int dgn_map(lua_State *ls)
         return 0;
     }
 
-    vector<string> &lines = map->map.get_lines();
+    map_lines &lines = map->map;
     int which_line = luaL_safe_checkint(ls, 2);
     if (which_line < 0)
-        which_line += (int) lines.size();
+        which_line += lines.height();
     if (lua_gettop(ls) == 2)
     {
-        if (which_line < 0 || which_line >= (int) lines.size())
+        if (which_line < 0 || which_line >= lines.height())
         {
             luaL_error(ls,
-                       lines.empty()? "Map is empty"
+                       !lines.height()? "Map is empty"
                        : make_stringf("Line %d out of range (0-%d)",
                                       which_line,
-                                      (int)lines.size() - 1).c_str());
+                                      lines.height() - 1).c_str());
         }
-        PLUARET(string, lines[which_line].c_str());
+        PLUARET(string, lines.get_line(which_line).c_str());
     }
 
     if (lua_isnil(ls, 3))
     {
-        if (which_line >= 0 && which_line < (int) lines.size())
+        if (which_line >= 0 && which_line < lines.height())
         {
-            lines.erase(lines.begin() + which_line);
+            lines.erase_line(which_line);
             PLUARET(boolean, true);
         }
         return 0;
@@ -378,15 +378,7 @@ static int dgn_map(lua_State *ls)
                    make_stringf("Index %d out of range", which_line).c_str());
     }
 
-    if (which_line < (int) lines.size())
-    {
-        lines[which_line] = newline;
-        return 0;
-    }
-
-    lines.reserve(which_line + 1);
-    lines.resize(which_line + 1, "");
-    lines[which_line] = newline;
+    lines.set_line(which_line, newline);
     return 0;
 }
 
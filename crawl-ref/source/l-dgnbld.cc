@@ -15,6 +15,7 @@
 #include "dgn-layouts.h"
 #include "dgn-shoals.h"
 #include "dgn-swamp.h"
+#include "dgn-zones.h"
 #include "dungeon.h"
 
 static const char *exit_glyphs = "{}()[]<>@";
@@ -148,17 +149,14 @@ static bool _valid_coord(lua_State *ls, map_lines &lines, int x, int y, bool err
 // multiple functions (including make_box).
 static int _fill_area(lua_State */*ls*/, map_lines &lines, int x1, int y1, int x2, int y2, char fill)
 {
-    for (int y = y1; y <= y2; ++y)
-        for (int x = x1; x <= x2; ++x)
-            lines(x, y) = fill;
-
+    lines.fill_rect(coord_def(x1, y1), coord_def(x2, y2), fill);
     return 0;
 }
 
 static void _border_area(map_lines &lines, int x1, int y1, int x2, int y2, char border)
 {
-    for (int x = x1 + 1; x < x2; ++x)
-        lines(x, y1) = border, lines(x, y2) = border;
+    lines.fill_rect(coord_def(x1, y1), coord_def(x2, y1), border);
+    lines.fill_rect(coord_def(x1, y2), coord_def(x2, y2), border);
     for (int y = y1; y <= y2; ++y)
         lines(x1, y) = border, lines(x2, y) = border;
 }
@@ -636,31 +634,20 @@ LUAFN(dgn_fill_disconnected)
     TABLE_STR(ls, passable, traversable_glyphs);
     TABLE_STR(ls, wanted, exit_glyphs);
 
-    coord_def tl(x1, y1);
-    coord_def br(x2, y2);
+    const glyph_set pass(passable);
+    const glyph_set want(wanted);
+    const zone_map zones(passability_map(coord_def(x1, y1), coord_def(x2, y2),
+        [&](const coord_def &c) { return pass[lines(c)]; }));
 
-    travel_distance_grid_t tpd;
-    memset(tpd, 0, sizeof(tpd));
-
-    int nzones = 0;
-    for (rectangle_iterator ri(tl, br); ri; ++ri)
+    // Fill every passable square of zones where wanted wasn't found with
+    // the 'fill' glyph.
+    const vector<bool> found = zones.zones_where(
+        [&](const coord_def &c) { return want[lines(c)]; });
+    zones.for_each_cell([&](const coord_def &c, int zone)
     {
-        const coord_def c = *ri;
-        if (tpd[c.x][c.y] || passable && !strchr(passable, lines(c)))
-            continue;
-
-        if (lines.fill_zone(tpd, c, tl, br, ++nzones, wanted, passable))
-            continue;
-
-        // If wanted wasn't found, fill every passable square that
-        // we just found with the 'fill' glyph.
-        for (rectangle_iterator f(tl, br); f; ++f)
-        {
-            const coord_def fc = *f;
-            if (tpd[fc.x][fc.y] == nzones)
-                lines(fc) = fill;
-        }
-    }
+        if (!found[zone])
+            lines(c) = fill;
+    });
 
     return 0;
 }
@@ -699,11 +686,12 @@ LUAFN(dgn_find_in_area)
 
     TABLE_STR(ls, find, "x");
 
+    const glyph_set wanted(find);
     int x, y;
 
     for (x = x1; x <= x2; x++)
         for (y = y1; y <= y2; y++)
-            if (strchr(find, lines(x, y))
+            if (wanted[lines(x, y)]
                 || (find_vault && (env.level_map_mask(coord_def(x,y))
                                    & MMT_VAULT)))
             {
@@ -1336,9 +1324,10 @@ LUAFN(dgn_remove_isolated_glyphs)
     if (y2 >= lines.height() - 1)
         y2 = lines.height() - 2;
 
+    const glyph_set wanted(find);
     for (int y = y1; y <= y2; ++y)
         for (int x = x1; x <= x2; ++x)
-            if (strchr(find, lines(x, y)) && x_chance_in_y(percent, 100))
+            if (wanted[lines(x, y)] && x_chance_in_y(percent, 100))
             {
                 bool do_replace = true;
                 for (radius_iterator ri(coord_def(x, y), 1,
@@ -1346,7 +1335,7 @@ LUAFN(dgn_remove_isolated_glyphs)
                                         true); ri; ++ri)
                 {
                     if (_valid_coord(ls, lines, ri->x, ri->y, false))
-                        if (strchr(find, lines(*ri)))
+                        if (wanted[lines(*ri)])
                         {
                             do_replace = false;
                             break;
@@ -1408,10 +1397,12 @@ LUAFN(dgn_widen_paths)
 
     // We do not replace this as we go to avoid favouring some directions.
     vector<coord_def> coord_to_replace;
+    const glyph_set wanted(find);
+    const glyph_set passable_glyphs(passable);
 
     for (int y = y1; y <= y2; ++y)
         for (int x = x1; x <= x2; ++x)
-            if (strchr(find, lines(x, y)))
+            if (wanted[lines(x, y)])
             {
                 int neighbour_count = 0;
                 for (radius_iterator ri(coord_def(x, y), 1,
@@ -1419,7 +1410,7 @@ LUAFN(dgn_widen_paths)
                                         true); ri; ++ri)
                 {
                     if (_valid_coord(ls, lines, ri->x, ri->y, false))
-                        if (strchr(passable, lines(*ri)))
+                        if (passable_glyphs[lines(*ri)])
                             neighbour_count++;
                 }
 
@@ -1762,10 +1753,8 @@ LUAFN(dgn_replace_area)
     if (!_coords(ls, lines, x1, y1, x2, y2))
         return 0;
 
-    for (int y = y1; y <= y2; ++y)
-        for (int x = x1; x <= x2; ++x)
-            if (strchr(find, lines(x, y)))
-                lines(x, y) = replace;
+    lines.replace_in_rect(coord_def(x1, y1), coord_def(x2, y2), find,
+                          replace);
 
     return 0;
 }
@@ -2264,6 +2253,271 @@ LUAFN(dgn_farthest_from)
     return 2;
 }
 
+// Like _coords, but the box must lie within the map.
+static bool _area_coords(lua_State *ls, map_lines &lines,
+                         int &x1, int &y1, int &x2, int &y2)
+{
+    return _coords(ls, lines, x1, y1, x2, y2)
+           && _valid_coord(ls, lines, x1, y1)
+           && _valid_coord(ls, lines, x2, y2);
+}
+
+// Everything from here to the layout wrappers works on a whole area in one
+// call, so that Lua layouts needn't go through mapgrd a cell at a time.
+
+// The glyphs of a box of the map as one string, row by row.
+LUAFN(dgn_get_area)
+{
+    LINES(ls, 1, map, lines);
+
+    int x1, y1, x2, y2;
+    if (!_area_coords(ls, lines, x1, y1, x2, y2))
+        return 0;
+
+    const int width = x2 - x1 + 1;
+    string area;
+    area.reserve(width * (y2 - y1 + 1));
+    for (int y = y1; y <= y2; ++y)
+        area.append(lines.row(y) + x1, width);
+
+    lua_pushlstring(ls, area.data(), area.size());
+    return 1;
+}
+
+// Overwrite a box of the map with the string glyphs, row by row as
+// get_area returns it. Glyphs past the end of a short line are dropped.
+LUAFN(dgn_set_area)
+{
+    LINES(ls, 1, map, lines);
+
+    int x1, y1, x2, y2;
+    if (!_area_coords(ls, lines, x1, y1, x2, y2))
+        return 0;
+
+    TABLE_STR(ls, glyphs, "");
+
+    const int width = x2 - x1 + 1;
+    const int size = width * (y2 - y1 + 1);
+    if ((int) strlen(glyphs) != size)
+    {
+        return luaL_error(ls, "set_area wants %d glyphs, not %d.", size,
+                          (int) strlen(glyphs));
+    }
+
+    for (int y = y1; y <= y2; ++y, glyphs += width)
+    {
+        const int len = min(x2 + 1, lines.line_length(y)) - x1;
+        if (len > 0)
+            memcpy(lines.row(y) + x1, glyphs, len);
+    }
+
+    return 0;
+}
+
+// For every cell of a box, the number of its neighbours that are in find,
+// as a string of digits laid out as in get_area. Neighbours off the map
+// don't count.
+LUAFN(dgn_count_neighbors_in_area)
+{
+    LINES(ls, 1, map, lines);
+
+    int x1, y1, x2, y2;
+    if (!_area_coords(ls, lines, x1, y1, x2, y2))
+        return 0;
+
+    TABLE_STR(ls, find, "");
+
+    const glyph_set wanted(find);
+    const int wide = lines.width(), high = lines.height();
+    string counts;
+    counts.reserve((x2 - x1 + 1) * (y2 - y1 + 1));
+    for (int y = y1; y <= y2; ++y)
+        for (int x = x1; x <= x2; ++x)
+        {
+            int count = 0;
+            for (int ny = max(y - 1, 0); ny <= min(y + 1, high - 1); ++ny)
+            {
+                const char *line = lines.row(ny);
+                for (int nx = max(x - 1, 0); nx <= min(x + 1, wide - 1); ++nx)
+                    count += wanted[line[nx]];
+            }
+            counts += (char) ('0' + count - wanted[lines(x, y)]);
+        }
+
+    lua_pushlstring(ls, counts.data(), counts.size());
+    return 1;
+}
+
+// Run a cellular automaton over a box, as cave layouts do. Cells whose
+// glyphs are in alive are alive; a dead cell with a number of live
+// neighbours in birth becomes a wall glyph, and a live cell with a number
+// not in survive becomes a floor glyph. Cells off the map count as alive if
+// edges_alive is set, and the padding past a short line is left alone.
+// Every cell of a pass sees the map from before it.
+LUAFN(dgn_cellular_step)
+{
+    LINES(ls, 1, map, lines);
+
+    int x1, y1, x2, y2;
+    if (!_area_coords(ls, lines, x1, y1, x2, y2))
+        return 0;
+
+    TABLE_STR(ls, alive, "x");
+    TABLE_CHAR(ls, wall, 'x');
+    TABLE_CHAR(ls, floor, '.');
+    TABLE_STR(ls, birth, "5678");
+    TABLE_STR(ls, survive, "45678");
+    TABLE_BOOL(ls, edges_alive, true);
+    TABLE_INT(ls, passes, 1);
+
+    bool born[9] = {}, survives[9] = {};
+    for (const char *c = birth; *c; ++c)
+        if (*c >= '0' && *c <= '8')
+            born[*c - '0'] = true;
+    for (const char *c = survive; *c; ++c)
+        if (*c >= '0' && *c <= '8')
+            survives[*c - '0'] = true;
+
+    const glyph_set live(alive);
+    const int wide = lines.width(), high = lines.height();
+
+    // Live cells, with a one cell border for off the map.
+    const int stride = wide + 2;
+    vector<char> state(stride * (high + 2), edges_alive);
+
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (int y = 0; y < high; ++y)
+        {
+            const char *line = lines.row(y);
+            char *cell = &state[(y + 1) * stride + 1];
+            for (int x = 0; x < wide; ++x)
+                cell[x] = live[line[x]];
+        }
+
+        for (int y = y1; y <= y2; ++y)
+        {
+            char *line = lines.row(y);
+            const char *above = &state[y * stride + 1];
+            const char *here = above + stride;
+            const char *below = here + stride;
+            const int last = min(x2, lines.line_length(y) - 1);
+            for (int x = x1; x <= last; ++x)
+            {
+                const int count = above[x - 1] + above[x] + above[x + 1]
+                                  + here[x - 1] + here[x + 1]
+                                  + below[x - 1] + below[x] + below[x + 1];
+                if (here[x] && !survives[count])
+                    line[x] = floor;
+                else if (!here[x] && born[count])
+                    line[x] = wall;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Replace the cells connected to (x, y) through passable glyphs, including
+// diagonally, with fill, and return how many there were. The padding past a
+// short line is never passable.
+LUAFN(dgn_flood_fill)
+{
+    LINES(ls, 1, map, lines);
+
+    TABLE_INT(ls, x, -1);
+    TABLE_INT(ls, y, -1);
+    TABLE_STR(ls, passable, traversable_glyphs);
+    TABLE_CHAR(ls, fill, '.');
+
+    if (!_valid_coord(ls, lines, x, y))
+        return 0;
+
+    const glyph_set pass(passable);
+    if (x >= lines.line_length(y) || !pass[lines(x, y)])
+        PLUARET(number, 0);
+
+    const int wide = lines.width(), high = lines.height();
+    vector<bool> seen(wide * high, false);
+    vector<coord_def> todo;
+    todo.emplace_back(x, y);
+    seen[y * wide + x] = true;
+
+    int filled = 0;
+    while (!todo.empty())
+    {
+        const coord_def c = todo.back();
+        todo.pop_back();
+        lines(c) = fill;
+        ++filled;
+
+        for (int ny = max(c.y - 1, 0); ny <= min(c.y + 1, high - 1); ++ny)
+            for (int nx = max(c.x - 1, 0); nx <= min(c.x + 1, wide - 1); ++nx)
+            {
+                if (seen[ny * wide + nx] || nx >= lines.line_length(ny)
+                    || !pass[lines(nx, ny)])
+                {
+                    continue;
+                }
+                seen[ny * wide + nx] = true;
+                todo.emplace_back(nx, ny);
+            }
+    }
+
+    PLUARET(number, filled);
+}
+
+// The distance in moves, diagonals included, from the nearest cell in from
+// to every cell of a box through passable glyphs, as a table indexed as
+// get_area's string is (from 1) and -1 where there's no way.
+LUAFN(dgn_distance_map)
+{
+    LINES(ls, 1, map, lines);
+
+    int x1, y1, x2, y2;
+    if (!_area_coords(ls, lines, x1, y1, x2, y2))
+        return 0;
+
+    TABLE_STR(ls, from, "");
+    TABLE_STR(ls, passable, traversable_glyphs);
+
+    const glyph_set sources(from), pass(passable);
+    const int width = x2 - x1 + 1;
+    vector<int> dist(width * (y2 - y1 + 1), -1);
+    vector<coord_def> queue;
+
+    for (int y = y1; y <= y2; ++y)
+        for (int x = x1; x <= x2; ++x)
+            if (sources[lines(x, y)])
+            {
+                dist[(y - y1) * width + x - x1] = 0;
+                queue.emplace_back(x, y);
+            }
+
+    for (size_t i = 0; i < queue.size(); ++i)
+    {
+        const coord_def c = queue[i];
+        const int next = dist[(c.y - y1) * width + c.x - x1] + 1;
+        for (int ny = max(c.y - 1, y1); ny <= min(c.y + 1, y2); ++ny)
+            for (int nx = max(c.x - 1, x1); nx <= min(c.x + 1, x2); ++nx)
+            {
+                int &d = dist[(ny - y1) * width + nx - x1];
+                if (d >= 0 || !pass[lines(nx, ny)])
+                    continue;
+                d = next;
+                queue.emplace_back(nx, ny);
+            }
+    }
+
+    lua_createtable(ls, dist.size(), 0);
+    for (size_t i = 0; i < dist.size(); ++i)
+    {
+        lua_pushnumber(ls, dist[i]);
+        lua_rawseti(ls, -2, i + 1);
+    }
+    return 1;
+}
+
 /* Wrappers for C++ layouts, to facilitate choosing of layouts by weight and
  * depth */
 
@@ -2342,6 +2596,12 @@ const struct luaL_reg dgn_build_dlib[] =
     { "delve", &dgn_delve },
     { "width", dgn_width },
     { "farthest_from", &dgn_farthest_from },
+    { "get_area", &dgn_get_area },
+    { "set_area", &dgn_set_area },
+    { "count_neighbors_in_area", &dgn_count_neighbors_in_area },
+    { "cellular_step", &dgn_cellular_step },
+    { "flood_fill", &dgn_flood_fill },
+    { "distance_map", &dgn_distance_map },
 
     { "layout_basic", &dgn_layout_basic },
     { "layout_bigger_room", &dgn_layout_bigger_room },
@@ -46,6 +46,15 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#if defined(__SSE2__) || defined(_M_X64)
+# define LOS_RAYS_SSE2
+# include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define LOS_RAYS_AVX2
+# include <immintrin.h>
+#endif
 
 #include "areas.h"
 #include "coord.h"
@@ -53,6 +62,7 @@
 #include "env.h"
 #include "losglobal.h"
 #include "mon-act.h"
+#include "mon-pathfind.h"
 
 // These determine what rays are cast in the precomputation,
 // and affect start-up time significantly.
@@ -71,12 +81,22 @@ static vector<coord_def> ray_coords;
 
 // These store all unique minimal cellrays. For each i,
 // cellray i ends in cellray_ends[i] and passes through
-// thoses cells p that have blockrays(p)[i] set. In other
-// words, blockrays(p)[i] is set iff an opaque cell p blocks
-// the cellray with index i.
+// thoses cells p that have bit i of _blockrays(p) set. In other
+// words, that bit is set iff an opaque cell p blocks the cellray
+// with index i.
 static vector<coord_def> cellray_ends;
 typedef FixedArray<bit_vector*, LOS_MAX_RANGE+1, LOS_MAX_RANGE+1> blockrays_t;
-static blockrays_t blockrays;
+
+// The blockray masks of all quadrant cells live in one contiguous,
+// cache line aligned block so that _losight_quadrant() can sweep them
+// a vector register at a time. Each mask takes ray_words words, which
+// is rounded up to a whole cache line; the padding bits are zero.
+typedef uint64_t ray_word;
+#define RAY_WORD_BITS 64
+#define RAY_LINE_WORDS (64 / sizeof(ray_word))
+static int ray_words = 0;
+static vector<ray_word> ray_store;
+static ray_word *blockrays_base = nullptr;
 
 // We also store the minimal cellrays by target position
 // for efficient retrieval by find_ray.
@@ -84,11 +104,17 @@ static blockrays_t blockrays;
 struct cellray;
 static FixedArray<vector<cellray>, LOS_MAX_RANGE+1, LOS_MAX_RANGE+1> min_cellrays;
 
+// For each cell p of the quadrant, the distinct end cells of all
+// minimal cellrays blocked by p. These are exactly the cells whose
+// visibility from the origin can change when the opacity of p does,
+// which lets losglobal.cc invalidate only what needs recomputing.
+static FixedArray<vector<coord_def>, LOS_MAX_RANGE+1, LOS_MAX_RANGE+1> shadows;
+
 // Temporary arrays used in losight() to track which rays
 // are blocked or have seen a smoke cloud.
-// Allocated when doing the precomputations.
-static bit_vector *dead_rays     = nullptr;
-static bit_vector *smoke_rays    = nullptr;
+// Allocated in ray_store when doing the precomputations.
+static ray_word *dead_rays     = nullptr;
+static ray_word *smoke_rays    = nullptr;
 
 class quadrant_iterator : public rectangle_iterator
 {
@@ -102,10 +128,159 @@ public:
 
 void clear_rays_on_exit()
 {
-    delete dead_rays;
-    delete smoke_rays;
-    for (quadrant_iterator qi; qi; ++qi)
-        delete blockrays(*qi);
+    blockrays_base = dead_rays = smoke_rays = nullptr;
+    ray_store.clear();
+    ray_store.shrink_to_fit();
+}
+
+static ray_word *_blockrays(const coord_def &p)
+{
+    return blockrays_base + (p.x * (LOS_MAX_RANGE+1) + p.y) * ray_words;
+}
+
+static bool _ray_bit(const ray_word *mask, int i)
+{
+    return mask[i / RAY_WORD_BITS] >> (i % RAY_WORD_BITS) & 1;
+}
+
+// The kernels applying a cell's blockray mask to the dead and smoke
+// masks. All of them compute the same bits; which one is used is
+// decided once by _choose_ray_kernels(). The word count n is always a
+// multiple of RAY_LINE_WORDS.
+
+// An opaque cell kills every ray through it.
+static void _block_rays_scalar(ray_word *dead, ray_word *, const ray_word *mask,
+                               int n)
+{
+    for (int w = 0; w < n; ++w)
+        dead[w] |= mask[w];
+}
+
+// A half-opaque cell kills the rays that have already passed through
+// one, and marks the rest.
+static void _smoke_rays_scalar(ray_word *dead, ray_word *smoke,
+                               const ray_word *mask, int n)
+{
+    for (int w = 0; w < n; ++w)
+    {
+        dead[w]  |= smoke[w] & mask[w];
+        smoke[w] |= mask[w];
+    }
+}
+
+#ifdef LOS_RAYS_SSE2
+static void _block_rays_sse2(ray_word *dead, ray_word *, const ray_word *mask,
+                             int n)
+{
+    __m128i *d = reinterpret_cast<__m128i *>(dead);
+    const __m128i *m = reinterpret_cast<const __m128i *>(mask);
+    for (int v = 0; v < n / 2; ++v)
+        _mm_store_si128(d + v, _mm_or_si128(_mm_load_si128(d + v),
+                                            _mm_load_si128(m + v)));
+}
+
+static void _smoke_rays_sse2(ray_word *dead, ray_word *smoke,
+                             const ray_word *mask, int n)
+{
+    __m128i *d = reinterpret_cast<__m128i *>(dead);
+    __m128i *s = reinterpret_cast<__m128i *>(smoke);
+    const __m128i *m = reinterpret_cast<const __m128i *>(mask);
+    for (int v = 0; v < n / 2; ++v)
+    {
+        const __m128i mv = _mm_load_si128(m + v);
+        const __m128i sv = _mm_load_si128(s + v);
+        _mm_store_si128(d + v, _mm_or_si128(_mm_load_si128(d + v),
+                                            _mm_and_si128(sv, mv)));
+        _mm_store_si128(s + v, _mm_or_si128(sv, mv));
+    }
+}
+#endif
+
+#ifdef LOS_RAYS_AVX2
+__attribute__((target("avx2")))
+static void _block_rays_avx2(ray_word *dead, ray_word *, const ray_word *mask,
+                             int n)
+{
+    __m256i *d = reinterpret_cast<__m256i *>(dead);
+    const __m256i *m = reinterpret_cast<const __m256i *>(mask);
+    for (int v = 0; v < n / 4; ++v)
+    {
+        _mm256_store_si256(d + v, _mm256_or_si256(_mm256_load_si256(d + v),
+                                                  _mm256_load_si256(m + v)));
+    }
+}
+
+__attribute__((target("avx2")))
+static void _smoke_rays_avx2(ray_word *dead, ray_word *smoke,
+                             const ray_word *mask, int n)
+{
+    __m256i *d = reinterpret_cast<__m256i *>(dead);
+    __m256i *s = reinterpret_cast<__m256i *>(smoke);
+    const __m256i *m = reinterpret_cast<const __m256i *>(mask);
+    for (int v = 0; v < n / 4; ++v)
+    {
+        const __m256i mv = _mm256_load_si256(m + v);
+        const __m256i sv = _mm256_load_si256(s + v);
+        _mm256_store_si256(d + v,
+                           _mm256_or_si256(_mm256_load_si256(d + v),
+                                           _mm256_and_si256(sv, mv)));
+        _mm256_store_si256(s + v, _mm256_or_si256(sv, mv));
+    }
+}
+#endif
+
+typedef void (*ray_kernel)(ray_word *dead, ray_word *smoke,
+                           const ray_word *mask, int n);
+static ray_kernel block_rays = _block_rays_scalar;
+static ray_kernel smoke_rays_through = _smoke_rays_scalar;
+
+// The ray kernels this build can use on this CPU, fastest last.
+vector<string> los_ray_kernels()
+{
+    vector<string> names = { "scalar" };
+#ifdef LOS_RAYS_SSE2
+    names.push_back("sse2");
+#endif
+#ifdef LOS_RAYS_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        names.push_back("avx2");
+#endif
+    return names;
+}
+
+// Use the named ray kernels from now on. False if they aren't available.
+bool los_set_ray_kernel(const string &name)
+{
+#ifdef LOS_RAYS_AVX2
+    if (name == "avx2" && __builtin_cpu_supports("avx2"))
+    {
+        block_rays = _block_rays_avx2;
+        smoke_rays_through = _smoke_rays_avx2;
+        return true;
+    }
+#endif
+#ifdef LOS_RAYS_SSE2
+    if (name == "sse2")
+    {
+        block_rays = _block_rays_sse2;
+        smoke_rays_through = _smoke_rays_sse2;
+        return true;
+    }
+#endif
+    if (name == "scalar")
+    {
+        block_rays = _block_rays_scalar;
+        smoke_rays_through = _smoke_rays_scalar;
+        return true;
+    }
+    return false;
+}
+
+static void _choose_ray_kernels()
+{
+    const string best = los_ray_kernels().back();
+    los_set_ray_kernel(best);
+    dprf("LOS ray kernel: %s", best.c_str());
 }
 
 // LOS radius.
@@ -413,28 +588,56 @@ static void _create_blockrays()
     for (int i = 0; i < n_min_rays; ++i)
         cellray_ends[i] = ray_coords[min_indices[i]];
 
+    // Lay out the compressed masks: one per quadrant cell, followed by
+    // dead_rays and smoke_rays, plus slack to align the start.
+    const int n_masks = (LOS_MAX_RANGE+1) * (LOS_MAX_RANGE+1) + 2;
+    ray_words = (n_min_rays + RAY_WORD_BITS - 1) / RAY_WORD_BITS;
+    ray_words = (ray_words + RAY_LINE_WORDS - 1) / RAY_LINE_WORDS
+                * RAY_LINE_WORDS;
+    ray_store.assign(n_masks * ray_words + RAY_LINE_WORDS, 0);
+    uintptr_t base = reinterpret_cast<uintptr_t>(ray_store.data());
+    base = (base + RAY_LINE_WORDS * sizeof(ray_word) - 1)
+           & ~(uintptr_t)(RAY_LINE_WORDS * sizeof(ray_word) - 1);
+    blockrays_base = reinterpret_cast<ray_word *>(base);
+    dead_rays  = blockrays_base + (n_masks - 2) * ray_words;
+    smoke_rays = blockrays_base + (n_masks - 1) * ray_words;
+
     // Compress blockrays accordingly.
     for (quadrant_iterator qi; qi; ++qi)
     {
-        blockrays(*qi) = new bit_vector(n_min_rays);
+        ray_word *mask = _blockrays(*qi);
         for (int i = 0; i < n_min_rays; ++i)
-        {
-            blockrays(*qi)->set(i, all_blockrays(*qi)
-                                   ->get(min_indices[i]));
-        }
+            if (all_blockrays(*qi)->get(min_indices[i]))
+                mask[i / RAY_WORD_BITS] |= (ray_word)1 << (i % RAY_WORD_BITS);
     }
 
     // We can throw away all_blockrays now.
     for (quadrant_iterator qi; qi; ++qi)
         delete all_blockrays(*qi);
 
-    dead_rays  = new bit_vector(n_min_rays);
-    smoke_rays = new bit_vector(n_min_rays);
+    _choose_ray_kernels();
 
     dprf("Cellrays: %d Fullrays: %u Minimal cellrays: %u",
           n_cellrays, (unsigned int)fullrays.size(), n_min_rays);
 }
 
+static void _create_shadows()
+{
+    const int n_min_rays = cellray_ends.size();
+    for (quadrant_iterator qi; qi; ++qi)
+    {
+        FixedBitArray<LOS_MAX_RANGE+1, LOS_MAX_RANGE+1> seen;
+        vector<coord_def> &shadow = shadows(*qi);
+        for (int i = 0; i < n_min_rays; ++i)
+        {
+            if (!_ray_bit(_blockrays(*qi), i) || seen(cellray_ends[i]))
+                continue;
+            seen.set(cellray_ends[i]);
+            shadow.push_back(cellray_ends[i]);
+        }
+    }
+}
+
 static int _gcd(int x, int y)
 {
     int tmp;
@@ -504,6 +707,19 @@ static void raycast()
 
     // Now create the appropriate blockrays array
     _create_blockrays();
+    _create_shadows();
+}
+
+const vector<coord_def>& los_shadow(const coord_def& p)
+{
+    ASSERT(p.x >= 0);
+    ASSERT(p.y >= 0);
+    ASSERT(p.rdist() <= LOS_MAX_RANGE);
+
+    // Ensure the precalculations have been done.
+    raycast();
+
+    return shadows(p);
 }
 
 static int _imbalance(ray_def ray, const coord_def& target)
@@ -795,8 +1011,8 @@ static void _losight_quadrant(los_grid& sh, const los_param& dat, int sx, int sy
 {
     const unsigned int num_cellrays = cellray_ends.size();
 
-    dead_rays->reset();
-    smoke_rays->reset();
+    memset(dead_rays, 0, ray_words * sizeof(ray_word));
+    memset(smoke_rays, 0, ray_words * sizeof(ray_word));
 
     for (quadrant_iterator qi; qi; ++qi)
     {
@@ -808,12 +1024,12 @@ static void _losight_quadrant(los_grid& sh, const los_param& dat, int sx, int sy
         {
         case OPC_OPAQUE:
             // Block the appropriate rays.
-            *dead_rays |= *blockrays(*qi);
+            block_rays(dead_rays, smoke_rays, _blockrays(*qi), ray_words);
             break;
         case OPC_HALF:
             // Block rays which have already seen a cloud.
-            *dead_rays  |= (*smoke_rays & *blockrays(*qi));
-            *smoke_rays |= *blockrays(*qi);
+            smoke_rays_through(dead_rays, smoke_rays, _blockrays(*qi),
+                               ray_words);
             break;
         default:
             break;
@@ -822,11 +1038,18 @@ static void _losight_quadrant(los_grid& sh, const los_param& dat, int sx, int sy
 
     // Ray calculation done. Now work out which cells in this
     // quadrant are visible.
-    for (unsigned int rayidx = 0; rayidx < num_cellrays; ++rayidx)
+    // Whole words of dead rays are skipped at once.
+    for (unsigned int base = 0; base < num_cellrays; base += RAY_WORD_BITS)
     {
-        // make the cells seen by this ray at this point visible
-        if (!dead_rays->get(rayidx))
+        const ray_word alive = ~dead_rays[base / RAY_WORD_BITS];
+        if (!alive)
+            continue;
+        const unsigned int end = min(base + RAY_WORD_BITS, num_cellrays);
+        for (unsigned int rayidx = base; rayidx < end; ++rayidx)
         {
+            // make the cells seen by this ray at this point visible
+            if (!(alive >> (rayidx - base) & 1))
+                continue;
             // This ray is alive, thus the end cell is visible.
             const coord_def p = coord_def(sx * cellray_ends[rayidx].x,
                                           sy * cellray_ends[rayidx].y);
@@ -930,6 +1153,7 @@ void los_monster_died(const monster* mon)
 void los_terrain_changed(const coord_def& p)
 {
     invalidate_los_around(p);
+    invalidate_shared_paths();
     _handle_los_change();
 }
 
@@ -937,5 +1161,6 @@ void los_changed()
 {
     mons_reset_just_seen();
     invalidate_los();
+    invalidate_shared_paths();
     _handle_los_change();
 }
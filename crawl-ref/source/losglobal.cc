@@ -4,37 +4,65 @@
 
 #include "coord.h"
 #include "coordit.h"
+#include "dbg-prof.h"
 #include "libutil.h"
 #include "los-def.h"
 
-#define LOS_KNOWN 4
+// Cell pairs (p, q) with p < q are stored at p, indexed by the offset
+// q - p: first the offsets (0, 1) to (0, LOS_MAX_RANGE) straight below p,
+// then the columns to its right. Offsets that p < q rules out get no
+// space. Each pair has a bit per los_type saying whether its visibility is
+// known, then a bit per los_type holding the value; that comes to 144
+// bytes a cell, where a byte for every offset in the half window took 153.
+#define NUM_LOS_TYPES 4
+#define LOS_BITS (2*NUM_LOS_TYPES)
+#define HALF_WIDTH (2*LOS_MAX_RANGE+1)
+#define HALF_PAIRS (LOS_MAX_RANGE + LOS_MAX_RANGE*HALF_WIDTH)
 
-typedef uint8_t losfield_t;
-typedef losfield_t halflos_t[LOS_MAX_RANGE+1][2*LOS_MAX_RANGE+1];
-static const int o_half_x = 0;
-static const int o_half_y = LOS_MAX_RANGE;
-typedef halflos_t globallos_t[GXM][GYM];
+typedef FixedBitVector<HALF_PAIRS * LOS_BITS> halflos_t;
+typedef FixedArray<halflos_t, GXM, GYM> globallos_t;
 
 static globallos_t globallos;
 
-static losfield_t* _lookup_globallos(const coord_def& p, const coord_def& q)
+static int _los_index(los_type l)
 {
-    COMPILE_CHECK(LOS_KNOWN * 2 <= sizeof(losfield_t) * 8);
+    switch (l)
+    {
+    case LOS_DEFAULT:   return 0;
+    case LOS_NO_TRANS:  return 1;
+    case LOS_SOLID:     return 2;
+    case LOS_SOLID_SEE: return 3;
+    default:
+        die("invalid opacity");
+    }
+}
 
+// Find where the pair (p, q) is stored. Returns nullptr if the cells
+// are the same or out of range of each other, else the half window and
+// sets idx to the index of the pair's first bit within it.
+static halflos_t* _lookup_globallos(const coord_def& p, const coord_def& q,
+                                    int &idx)
+{
     if (!map_bounds(p) || !map_bounds(q))
         return nullptr;
     coord_def diff = q - p;
-    if (diff.rdist() > LOS_RADIUS)
+    if (diff.origin() || diff.rdist() > LOS_RADIUS)
         return nullptr;
     // p < q iff p.x < q.x || p.x == q.x && p.y < q.y
-    if (diff < coord_def(0, 0))
-        return &globallos[q.x][q.y][-diff.x + o_half_x][-diff.y + o_half_y];
-    else
-        return &globallos[p.x][p.y][ diff.x + o_half_x][ diff.y + o_half_y];
+    const bool swap = diff < coord_def(0, 0);
+    if (swap)
+        diff = -diff;
+
+    const int pair = diff.x ? LOS_MAX_RANGE + (diff.x - 1) * HALF_WIDTH
+                              + diff.y + LOS_MAX_RANGE
+                            : diff.y - 1;
+    idx = pair * LOS_BITS;
+    return &globallos(swap ? q : p);
 }
 
 static void _save_los(los_def* los, los_type l)
 {
+    const int li = _los_index(l);
     const coord_def o = los->get_center();
     int y1 = o.y - LOS_MAX_RANGE;
     int y2 = o.y + LOS_MAX_RANGE;
@@ -43,37 +71,63 @@ static void _save_los(los_def* los, los_type l)
     for (int y = y1; y <= y2; y++)
         for (int x = x1; x <= x2; x++)
         {
-            if (max(abs(o.x - x), abs(o.y - y)) > LOS_MAX_RANGE)
-                continue;
-
             coord_def ri(x, y);
-            losfield_t* flags = _lookup_globallos(o, ri);
-            if (!flags)
+            int idx;
+            halflos_t* half = _lookup_globallos(o, ri, idx);
+            if (!half)
                 continue;
-            *flags |= l << LOS_KNOWN;
-            if (los->see_cell(ri))
-                *flags |= l;
-            else
-                *flags &= ~l;
+            half->set(idx + li);
+            half->set(idx + NUM_LOS_TYPES + li, los->see_cell(ri));
         }
 }
 
+static void _forget_pair(const coord_def& p, const coord_def& q)
+{
+    int idx;
+    halflos_t* half = _lookup_globallos(p, q, idx);
+    if (!half)
+        return;
+    for (int i = 0; i < NUM_LOS_TYPES; ++i)
+        half->set(idx + i, false);
+}
+
 // Opacity at p has changed.
+// Only the pairs with a minimal cellray through p can be affected, so
+// rather than dropping everything in range we walk the shadow that p
+// casts as seen from each cell around it.
 void invalidate_los_around(const coord_def& p)
 {
     int x1 = max(p.x - LOS_MAX_RANGE, 0);
     int y1 = max(p.y - LOS_MAX_RANGE, 0);
-    int x2 = min(p.x, GXM - 1);
+    int x2 = min(p.x + LOS_MAX_RANGE, GXM - 1);
     int y2 = min(p.y + LOS_MAX_RANGE, GYM - 1);
     for (int y = y1; y <= y2; y++)
         for (int x = x1; x <= x2; x++)
-            memset(globallos[x][y], 0, sizeof(halflos_t));
+        {
+            const coord_def src(x, y);
+            const coord_def d = p - src;
+            if (d.origin())
+                continue;
+            const coord_def quad_d(abs(d.x), abs(d.y));
+            const vector<coord_def> &shadow = los_shadow(quad_d);
+
+            // Cells on an axis belong to two quadrants, each of which
+            // losight() treats separately.
+            for (int sx = -1; sx <= 1; sx += 2)
+                for (int sy = -1; sy <= 1; sy += 2)
+                {
+                    if (sx * d.x < 0 || sy * d.y < 0)
+                        continue;
+                    for (const coord_def &c : shadow)
+                        _forget_pair(src, src + coord_def(sx * c.x, sy * c.y));
+                }
+        }
 }
 
 void invalidate_los()
 {
     for (rectangle_iterator ri(0); ri; ++ri)
-        memset(globallos[ri->x][ri->y], 0, sizeof(halflos_t));
+        globallos(*ri).reset();
 }
 
 static void _update_globallos_at(const coord_def& p, los_type l)
@@ -117,15 +171,24 @@ bool cell_see_cell(const coord_def& p, const coord_def& q, los_type l)
 {
     if (l == LOS_NONE)
         return true;
+    if (p == q)
+        return map_bounds(p);
 
-    losfield_t* flags = _lookup_globallos(p, q);
+    int idx;
+    halflos_t* half = _lookup_globallos(p, q, idx);
 
-    if (!flags)
+    if (!half)
         return false; // outside range
 
-    if (!(*flags & (l << LOS_KNOWN)))
+    const int li = _los_index(l);
+    if (half->get(idx + li))
+        PROFILE_COUNT(PEV_LOS_CACHE_HIT);
+    else
+    {
+        PROFILE_COUNT(PEV_LOS_CACHE_MISS);
         _update_globallos_at(p, l);
+    }
 
-    ASSERT(*flags & (l << LOS_KNOWN));
-    return *flags & l;
+    ASSERT(half->get(idx + li));
+    return half->get(idx + NUM_LOS_TYPES + li);
 }
@@ -0,0 +1,193 @@
+/**
+ * @file
+ * @brief A fast LZ77 compressor for blocks of save data.
+ *
+ * The format is modelled on LZ4's blocks: a series of sequences, each a
+ * token byte, its literals, and a match copied from earlier in the output.
+ * The token's high nibble is the number of literals and its low nibble
+ * the match length less LZ_MIN_MATCH; a nibble of 15 is continued by
+ * bytes that are added on, up to and including the first that isn't 255.
+ * The match offset is two little-endian bytes. The last sequence is just
+ * literals, and ends the block.
+ *
+ * Matches are found greedily through a hash table of recent positions,
+ * trading ratio for speed: this packs and unpacks several times faster than
+ * deflate, and is meant for when save latency matters more than size.
+**/
+
+#include "AppHdr.h"
+
+#include "lz-block.h"
+
+#include <cstdint>
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+// Matches end at least this far from the end of the input...
+#define LZ_LAST_LITERALS 5
+// ...and start at least this far from it.
+#define LZ_MATCH_LIMIT 12
+// Skip ahead faster the longer we go without finding a match, so that
+// incompressible data passes through quickly.
+#define LZ_SKIP_SHIFT 6
+
+static uint32_t _read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int _hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *_put_length(uint8_t *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+// Write a token and its literals; the caller adds any match.
+static uint8_t *_put_literals(uint8_t *op, const uint8_t *lit, size_t len,
+                              size_t match_len)
+{
+    *op++ = min<size_t>(len, 15) << 4 | min<size_t>(match_len, 15);
+    if (len >= 15)
+        op = _put_length(op, len - 15);
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+size_t lz_compress_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const char *src_, size_t len, char *dst_)
+{
+    const uint8_t *const src = (const uint8_t *)src_;
+    const uint8_t *const end = src + len;
+    uint8_t *op = (uint8_t *)dst_;
+    const uint8_t *anchor = src;
+
+    if (len > LZ_MATCH_LIMIT)
+    {
+        // Positions, as offsets from src; a stale or empty entry is weeded
+        // out by comparing the data.
+        uint32_t table[1 << LZ_HASH_BITS] = { 0 };
+        const uint8_t *const match_limit = end - LZ_MATCH_LIMIT;
+        const uint8_t *const extend_limit = end - LZ_LAST_LITERALS;
+
+        const uint8_t *ip = src + 1;
+        while (ip < match_limit)
+        {
+            const uint32_t seq = _read32(ip);
+            const unsigned int h = _hash(seq);
+            const uint8_t *ref = src + table[h];
+            table[h] = ip - src;
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || _read32(ref) != seq)
+            {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_SHIFT);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+                --ip, --ref;
+
+            const uint8_t *mend = ip + LZ_MIN_MATCH;
+            const uint8_t *mref = ref + LZ_MIN_MATCH;
+            while (mend < extend_limit && *mend == *mref)
+                ++mend, ++mref;
+
+            const size_t match_len = mend - ip - LZ_MIN_MATCH;
+            op = _put_literals(op, anchor, ip - anchor, match_len);
+            const size_t offset = ip - ref;
+            *op++ = offset & 0xff;
+            *op++ = offset >> 8;
+            if (match_len >= 15)
+                op = _put_length(op, match_len - 15);
+
+            // Remember a position inside the match too, as runs often
+            // repeat from there.
+            table[_hash(_read32(mend - 2))] = mend - 2 - src;
+            ip = anchor = mend;
+        }
+    }
+
+    op = _put_literals(op, anchor, end - anchor, 0);
+    return op - (uint8_t *)dst_;
+}
+
+// Add on the bytes continuing a length nibble of 15.
+static bool _get_length(const uint8_t *&ip, const uint8_t *end, size_t &len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= end)
+            return false;
+        b = *ip++;
+        len += b;
+    }
+    while (b == 255);
+    return true;
+}
+
+int lz_decompress(const char *src_, size_t len, char *dst_, size_t cap)
+{
+    const uint8_t *ip = (const uint8_t *)src_;
+    const uint8_t *const end = ip + len;
+    uint8_t *const dst = (uint8_t *)dst_;
+    uint8_t *op = dst;
+    uint8_t *const oend = dst + cap;
+
+    while (true)
+    {
+        if (ip >= end)
+            return -1;
+        const uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && !_get_length(ip, end, lit))
+            return -1;
+        if (lit > (size_t)(end - ip) || lit > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return -1;
+        const size_t offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (!offset || offset > (size_t)(op - dst))
+            return -1;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !_get_length(ip, end, match_len))
+            return -1;
+        match_len += LZ_MIN_MATCH;
+        if (match_len > (size_t)(oend - op))
+            return -1;
+
+        // The match may overlap what it writes, repeating a short run.
+        const uint8_t *ref = op - offset;
+        if (offset >= match_len)
+            memcpy(op, ref, match_len);
+        else
+            for (size_t i = 0; i < match_len; ++i)
+                op[i] = ref[i];
+        op += match_len;
+    }
+
+    return op - dst;
+}
@@ -0,0 +1,24 @@
+/**
+ * @file
+ * @brief A fast LZ77 compressor for blocks of save data.
+**/
+
+#pragma once
+
+#include <cstddef>
+
+// The largest offset a match can reach back; blocks longer than this still
+// compress, but only against their last 64k.
+#define LZ_MAX_OFFSET 65535
+
+// How much room lz_compress() may need for len bytes of input.
+size_t lz_compress_bound(size_t len);
+
+// Compress len bytes of src into dst, which must have room for
+// lz_compress_bound(len) bytes. Returns the compressed length.
+size_t lz_compress(const char *src, size_t len, char *dst);
+
+// Decompress len bytes of src into dst, which has room for cap bytes.
+// Returns the decompressed length, or -1 if src is malformed or wouldn't
+// fit.
+int lz_decompress(const char *src, size_t len, char *dst, size_t cap);
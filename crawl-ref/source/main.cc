@@ -50,6 +50,7 @@
 #include "corpse.h"
 #include "crash.h"
 #include "database.h"
+#include "dbg-prof.h"
 #include "dbg-scan.h"
 #include "dbg-util.h"
 #include "delay.h"
@@ -534,8 +535,13 @@ static void _show_commandline_options_help()
     puts("  -objstat [<levels>] run monster and item stats on the given range "
          "of levels");
     puts("      Defaults to entire dungeon; same level syntax as -mapstat.");
-    puts("  -iters <num>        For -mapstat and -objstat, set the number of "
-         "iterations");
+    puts("  -bench-levelgen [<levels>] time level generation by branch and "
+         "builder,");
+    puts("      writing levelgen-bench.tsv; same level syntax as -mapstat.");
+    puts("      Every iteration rebuilds the dungeon from the same -seed.");
+    puts("  -iters <num>        For -mapstat, -objstat and -bench-levelgen, "
+         "set the number");
+    puts("      of iterations");
     puts("  -force-map <map>    For -mapstat and -objstat, alway choose the "
          "      given map on every level.");
 #endif
@@ -547,6 +553,7 @@ static void _show_commandline_options_help()
 #endif
     puts("  -playable-json   list playable species, jobs, and character combos.");
     puts("  -branches-json   list branch data.");
+    puts("  -bench-save <name>...  time each save codec on the given saves");
 
 #if defined(TARGET_OS_WINDOWS) && defined(USE_TILE_LOCAL)
     text_popup(help, L"Dungeon Crawl command line help");
@@ -2140,6 +2147,8 @@ static void _update_still_winds()
 
 void world_reacts()
 {
+    PROFILE_STAGE(PROF_WORLD_REACTS);
+
     // All markers should be activated at this point.
     ASSERT(!env.markers.need_activate());
 
@@ -454,11 +454,21 @@ bool level_range::valid() const
     return shallowest > 0 && deepest >= shallowest;
 }
 
+////////////////////////////////////////////////////////////////////////
+// glyph_set
+
+glyph_set::glyph_set(const char *glyphs)
+{
+    memset(in_set, 0, sizeof(in_set));
+    for (const char *g = glyphs; *g; ++g)
+        in_set[(unsigned char) *g] = true;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // map_lines
 
 map_lines::map_lines()
-    : markers(), lines(), overlay(),
+    : markers(), cells(), line_lengths(), overlay(),
       map_width(0), solid_north(false), solid_east(false),
       solid_south(false), solid_west(false), solid_checked(false)
 {
@@ -474,7 +484,7 @@ void map_lines::write_maplines(writer &outf) const
     const int h = height();
     marshallShort(outf, h);
     for (int i = 0; i < h; ++i)
-        marshallString(outf, lines[i]);
+        marshallString(outf, get_line(i));
 }
 
 void map_lines::read_maplines(reader &inf)
@@ -497,24 +507,27 @@ rectangle_iterator map_lines::get_iter() const
     return rectangle_iterator(tl, br);
 }
 
-char map_lines::operator () (const coord_def &c) const
-{
-    return lines[c.y][c.x];
-}
-
-char& map_lines::operator () (const coord_def &c)
-{
-    return lines[c.y][c.x];
-}
-
-char map_lines::operator () (int x, int y) const
+void map_lines::fill_rect(const coord_def &tl, const coord_def &br,
+                          char glyph)
 {
-    return lines[y][x];
+    // An inverted rectangle is empty, as it is for replace_in_rect().
+    if (br.x < tl.x)
+        return;
+    for (int y = tl.y; y <= br.y; ++y)
+        memset(row(y) + tl.x, glyph, br.x - tl.x + 1);
 }
 
-char& map_lines::operator () (int x, int y)
+void map_lines::replace_in_rect(const coord_def &tl, const coord_def &br,
+                                const char *find, char replace)
 {
-    return lines[y][x];
+    const glyph_set wanted(find);
+    for (int y = tl.y; y <= br.y; ++y)
+    {
+        char *line = row(y);
+        for (int x = tl.x; x <= br.x; ++x)
+            if (wanted[line[x]])
+                line[x] = replace;
+    }
 }
 
 bool map_lines::in_bounds(const coord_def &c) const
@@ -524,7 +537,7 @@ bool map_lines::in_bounds(const coord_def &c) const
 
 bool map_lines::in_map(const coord_def &c) const
 {
-    return in_bounds(c) && lines[c.y][c.x] != ' ';
+    return in_bounds(c) && (*this)(c) != ' ';
 }
 
 map_lines &map_lines::operator = (const map_lines &map)
@@ -544,7 +557,8 @@ void map_lines::init_from(const map_lines &map)
     // Markers have to be regenerated, they will not be copied.
     clear_markers();
     overlay.reset(nullptr);
-    lines            = map.lines;
+    cells            = map.cells;
+    line_lengths     = map.line_lengths;
     map_width        = map.map_width;
     solid_north      = map.solid_north;
     solid_east       = map.solid_east;
@@ -696,21 +710,60 @@ void map_lines::apply_overlays(const coord_def &c, bool is_layout)
     apply_grid_overlay(c, is_layout);
 }
 
-const vector<string> &map_lines::get_lines() const
+vector<string> map_lines::get_lines() const
 {
+    vector<string> lines;
+    for (int y = 0, h = height(); y < h; ++y)
+        lines.push_back(get_line(y));
     return lines;
 }
 
-vector<string> &map_lines::get_lines()
+string map_lines::get_line(int y) const
 {
-    return lines;
+    return string(row(y), line_lengths[y]);
+}
+
+void map_lines::set_line(int y, const string &s)
+{
+    while (height() <= y)
+        add_line("");
+
+    if (static_cast<int>(s.length()) > map_width)
+        set_width(s.length());
+
+    char *line = row(y);
+    memcpy(line, s.data(), s.length());
+    memset(line + s.length(), ' ', map_width - s.length());
+    line_lengths[y] = s.length();
+}
+
+void map_lines::erase_line(int y)
+{
+    cells.erase(cells.begin() + y * map_width,
+                cells.begin() + (y + 1) * map_width);
+    line_lengths.erase(line_lengths.begin() + y);
 }
 
 void map_lines::add_line(const string &s)
 {
-    lines.push_back(s);
     if (static_cast<int>(s.length()) > map_width)
-        map_width = s.length();
+        set_width(s.length());
+
+    cells.insert(cells.end(), s.begin(), s.end());
+    cells.resize(cells.size() + map_width - s.length(), ' ');
+    line_lengths.push_back(s.length());
+}
+
+// Widen every row to new_width, padding with spaces.
+void map_lines::set_width(int new_width)
+{
+    ASSERT(new_width >= map_width);
+    vector<char> widened(height() * new_width, ' ');
+    for (int y = 0, h = height(); y < h; ++y)
+        memcpy(&widened[y * new_width], row(y), map_width);
+
+    cells.swap(widened);
+    map_width = new_width;
 }
 
 string map_lines::clean_shuffle(string s)
@@ -1046,7 +1099,7 @@ int map_lines::width() const
 
 int map_lines::height() const
 {
-    return lines.size();
+    return line_lengths.size();
 }
 
 void map_lines::extend(int min_width, int min_height, char fill)
@@ -1058,18 +1111,17 @@ void map_lines::extend(int min_width, int min_height, char fill)
     int old_width = width();
     int old_height = height();
 
-    if (static_cast<int>(lines.size()) < min_height)
+    if (width() < min_width)
     {
         dirty = true;
-        while (static_cast<int>(lines.size()) < min_height)
-            add_line(string(min_width, fill));
+        set_width(min_width);
     }
 
-    if (width() < min_width)
+    if (height() < min_height)
     {
         dirty = true;
-        lines[0] += string(min_width - width(), fill);
-        map_width = max(map_width, min_width);
+        while (height() < min_height)
+            add_line("");
     }
 
     if (!dirty)
@@ -1097,7 +1149,7 @@ coord_def map_lines::size() const
 
 int map_lines::glyph(int x, int y) const
 {
-    return lines[y][x];
+    return (*this)(x, y);
 }
 
 int map_lines::glyph(const coord_def &c) const
@@ -1159,7 +1211,8 @@ bool map_lines::solid_borders(map_section_type border)
 void map_lines::clear()
 {
     clear_markers();
-    lines.clear();
+    cells.clear();
+    line_lengths.clear();
     keyspecs.clear();
     overlay.reset(nullptr);
     map_width = 0;
@@ -1169,18 +1222,17 @@ void map_lines::clear()
     next_keyspec_idx = 256;
 }
 
-void map_lines::subst(string &s, subst_spec &spec)
-{
-    string::size_type pos = 0;
-    while ((pos = s.find_first_of(spec.key, pos)) != string::npos)
-        s[pos++] = spec.value();
-}
-
 void map_lines::subst(subst_spec &spec)
 {
     ASSERT(!spec.key.empty());
-    for (string &line : lines)
-        subst(line, spec);
+    const glyph_set keys(spec.key.c_str());
+    for (int y = 0, h = height(); y < h; ++y)
+    {
+        char *line = row(y);
+        for (int x = 0, len = line_lengths[y]; x < len; ++x)
+            if (keys[line[x]])
+                line[x] = spec.value();
+    }
 }
 
 void map_lines::bind_overlay()
@@ -1440,34 +1492,26 @@ void map_lines::overlay_tiles(tile_spec &spec)
     if (!overlay)
         overlay.reset(new overlay_matrix(width(), height()));
 
-    for (int y = 0, ysize = lines.size(); y < ysize; ++y)
+    for (iterator mi(*this, spec.key); mi; ++mi)
     {
-        string::size_type pos = 0;
-        while ((pos = lines[y].find_first_of(spec.key, pos)) != string::npos)
-        {
-            if (spec.floor)
-                (*overlay)(pos, y).floortile = spec.get_tile();
-            else if (spec.feat)
-                (*overlay)(pos, y).tile      = spec.get_tile();
-            else
-                (*overlay)(pos, y).rocktile  = spec.get_tile();
+        overlay_def &cell = (*overlay)(*mi);
+        if (spec.floor)
+            cell.floortile = spec.get_tile();
+        else if (spec.feat)
+            cell.tile      = spec.get_tile();
+        else
+            cell.rocktile  = spec.get_tile();
 
-            (*overlay)(pos, y).no_random = spec.no_random;
-            (*overlay)(pos, y).last_tile = spec.last_tile;
-            ++pos;
-        }
+        cell.no_random = spec.no_random;
+        cell.last_tile = spec.last_tile;
     }
 }
 
 void map_lines::nsubst(nsubst_spec &spec)
 {
     vector<coord_def> positions;
-    for (int y = 0, ysize = lines.size(); y < ysize; ++y)
-    {
-        string::size_type pos = 0;
-        while ((pos = lines[y].find_first_of(spec.key, pos)) != string::npos)
-            positions.emplace_back(pos++, y);
-    }
+    for (iterator mi(*this, spec.key); mi; ++mi)
+        positions.push_back(*mi);
     shuffle_array(positions);
 
     int pcount = 0;
@@ -1491,7 +1535,7 @@ int map_lines::apply_nsubst(vector<coord_def> &pos, int start, int nsub,
     {
         const int val = spec.value();
         const coord_def &c = pos[i];
-        lines[c.y][c.x] = val;
+        (*this)(c) = val;
         ++substituted;
     }
     return substituted;
@@ -1530,75 +1574,80 @@ void map_lines::resolve_shuffle(const string &shufflage)
     if (toshuffle.empty() || shuffled.empty())
         return;
 
-    for (string &s : lines)
+    char shuffled_glyph[256];
+    for (int c = 0; c < 256; ++c)
+        shuffled_glyph[c] = c;
+    // Where a glyph is repeated, its first position counts.
+    for (int i = toshuffle.length() - 1; i >= 0; --i)
+        shuffled_glyph[(unsigned char) toshuffle[i]] = shuffled[i];
+
+    for (int y = 0, h = height(); y < h; ++y)
     {
-        for (char &c : s)
-        {
-            string::size_type pos = toshuffle.find(c);
-            if (pos != string::npos)
-                c = shuffled[pos];
-        }
+        char *line = row(y);
+        for (int x = 0, len = line_lengths[y]; x < len; ++x)
+            line[x] = shuffled_glyph[(unsigned char) line[x]];
     }
 }
 
 void map_lines::clear(const string &clearchars)
 {
-    for (string &s : lines)
+    const glyph_set cleared(clearchars.c_str());
+    for (int y = 0, h = height(); y < h; ++y)
     {
-        for (char &c : s)
-        {
-            string::size_type pos = clearchars.find(c);
-            if (pos != string::npos)
-                c = ' ';
-        }
+        char *line = row(y);
+        for (int x = 0, len = line_lengths[y]; x < len; ++x)
+            if (cleared[line[x]])
+                line[x] = ' ';
     }
 }
 
 void map_lines::normalise(char fillch)
 {
-    for (string &s : lines)
-        if (static_cast<int>(s.length()) < map_width)
-            s += string(map_width - s.length(), fillch);
+    for (int y = 0, h = height(); y < h; ++y)
+    {
+        if (line_lengths[y] < map_width)
+        {
+            memset(row(y) + line_lengths[y], fillch,
+                   map_width - line_lengths[y]);
+            line_lengths[y] = map_width;
+        }
+    }
 }
 
 // Should never be attempted if the map has a defined orientation, or if one
 // of the dimensions is greater than the lesser of GXM,GYM.
 void map_lines::rotate(bool clockwise)
 {
-    vector<string> newlines;
-
     // normalise() first for convenience.
     normalise();
 
+    const int old_height = height();
     const int xs = clockwise? 0 : map_width - 1,
               xe = clockwise? map_width : -1,
               xi = clockwise? 1 : -1;
 
-    const int ys = clockwise? (int) lines.size() - 1 : 0,
-              ye = clockwise? -1 : (int) lines.size(),
+    const int ys = clockwise? old_height - 1 : 0,
+              ye = clockwise? -1 : old_height,
               yi = clockwise? -1 : 1;
 
+    vector<char> newcells;
+    newcells.reserve(cells.size());
     for (int i = xs; i != xe; i += xi)
-    {
-        string line;
-
         for (int j = ys; j != ye; j += yi)
-            line += lines[j][i];
-
-        newlines.push_back(line);
-    }
+            newcells.push_back((*this)(i, j));
 
     if (overlay)
     {
-        auto new_overlay = make_unique<overlay_matrix>(lines.size(), map_width);
+        auto new_overlay = make_unique<overlay_matrix>(old_height, map_width);
         for (int i = xs, y = 0; i != xe; i += xi, ++y)
             for (int j = ys, x = 0; j != ye; j += yi, ++x)
                 (*new_overlay)(x, y) = (*overlay)(i, j);
         overlay = move(new_overlay);
     }
 
-    map_width = lines.size();
-    lines     = newlines;
+    line_lengths.assign(map_width, old_height);
+    map_width = old_height;
+    cells.swap(newcells);
     rotate_markers(clockwise);
     solid_checked = false;
 }
@@ -1647,14 +1696,13 @@ void map_lines::rotate_markers(bool clock)
 
 void map_lines::vmirror()
 {
-    const int vsize = lines.size();
+    const int vsize = height();
     const int midpoint = vsize / 2;
 
     for (int i = 0; i < midpoint; ++i)
     {
-        string temp = lines[i];
-        lines[i] = lines[vsize - 1 - i];
-        lines[vsize - 1 - i] = temp;
+        swap_ranges(row(i), row(i) + map_width, row(vsize - 1 - i));
+        swap(line_lengths[i], line_lengths[vsize - 1 - i]);
     }
 
     if (overlay)
@@ -1670,14 +1718,16 @@ void map_lines::vmirror()
 
 void map_lines::hmirror()
 {
+    // Short lines would have their ends mirrored to the wrong place.
+    normalise();
+
     const int midpoint = map_width / 2;
-    for (string &s : lines)
-        for (int j = 0; j < midpoint; ++j)
-            swap(s[j], s[map_width - 1 - j]);
+    for (int i = 0, vsize = height(); i < vsize; ++i)
+        reverse(row(i), row(i) + map_width);
 
     if (overlay)
     {
-        for (int i = 0, vsize = lines.size(); i < vsize; ++i)
+        for (int i = 0, vsize = height(); i < vsize; ++i)
             for (int j = 0; j < midpoint; ++j)
                 swap((*overlay)(j, i), (*overlay)(map_width - 1 - j, i));
     }
@@ -1823,9 +1873,10 @@ coord_def map_lines::find_first_glyph(int gly) const
 {
     for (int y = 0, h = height(); y < h; ++y)
     {
-        string::size_type pos = lines[y].find(gly);
-        if (pos != string::npos)
-            return coord_def(pos, y);
+        const char *line = row(y);
+        for (int x = 0, len = line_lengths[y]; x < len; ++x)
+            if (line[x] == gly)
+                return coord_def(x, y);
     }
 
     return coord_def(-1, -1);
@@ -1833,11 +1884,13 @@ coord_def map_lines::find_first_glyph(int gly) const
 
 coord_def map_lines::find_first_glyph(const string &glyphs) const
 {
+    const glyph_set wanted(glyphs.c_str());
     for (int y = 0, h = height(); y < h; ++y)
     {
-        string::size_type pos = lines[y].find_first_of(glyphs);
-        if (pos != string::npos)
-            return coord_def(pos, y);
+        const char *line = row(y);
+        for (int x = 0, len = line_lengths[y]; x < len; ++x)
+            if (wanted[line[x]])
+                return coord_def(x, y);
     }
     return coord_def(-1, -1);
 }
@@ -1894,59 +1947,16 @@ bool map_lines::find_bounds(const char *str, coord_def &tl, coord_def &br) const
     return br.x >= 0;
 }
 
-bool map_lines::fill_zone(travel_distance_grid_t &tpd, const coord_def &start,
-                          const coord_def &tl, const coord_def &br, int zone,
-                          const char *wanted, const char *passable) const
-{
-    // This is the map_lines equivalent of _dgn_fill_zone.
-    // It's unfortunately extremely similar, but not close enough to combine.
-
-    bool ret = false;
-    list<coord_def> points[2];
-    int cur = 0;
-
-    for (points[cur].push_back(start); !points[cur].empty();)
-    {
-        for (const auto &c : points[cur])
-        {
-            tpd[c.x][c.y] = zone;
-
-            ret |= (wanted && strchr(wanted, (*this)(c)) != nullptr);
-
-            for (int yi = -1; yi <= 1; ++yi)
-                for (int xi = -1; xi <= 1; ++xi)
-                {
-                    if (!xi && !yi)
-                        continue;
-
-                    const coord_def cp(c.x + xi, c.y + yi);
-                    if (cp.x < tl.x || cp.x > br.x
-                        || cp.y < tl.y || cp.y > br.y
-                        || !in_bounds(cp) || tpd[cp.x][cp.y]
-                        || passable && !strchr(passable, (*this)(cp)))
-                    {
-                        continue;
-                    }
-
-                    tpd[cp.x][cp.y] = zone;
-                    points[!cur].push_back(cp);
-                }
-        }
-
-        points[cur].clear();
-        cur = !cur;
-    }
-    return ret;
-}
-
 int map_lines::count_feature_in_box(const coord_def &tl, const coord_def &br,
                                     const char *feat) const
 {
+    const glyph_set wanted(feat);
     int result = 0;
-    for (rectangle_iterator ri(tl, br); ri; ++ri)
+    for (int y = tl.y; y <= br.y; ++y)
     {
-        if (strchr(feat, (*this)(*ri)))
-            result++;
+        const char *line = row(y);
+        for (int x = tl.x; x <= br.x; ++x)
+            result += wanted[line[x]];
     }
 
     return result;
@@ -2032,7 +2042,7 @@ string tile_spec::get_tile()
 // map_lines::iterator
 
 map_lines::iterator::iterator(map_lines &_maplines, const string &_key)
-    : maplines(_maplines), key(_key), p(0, 0)
+    : maplines(_maplines), keys(_key.c_str()), p(0, 0)
 {
     advance();
 }
@@ -2042,16 +2052,10 @@ void map_lines::iterator::advance()
     const int height = maplines.height();
     while (p.y < height)
     {
-        string::size_type place = p.x;
-        if (place < maplines.lines[p.y].length())
-        {
-            place = maplines.lines[p.y].find_first_of(key, place);
-            if (place != string::npos)
-            {
-                p.x = place;
-                break;
-            }
-        }
+        const char *line = maplines.row(p.y);
+        for (const int len = maplines.line_lengths[p.y]; p.x < len; ++p.x)
+            if (keys[line[p.x]])
+                return;
         ++p.y;
         p.x = 0;
     }
@@ -2574,7 +2578,7 @@ string map_def::run_lua(bool run_main)
 {
     dlua_set_map mset(this);
 
-    int err = prelude.load(dlua);
+    int err = prelude.load_cached(dlua);
     if (err == E_CHUNK_LOAD_FAILURE)
         lua_pushnil(dlua);
     else if (err)
@@ -2585,7 +2589,7 @@ string map_def::run_lua(bool run_main)
     if (run_main)
     {
         // Run the map chunk to set up the vault's map grid.
-        err = mapchunk.load(dlua);
+        err = mapchunk.load_cached(dlua);
         if (err == E_CHUNK_LOAD_FAILURE)
             lua_pushnil(dlua);
         else if (err)
@@ -2600,7 +2604,7 @@ string map_def::run_lua(bool run_main)
 
         // Run the main Lua chunk to set up the rest of the vault
         run_hook("pre_main");
-        err = main.load(dlua);
+        err = main.load_cached(dlua);
         if (err == E_CHUNK_LOAD_FAILURE)
             lua_pushnil(dlua);
         else if (err)
@@ -2664,7 +2668,7 @@ bool map_def::test_lua_boolchunk(dlua_chunk &chunk, bool defval,
     bool result = defval;
     dlua_set_map mset(this);
 
-    int err = chunk.load(dlua);
+    int err = chunk.load_cached(dlua);
     if (err == E_CHUNK_LOAD_FAILURE)
         return result;
     else if (err)
@@ -322,6 +322,20 @@ public:
 };
 
 typedef pair<coord_def, coord_def> map_corner_t;
+
+// A set of glyphs to test map cells against in tight loops. Membership is
+// the same as strchr(glyphs, c) != nullptr for every glyph but NUL, which
+// no map cell holds.
+class glyph_set
+{
+public:
+    glyph_set(const char *glyphs);
+    bool operator [] (char c) const { return in_set[(unsigned char) c]; }
+
+private:
+    bool in_set[256];
+};
+
 class map_def;
 class rectangle_iterator;
 struct keyed_mapspec;
@@ -340,7 +354,7 @@ public:
         void advance();
     private:
         map_lines &maplines;
-        string key;
+        glyph_set keys;
         coord_def p;
     };
 
@@ -411,14 +425,29 @@ public:
     void apply_grid_overlay(const coord_def &pos, bool is_layout);
     void apply_overlays(const coord_def &pos, bool is_layout);
 
-    const vector<string> &get_lines() const;
-    vector<string> &get_lines();
+    vector<string> get_lines() const;
+    string get_line(int y) const;
+    // Replace line y, adding empty lines first if the map is shorter.
+    void set_line(int y, const string &s);
+    void erase_line(int y);
 
     rectangle_iterator get_iter() const;
-    char operator () (const coord_def &c) const;
-    char& operator () (const coord_def &c);
-    char operator () (int x, int y) const;
-    char& operator () (int x, int y);
+    char operator () (const coord_def &c) const { return (*this)(c.x, c.y); }
+    char& operator () (const coord_def &c) { return (*this)(c.x, c.y); }
+    char operator () (int x, int y) const { return cells[y * map_width + x]; }
+    char& operator () (int x, int y) { return cells[y * map_width + x]; }
+
+    // The width() glyphs of row y, which the next row follows directly.
+    const char *row(int y) const { return cells.data() + y * map_width; }
+    char *row(int y) { return cells.data() + y * map_width; }
+    // How much of row y is the line itself; the rest is padding.
+    int line_length(int y) const { return line_lengths[y]; }
+
+    // Set every cell of the (inclusive) rectangle to glyph.
+    void fill_rect(const coord_def &tl, const coord_def &br, char glyph);
+    // Replace the glyphs in find with replace throughout the rectangle.
+    void replace_in_rect(const coord_def &tl, const coord_def &br,
+                         const char *find, char replace);
 
     const keyed_mapspec *mapspec_at(const coord_def &c) const;
     keyed_mapspec *mapspec_at(const coord_def &c);
@@ -433,10 +462,6 @@ public:
     // Extend map dimensions with glyph 'fill' to minimum width and height.
     void extend(int min_width, int min_height, char fill);
 
-    bool fill_zone(travel_distance_grid_t &tpd, const coord_def &start,
-                   const coord_def &tl, const coord_def &br, int zone,
-                   const char *wanted, const char *passable) const;
-
     int count_feature_in_box(const coord_def &tl, const coord_def &br,
                              const char *feat) const;
 
@@ -457,9 +482,9 @@ private:
     void translate_marker(void (map_lines::*xform)(map_marker *, int par),
                           int par = 0);
 
+    void set_width(int new_width);
     void resolve_shuffle(const string &shuffle);
     void clear(const string &clear);
-    void subst(string &s, subst_spec &spec);
     void subst(subst_spec &);
     void nsubst(nsubst_spec &);
     void bind_overlay();
@@ -504,7 +529,12 @@ private:
 
 private:
     vector<map_marker *> markers;
-    vector<string> lines;
+
+    // The glyphs, row by row, map_width to a row. Until normalise(), lines
+    // may be shorter than that: line_lengths has their real lengths, and
+    // the rest of their rows are spaces.
+    vector<char> cells;
+    vector<int> line_lengths;
 
     struct overlay_def
     {
@@ -975,6 +1005,7 @@ public:
     void write(writer &) const;
     void clear() { depths.clear(); }
     bool empty() const { return depths.empty(); }
+    const depth_ranges_v &ranges() const { return depths; }
     bool is_usable_in(const level_id &lid) const;
     void add_depth(const level_range &range) { depths.push_back(range); }
     void add_depths(const depth_ranges &other_ranges);
@@ -0,0 +1,487 @@
+/**
+ * @file
+ * @brief Read-only text databases mapped from disk.
+**/
+
+#include "AppHdr.h"
+
+#include "mapped-db.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(UNIX) || defined(TARGET_COMPILER_MINGW)
+#include <unistd.h>
+#endif
+#ifdef UNIX
+#include <sys/mman.h>
+#endif
+
+#include "files.h"
+#include "libutil.h"
+#include "syscalls.h"
+
+#define MAPPED_DB_MAGIC "TDB1"
+#define MAPPED_DB_VERSION 1
+
+// FNV-1a.
+static uint32_t _db_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ (uint8_t) s[i]) * 16777619U;
+    return h;
+}
+
+static inline bool _trigram_char(char c)
+{
+    // Case folding is ASCII only: anything else can't be folded without
+    // knowing the encoding, so it stays out of the index.
+    return !(c & 0x80);
+}
+
+static inline uint32_t _trigram(const char *s)
+{
+    return (uint32_t) toalower((int) s[0]) << 16
+           | (uint32_t) toalower((int) s[1]) << 8
+           | (uint32_t) toalower((int) s[2]);
+}
+
+static void _add_trigrams(vector<uint32_t> &out, const string &s)
+{
+    for (size_t i = 0; i + 3 <= s.size(); ++i)
+    {
+        if (_trigram_char(s[i]) && _trigram_char(s[i + 1])
+            && _trigram_char(s[i + 2]))
+        {
+            out.push_back(_trigram(&s[i]));
+        }
+    }
+}
+
+// Collect runs of characters that every match of a regex must contain.
+// Whatever isn't understood just ends the current run (groups and classes
+// are skipped whole), so the runs are always safe to filter on. Returns
+// false if the regex can't be narrowed down at all.
+static bool _regex_literals(const string &regex, vector<string> &runs)
+{
+    // Inline options such as (?x) change how the rest is read.
+    if (regex.find("(?") != string::npos)
+        return false;
+
+    string run;
+    auto end_run = [&]()
+    {
+        if (run.size() >= 3)
+            runs.push_back(run);
+        run.clear();
+    };
+
+    for (size_t i = 0; i < regex.size(); ++i)
+    {
+        char c = regex[i];
+        switch (c)
+        {
+        case '|':
+            return false;
+
+        case '(':
+        case '[':
+        {
+            end_run();
+            // Skip to the matching close, minding escapes and classes.
+            int depth = 0;
+            bool in_class = false;
+            for (; i < regex.size(); ++i)
+            {
+                if (regex[i] == '\\')
+                    ++i;
+                else if (in_class)
+                {
+                    // ']' straight after '[' or '[^' is a member.
+                    if (regex[i] == ']' && regex[i - 1] != '['
+                        && !(regex[i - 1] == '^' && regex[i - 2] == '['))
+                    {
+                        in_class = false;
+                    }
+                }
+                else if (regex[i] == '[')
+                    in_class = true;
+                else if (regex[i] == '(')
+                    ++depth;
+                else if (regex[i] == ')')
+                    --depth;
+
+                if (!depth && !in_class)
+                    break;
+            }
+            continue;
+        }
+
+        case '{':
+            end_run();
+            i = min(regex.find('}', i), regex.size());
+            continue;
+
+        case '.': case '^': case '$': case '?': case '*': case '+':
+        case ')': case ']': case '}':
+            end_run();
+            continue;
+
+        case '\\':
+            if (i + 1 >= regex.size())
+                return false;
+            c = regex[++i];
+            if (isaalnum(c))
+            {
+                // Single-character classes and anchors; anything longer
+                // (\x41, \Q...\E, backreferences) is beyond us.
+                if (!strchr("dDwWsSbBAzZ", c))
+                    return false;
+                end_run();
+                continue;
+            }
+            // GNU word and buffer anchors in POSIX builds.
+            if (strchr("<>`'", c))
+            {
+                end_run();
+                continue;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        // A literal character, unless what follows makes it optional. POSIX
+        // regexes read a second quantifier as applying to the first, so
+        // b+? is (b+)? there rather than a lazy b+.
+        const char next = i + 1 < regex.size() ? regex[i + 1] : 0;
+        const char after = i + 2 < regex.size() ? regex[i + 2] : 0;
+        if (next == '?' || next == '*' || next == '{'
+            || next == '+' && (after == '?' || after == '*' || after == '{')
+            || !_trigram_char(c))
+        {
+            end_run();
+        }
+        else
+            run += c;
+    }
+    end_run();
+
+    return !runs.empty();
+}
+
+MappedDB *MappedDB::open(const string &path)
+{
+    MappedDB *db = new MappedDB();
+
+#ifdef UNIX
+    const int fd = open_u(path.c_str(), O_RDONLY, 0);
+    if (fd == -1)
+    {
+        delete db;
+        return nullptr;
+    }
+    struct stat st;
+    if (!fstat(fd, &st) && st.st_size > 0)
+    {
+        void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED)
+        {
+            db->_base = static_cast<const char *>(base);
+            db->_len = st.st_size;
+            db->_mapped = true;
+        }
+    }
+    close(fd);
+#else
+    FILE *f = fopen_u(path.c_str(), "rb");
+    if (!f)
+    {
+        delete db;
+        return nullptr;
+    }
+    const size_t len = file_size(f);
+    char *base = static_cast<char *>(malloc(len ? len : 1));
+    if (base && fread(base, 1, len, f) == len)
+    {
+        db->_base = base;
+        db->_len = len;
+    }
+    else
+        free(base);
+    fclose(f);
+#endif
+
+    if (!db->_base || !db->_check())
+    {
+        delete db;
+        return nullptr;
+    }
+    return db;
+}
+
+MappedDB::~MappedDB()
+{
+    if (!_base)
+        return;
+#ifdef UNIX
+    if (_mapped)
+        munmap(const_cast<char *>(_base), _len);
+#else
+    free(const_cast<char *>(_base));
+#endif
+}
+
+// Validate everything once, so that lookups needn't.
+bool MappedDB::_check()
+{
+    if (_len < sizeof(header))
+        return false;
+    _header = reinterpret_cast<const header *>(_base);
+    const header &h = *_header;
+
+    if (memcmp(h.magic, MAPPED_DB_MAGIC, 4) || h.version != MAPPED_DB_VERSION
+        || h.file_size != _len
+        || !h.num_buckets || (h.num_buckets & (h.num_buckets - 1))
+        || h.num_buckets < h.num_entries)
+    {
+        return false;
+    }
+
+    auto fits = [&](uint32_t off, uint64_t count, size_t size)
+    {
+        return off % 4 == 0 && off <= _len && count * size <= _len - off;
+    };
+    if (!fits(h.entries, h.num_entries, sizeof(entry))
+        || !fits(h.buckets, h.num_buckets, sizeof(uint32_t))
+        || !fits(h.trigrams, h.num_trigrams, sizeof(trigram))
+        || h.postings > _len)
+    {
+        return false;
+    }
+
+    _entries = reinterpret_cast<const entry *>(_base + h.entries);
+    _buckets = reinterpret_cast<const uint32_t *>(_base + h.buckets);
+    _trigrams = reinterpret_cast<const trigram *>(_base + h.trigrams);
+    _postings = reinterpret_cast<const uint32_t *>(_base + h.postings);
+    const size_t num_postings = (_len - h.postings) / sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < h.num_entries; ++i)
+    {
+        const entry &e = _entries[i];
+        if (e.key > _len || e.key_len > _len - e.key
+            || e.body > _len || e.body_len > _len - e.body)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h.num_buckets; ++i)
+        if (_buckets[i] > h.num_entries)
+            return false;
+    for (uint32_t i = 0; i < h.num_trigrams; ++i)
+    {
+        const trigram &t = _trigrams[i];
+        if (t.first > num_postings || t.count > num_postings - t.first)
+            return false;
+        for (uint32_t j = t.first; j < t.first + t.count; ++j)
+            if (_postings[j] >= h.num_entries)
+                return false;
+    }
+    return true;
+}
+
+db_text MappedDB::key(int i) const
+{
+    const entry &e = _entries[i];
+    return { _base + e.key, e.key_len };
+}
+
+db_text MappedDB::body(int i) const
+{
+    const entry &e = _entries[i];
+    return { _base + e.body, e.body_len };
+}
+
+db_text MappedDB::fetch(const string &key) const
+{
+    const uint32_t hash = _db_hash(key.data(), key.size());
+    const uint32_t mask = _header->num_buckets - 1;
+    for (uint32_t b = hash & mask, n = 0; n <= mask; b = (b + 1) & mask, ++n)
+    {
+        const uint32_t slot = _buckets[b];
+        if (!slot)
+            break;
+        const entry &e = _entries[slot - 1];
+        if (e.hash == hash && e.key_len == key.size()
+            && !memcmp(_base + e.key, key.data(), key.size()))
+        {
+            return { _base + e.body, e.body_len };
+        }
+    }
+    return { nullptr, 0 };
+}
+
+/**
+ * Find the entries that may match a regex, by key or by body.
+ *
+ * @param regex  the regex to be matched.
+ * @param out    set to the indices of the entries to try, in key order.
+ * @return false if the index can't narrow the search down, in which case
+ *         every entry has to be tried.
+ */
+bool MappedDB::candidates(const string &regex, vector<uint32_t> &out) const
+{
+    vector<string> runs;
+    if (!_regex_literals(regex, runs))
+        return false;
+
+    vector<uint32_t> wanted;
+    for (const string &run : runs)
+        _add_trigrams(wanted, run);
+    sort(wanted.begin(), wanted.end());
+    wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+
+    vector<const trigram *> lists;
+    for (uint32_t value : wanted)
+    {
+        const trigram *end = _trigrams + _header->num_trigrams;
+        const trigram *t = lower_bound(_trigrams, end, value,
+            [](const trigram &a, uint32_t v) { return a.value < v; });
+        if (t == end || t->value != value)
+        {
+            out.clear();
+            return true;
+        }
+        lists.push_back(t);
+    }
+    sort(lists.begin(), lists.end(),
+         [](const trigram *a, const trigram *b)
+         {
+             return a->count < b->count;
+         });
+
+    // Intersect, starting from the rarest trigram.
+    out.assign(_postings + lists[0]->first,
+               _postings + lists[0]->first + lists[0]->count);
+    for (size_t i = 1; i < lists.size() && !out.empty(); ++i)
+    {
+        const uint32_t *first = _postings + lists[i]->first;
+        const uint32_t *last = first + lists[i]->count;
+        out.erase(remove_if(out.begin(), out.end(),
+                            [&](uint32_t e)
+                            { return !binary_search(first, last, e); }),
+                  out.end());
+    }
+    return true;
+}
+
+static void _append_u32s(string &out, const vector<uint32_t> &v)
+{
+    out.append(reinterpret_cast<const char *>(v.data()),
+               v.size() * sizeof(uint32_t));
+}
+
+// Write the entries out in the format MappedDB reads. The file is written
+// under a temporary name and renamed into place, so processes that still
+// have the old one mapped are unaffected.
+bool MappedDB::write(const string &path, const map<string, string> &entries)
+{
+    const uint32_t num_entries = entries.size();
+    uint32_t num_buckets = 16;
+    while (num_buckets < num_entries * 2)
+        num_buckets *= 2;
+
+    vector<entry> table;
+    vector<uint32_t> buckets(num_buckets, 0);
+    string strings;
+    // (trigram, entry index), made unique per entry.
+    vector<pair<uint32_t, uint32_t>> occurrences;
+    vector<uint32_t> grams;
+
+    for (const auto &kv : entries)
+    {
+        const uint32_t index = table.size();
+        entry e;
+        e.hash = _db_hash(kv.first.data(), kv.first.size());
+        e.key = strings.size();
+        e.key_len = kv.first.size();
+        strings += kv.first;
+        e.body = strings.size();
+        e.body_len = kv.second.size();
+        strings += kv.second;
+        table.push_back(e);
+
+        uint32_t b = e.hash & (num_buckets - 1);
+        while (buckets[b])
+            b = (b + 1) & (num_buckets - 1);
+        buckets[b] = index + 1;
+
+        grams.clear();
+        _add_trigrams(grams, kv.first);
+        _add_trigrams(grams, kv.second);
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        for (uint32_t g : grams)
+            occurrences.emplace_back(g, index);
+    }
+    sort(occurrences.begin(), occurrences.end());
+
+    vector<trigram> trigrams;
+    vector<uint32_t> postings;
+    for (const auto &occ : occurrences)
+    {
+        if (trigrams.empty() || trigrams.back().value != occ.first)
+            trigrams.push_back({ occ.first, (uint32_t) postings.size(), 0 });
+        trigrams.back().count++;
+        postings.push_back(occ.second);
+    }
+
+    header h;
+    memcpy(h.magic, MAPPED_DB_MAGIC, 4);
+    h.version = MAPPED_DB_VERSION;
+    h.num_entries = num_entries;
+    h.num_buckets = num_buckets;
+    h.num_trigrams = trigrams.size();
+    h.entries = sizeof(header);
+    h.buckets = h.entries + num_entries * sizeof(entry);
+    h.trigrams = h.buckets + num_buckets * sizeof(uint32_t);
+    h.postings = h.trigrams + trigrams.size() * sizeof(trigram);
+    const uint32_t strings_start = h.postings
+                                   + postings.size() * sizeof(uint32_t);
+    h.file_size = strings_start + strings.size();
+    for (entry &e : table)
+    {
+        e.key += strings_start;
+        e.body += strings_start;
+    }
+
+    string out;
+    out.reserve(h.file_size);
+    out.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.append(reinterpret_cast<const char *>(table.data()),
+               table.size() * sizeof(entry));
+    _append_u32s(out, buckets);
+    out.append(reinterpret_cast<const char *>(trigrams.data()),
+               trigrams.size() * sizeof(trigram));
+    _append_u32s(out, postings);
+    out += strings;
+    ASSERT(out.size() == h.file_size);
+
+    const string tmp = path + ".tmp";
+    unlink_u(tmp.c_str());
+    FILE *f = fopen_u(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    if (fclose(f) || !ok)
+    {
+        unlink_u(tmp.c_str());
+        return false;
+    }
+    return !rename_u(tmp.c_str(), path.c_str());
+}
@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief Read-only text databases mapped from disk.
+**/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// A key or body inside a MappedDB. Not NUL-terminated.
+struct db_text
+{
+    const char *ptr;
+    size_t len;
+};
+
+// A text database as written by TextDB::_regenerate_db(): a read-only file
+// that is mapped into memory (and so shared between all the crawl processes
+// on a server), holding the entries sorted by key, an open-addressed hash
+// table over them, and a trigram index for the regex searches.
+//
+// Everything is in native byte order; the file lives in the (versioned)
+// cache directory and is rebuilt whenever it doesn't check out.
+class MappedDB
+{
+public:
+    static MappedDB *open(const string &path);
+    static bool write(const string &path, const map<string, string> &entries);
+    ~MappedDB();
+
+    int size() const { return _header->num_entries; }
+    db_text key(int i) const;
+    db_text body(int i) const;
+    db_text fetch(const string &key) const;
+    bool candidates(const string &regex, vector<uint32_t> &out) const;
+
+private:
+    struct header
+    {
+        char     magic[4];
+        uint32_t version;
+        uint32_t file_size;
+        uint32_t num_entries;
+        uint32_t num_buckets;   // a power of two
+        uint32_t num_trigrams;
+        uint32_t entries;       // file offsets of the tables below
+        uint32_t buckets;       // entry index + 1, or 0 if empty
+        uint32_t trigrams;
+        uint32_t postings;
+    };
+
+    struct entry
+    {
+        uint32_t hash;
+        uint32_t key, key_len;
+        uint32_t body, body_len;
+    };
+
+    // The entries containing a trigram are postings[first, first + count),
+    // in increasing order.
+    struct trigram
+    {
+        uint32_t value;
+        uint32_t first, count;
+    };
+
+    MappedDB() : _base(nullptr), _len(0), _mapped(false), _header(nullptr)
+    {
+    }
+    bool _check();
+
+    const char *_base;
+    size_t _len;
+    bool _mapped;
+    const header *_header;
+    const entry *_entries;
+    const uint32_t *_buckets;
+    const trigram *_trigrams;
+    const uint32_t *_postings;
+};
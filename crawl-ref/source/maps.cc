@@ -10,11 +10,15 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <unordered_map>
 #include <sys/param.h>
 #include <sys/types.h>
 #if defined(UNIX) || defined(TARGET_COMPILER_MINGW)
 #include <unistd.h>
 #endif
+#ifdef UNIX
+#include <sys/wait.h>
+#endif
 
 #include "branch.h"
 #include "coord.h"
@@ -147,6 +151,7 @@ static void _dgn_flush_map_environments()
 {
     // Clean up cached environments.
     dlua.callfn("dgn_flush_map_environments", 0, 0);
+    dlua_flush_chunk_cache();
 }
 
 static void _dgn_flush_map_environment_for(const string &mapname)
@@ -424,13 +429,12 @@ static bool _map_safe_vault_place(const map_def &map,
     const bool vault_can_replace_portals =
         map.has_tag("replace_portal");
 
-    const vector<string> &lines = map.map.get_lines();
     for (rectangle_iterator ri(c, c + size - 1); ri; ++ri)
     {
         const coord_def cp(*ri);
         const coord_def dp(cp - c);
 
-        if (lines[dp.y][dp.x] == ' ')
+        if (map.map(dp) == ' ')
             continue;
 
         // Unconditionally allow portal placements to work.
@@ -489,13 +493,13 @@ static bool _connected_minivault_place(const coord_def &c,
         return true;
 
     // Must not be completely isolated.
-    const vector<string> &lines = place.map.map.get_lines();
+    const map_lines &lines = place.map.map;
 
     for (rectangle_iterator ri(c, c + place.size - 1); ri; ++ri)
     {
         const coord_def &ci(*ri);
 
-        if (lines[ci.y - c.y][ci.x - c.x] == ' ')
+        if (lines(ci - c) == ' ')
             continue;
 
         if (_may_overwrite_feature(ci, false, false)
@@ -724,18 +728,175 @@ vector<string> find_map_matches(const string &name)
     return matches;
 }
 
+typedef vector<unsigned> vault_indices;
+
+/////////////////////////////////////////////////////////////////////////////
+// Candidate indices for map selection.
+//
+// Picking a vault used to run map_selector::accept() over every loaded map,
+// several times per level. These indices narrow a query down to the maps
+// that could possibly match its tags or its place; the full predicate is
+// still run on each candidate. Candidate lists are sorted by map index, so
+// selection sees maps in the same order as a scan of vdefs would, and draws
+// the same random numbers.
+
+static void _add_candidate(vault_indices &list, unsigned index)
+{
+    // Maps are added in increasing index order; a map may cover the same
+    // slot through several ranges.
+    if (list.empty() || list.back() != index)
+        list.push_back(index);
+}
+
+static vault_indices _union_candidates(const vault_indices &a,
+                                       const vault_indices &b)
+{
+    vault_indices merged;
+    merged.reserve(a.size() + b.size());
+    set_union(a.begin(), a.end(), b.begin(), b.end(), back_inserter(merged));
+    return merged;
+}
+
+// Maps whose depth_ranges may match a given level.
+class map_depth_index
+{
+public:
+    void clear()
+    {
+        for (int b = 0; b < NUM_BRANCHES; ++b)
+        {
+            for (vault_indices &list : by_depth[b])
+                list.clear();
+            branch_end[b].clear();
+        }
+        absolute.clear();
+    }
+
+    void add(unsigned index, const depth_ranges &ranges)
+    {
+        for (const level_range &lr : ranges.ranges())
+        {
+            // Denials only ever remove a level from a map's ranges.
+            if (lr.deny)
+                continue;
+
+            // Ranges of absolute depth can match in any branch.
+            if (lr.branch == NUM_BRANCHES)
+            {
+                _add_candidate(absolute, index);
+                continue;
+            }
+
+            // Branch ends depend on brdepth, which can change between games.
+            if (lr.shallowest == BRANCH_END)
+                _add_candidate(branch_end[lr.branch], index);
+
+            const int deepest = min(lr.deepest, MAX_BRANCH_DEPTH);
+            for (int d = max(lr.shallowest, 1); d <= deepest; ++d)
+                _add_candidate(by_depth[lr.branch][d], index);
+        }
+    }
+
+    vault_indices candidates(const level_id &place) const
+    {
+        if (place.branch < 0 || place.branch >= NUM_BRANCHES
+            || place.depth < 1 || place.depth > MAX_BRANCH_DEPTH)
+        {
+            return absolute;
+        }
+
+        vault_indices result =
+            _union_candidates(by_depth[place.branch][place.depth], absolute);
+        if (place.depth == brdepth[place.branch])
+            result = _union_candidates(result, branch_end[place.branch]);
+        return result;
+    }
+
+private:
+    vault_indices by_depth[NUM_BRANCHES][MAX_BRANCH_DEPTH + 1];
+    vault_indices branch_end[NUM_BRANCHES];
+    vault_indices absolute;
+};
+
+static bool selector_index_valid = false;
+static unordered_map<string, vault_indices> maps_by_tag;
+static map_depth_index maps_by_depth;
+static map_depth_index maps_by_place;
+
+// Call whenever vdefs, or the tags or depths of a map in it, change.
+static void _invalidate_selector_index()
+{
+    selector_index_valid = false;
+}
+
+static void _build_selector_index()
+{
+    if (selector_index_valid)
+        return;
+
+    maps_by_tag.clear();
+    maps_by_depth.clear();
+    maps_by_place.clear();
+    for (unsigned i = 0, size = vdefs.size(); i < size; ++i)
+    {
+        for (const string &tag : vdefs[i].get_tags_unsorted())
+            maps_by_tag[tag].push_back(i);
+        maps_by_depth.add(i, vdefs[i].depths);
+        maps_by_place.add(i, vdefs[i].place);
+    }
+    selector_index_valid = true;
+}
+
+// Maps having all the given tags.
+static vault_indices _maps_with_tags(const string &tags)
+{
+    _build_selector_index();
+
+    const unordered_set<string> tag_set = parse_tags(tags);
+    if (tag_set.empty())
+    {
+        vault_indices all(vdefs.size());
+        for (unsigned i = 0; i < all.size(); ++i)
+            all[i] = i;
+        return all;
+    }
+
+    // Start from the rarest tag to keep the intersections small.
+    vector<const vault_indices *> lists;
+    for (const string &tag : tag_set)
+    {
+        const vault_indices *list = map_find(maps_by_tag, tag);
+        if (!list)
+            return vault_indices();
+        lists.push_back(list);
+    }
+    sort(lists.begin(), lists.end(),
+         [](const vault_indices *a, const vault_indices *b)
+         { return a->size() < b->size(); });
+
+    vault_indices result = *lists[0];
+    for (unsigned i = 1; i < lists.size() && !result.empty(); ++i)
+    {
+        vault_indices both;
+        set_intersection(result.begin(), result.end(),
+                         lists[i]->begin(), lists[i]->end(),
+                         back_inserter(both));
+        result.swap(both);
+    }
+    return result;
+}
+
 mapref_vector find_maps_for_tag(const string &tag,
                                 bool check_depth,
                                 bool check_used)
 {
     mapref_vector maps;
     level_id place = level_id::current();
-    unordered_set<string> tag_set = parse_tags(tag);
 
-    for (const map_def &mapdef : vdefs)
+    for (unsigned i : _maps_with_tags(tag))
     {
-        if (mapdef.has_all_tags(tag_set.begin(), tag_set.end())
-            && !mapdef.has_tag("dummy")
+        const map_def &mapdef(vdefs[i]);
+        if (!mapdef.has_tag("dummy")
             && (!check_depth || !mapdef.has_depth()
                 || mapdef.is_usable_in(place))
             && (!check_used || !mapdef.map_already_used()))
@@ -760,6 +921,7 @@ private:
 public:
     bool accept(const map_def &md) const;
     void announce(const map_def *map) const;
+    vault_indices candidates() const;
 
     bool valid() const
     {
@@ -842,6 +1004,26 @@ bool map_selector::depth_selectable(const map_def &mapdef) const
            && (!check_layout || _map_matches_layout_type(mapdef));
 }
 
+// A superset of the maps this selector will accept, in index order.
+vault_indices map_selector::candidates() const
+{
+    _build_selector_index();
+
+    switch (sel)
+    {
+    case PLACE:
+        return maps_by_place.candidates(place);
+    case DEPTH:
+    case DEPTH_AND_CHANCE:
+        // depth_selectable() requires is_usable_in(place).
+        return maps_by_depth.candidates(place);
+    case TAG:
+        return _maps_with_tags(tag);
+    default:
+        return vault_indices();
+    }
+}
+
 static bool _is_extra_compatible(maybe_bool want_extra, bool have_extra)
 {
     return want_extra == MB_MAYBE
@@ -941,15 +1123,13 @@ string vault_chance_tag(const map_def &map)
     return "";
 }
 
-typedef vector<unsigned> vault_indices;
-
 static vault_indices _eligible_maps_for_selector(const map_selector &sel)
 {
     vault_indices eligible;
 
     if (sel.valid())
     {
-        for (unsigned i = 0, size = vdefs.size(); i < size; ++i)
+        for (unsigned i : sel.candidates())
             if (sel.accept(vdefs[i]))
                 eligible.push_back(i);
     }
@@ -1262,6 +1442,26 @@ static bool _verify_map_full(const string &base, time_t mtime)
     return verify_file_version(base + ".dsc", mtime);
 }
 
+// Note where a map read back from a cache or the index was defined,
+// complaining as the parser would if another map already has its name.
+// The parser only sees the maps loaded before it, and the workers of
+// _compile_des_files() each see only their own files, so names repeated
+// across files are caught here.
+static void _note_loaded_map(const map_def &vdef)
+{
+    map_load_info_t::const_iterator i = lc_loaded_maps.find(vdef.name);
+    if (i != lc_loaded_maps.end())
+    {
+        if (lc_des_worker)
+            abort_des_worker();
+        end(1, false, "%s:%d: Map named '%s' already loaded at %s:%d\n",
+            vdef.place_loaded_from.filename.c_str(),
+            vdef.place_loaded_from.lineno, vdef.name.c_str(),
+            i->second.filename.c_str(), i->second.lineno);
+    }
+    lc_loaded_maps[vdef.name] = vdef.place_loaded_from;
+}
+
 static bool _load_map_index(const string& cache, const string &base,
                             time_t mtime)
 {
@@ -1318,7 +1518,7 @@ static bool _load_map_index(const string& cache, const string &base,
         vdef.order = unmarshallInt(inf);
 
         vdef.set_file(cache);
-        lc_loaded_maps[vdef.name] = vdef.place_loaded_from;
+        _note_loaded_map(vdef);
         vdef.place_loaded_from.clear();
     }
     fclose(fp);
@@ -1370,6 +1570,8 @@ static void _write_map_full(const string &filebase, size_t vs, size_t ve,
 {
     const string cfile = filebase + ".dsc";
     FILE *fp = fopen_u(cfile.c_str(), "wb");
+    if (!fp && lc_des_worker)
+        abort_des_worker();
     if (!fp)
         end(1, true, "Unable to open %s for writing", cfile.c_str());
 
@@ -1387,6 +1589,8 @@ static void _write_map_index(const string &filebase, size_t vs, size_t ve,
 {
     const string cfile = filebase + ".idx";
     FILE *fp = fopen_u(cfile.c_str(), "wb");
+    if (!fp && lc_des_worker)
+        abort_des_worker();
     if (!fp)
         end(1, true, "Unable to open %s for writing", cfile.c_str());
 
@@ -1420,26 +1624,215 @@ static void _write_map_cache(const string &filename, size_t vs, size_t ve,
     _write_map_index(descache_base, vs, ve, mtime);
 }
 
-static void _parse_maps(const string &s)
+/////////////////////////////////////////////////////////////////////////////
+// The consolidated map index.
+//
+// Every .des file also has its own .idx/.dsc cache, but opening and
+// version-checking two or three files per .des (some 200 of them) on each
+// startup adds up. Once all maps are loaded, the headers of every file are
+// written to a single index in the des cache directory; on the next start
+// each .des file only costs a stat() to confirm that its entry is current.
+// Map bodies stay in the per-file .dsc files and are loaded on demand by
+// map_def::load().
+
+#define MAP_INDEX_FILE "maps.cache"
+
+struct des_index_entry
+{
+    time_t mtime;
+    bool has_prelude;
+    dlua_chunk prelude;
+    map_vector maps;
+
+    des_index_entry()
+        : mtime(0), has_prelude(false), prelude("global_prelude")
+    {
+    }
+};
+
+// The consolidated index as read from disk, keyed by cache name.
+static map<string, des_index_entry> map_index;
+
+// A .des file that has been loaded in this session, in load order.
+struct des_file_loaded
 {
-    string cache_name = get_cache_name(s);
-    if (map_files_read.count(cache_name))
+    string cache_name;
+    time_t mtime;
+    int prelude;        // index into global_preludes, or -1
+    size_t first, last; // range in vdefs
+};
+static vector<des_file_loaded> des_files_loaded;
+
+// Does the index on disk need rewriting after this load?
+static bool map_index_dirty = false;
+
+// Set in the worker processes of _compile_des_files().
+bool lc_des_worker = false;
+
+static string _map_index_path()
+{
+    return _des_cache_dir(MAP_INDEX_FILE);
+}
+
+static void _read_map_index()
+{
+    map_index.clear();
+    map_index_dirty = false;
+
+    const string path = _map_index_path();
+    file_lock deslock(path + ".lk", "rb", false);
+
+    FILE *fp = fopen_u(path.c_str(), "rb");
+    if (!fp)
+    {
+        map_index_dirty = true;
         return;
+    }
 
-    map_files_read.insert(cache_name);
+    // Slurp the whole index at once; it is read front to back anyway.
+    vector<unsigned char> buf(file_size(fp));
+    const bool ok = fread(buf.data(), 1, buf.size(), fp) == buf.size();
+    fclose(fp);
 
-    if (_load_map_cache(s, cache_name))
+    try
+    {
+        if (!ok)
+            throw short_read_exception();
+
+        reader inf(buf, TAG_MINOR_VERSION);
+        const auto version = get_save_version(inf);
+        if (version.major != TAG_MAJOR_VERSION
+            || version.minor != TAG_MINOR_VERSION
+            || unmarshallByte(inf) != WORD_LEN)
+        {
+            map_index_dirty = true;
+            return;
+        }
+
+        for (int nfiles = unmarshallInt(inf); nfiles > 0; --nfiles)
+        {
+            const string cache_name = unmarshallString(inf);
+            des_index_entry &entry(map_index[cache_name]);
+            entry.mtime = unmarshallSigned(inf);
+            entry.has_prelude = unmarshallBoolean(inf);
+            if (entry.has_prelude)
+                entry.prelude.read(inf);
+
+            entry.maps.resize(unmarshallInt(inf));
+            for (map_def &vdef : entry.maps)
+            {
+                vdef.read_index(inf);
+                vdef.description = unmarshallString(inf);
+                vdef.order = unmarshallInt(inf);
+                vdef.set_file(cache_name);
+            }
+        }
+    }
+    catch (short_read_exception &E)
+    {
+        dprf("Map index %s is truncated, rebuilding", path.c_str());
+        map_index.clear();
+        map_index_dirty = true;
+    }
+}
+
+static void _write_map_index_file()
+{
+    _check_des_index_dir();
+
+    const string path = _map_index_path();
+    file_lock deslock(path + ".lk", "wb");
+
+    FILE *fp = fopen_u(path.c_str(), "wb");
+    if (!fp)
+    {
+        // Not fatal: the per-file caches still work.
+        mprf(MSGCH_ERROR, "Unable to write %s", path.c_str());
         return;
+    }
+
+    writer outf(path, fp);
+    write_save_version(outf, save_version::current());
+    marshallByte(outf, WORD_LEN);
+    marshallInt(outf, des_files_loaded.size());
+    for (const des_file_loaded &file : des_files_loaded)
+    {
+        marshallString(outf, file.cache_name);
+        marshallSigned(outf, file.mtime);
+        marshallBoolean(outf, file.prelude != -1);
+        if (file.prelude != -1)
+            global_preludes[file.prelude].write(outf);
+
+        marshallInt(outf, file.last - file.first);
+        for (size_t i = file.first; i < file.last; ++i)
+        {
+            map_def &vdef(vdefs[i]);
+            vdef.place_loaded_from = lc_loaded_maps[vdef.name];
+            vdef.write_index(outf);
+            vdef.place_loaded_from.clear();
+            marshallString(outf, vdef.description);
+            marshallInt(outf, vdef.order);
+        }
+    }
+    fclose(fp);
+
+    map_index_dirty = false;
+}
+
+static des_index_entry *_map_index_entry(const string &filename,
+                                         const string &cachename)
+{
+    des_index_entry *entry = map_find(map_index, cachename);
+    if (!entry || entry->mtime != file_modtime(filename))
+        return nullptr;
+    return entry;
+}
+
+static bool _load_indexed_maps(const string &filename, const string &cachename)
+{
+    des_index_entry *entry = _map_index_entry(filename, cachename);
+    if (!entry)
+        return false;
+
+    if (entry->has_prelude)
+        global_preludes.push_back(entry->prelude);
+
+    for (map_def &vdef : entry->maps)
+    {
+        _note_loaded_map(vdef);
+        vdef.place_loaded_from.clear();
+        vdefs.push_back(move(vdef));
+    }
+    // The entry has been consumed; a reread must go back to the disk.
+    map_index.erase(cachename);
+    return true;
+}
 
+// Worker processes can't use end(): that would tear down the parent's
+// terminal and webtiles connection. They exit quietly instead, and the
+// parent reparses the file and reports the error itself.
+NORETURN void abort_des_worker()
+{
+    _exit(1);
+}
+
+// Parse a .des file and write its per-file caches. Returns the file's mtime.
+static time_t _compile_maps(const string &s, const string &cache_name)
+{
     FILE *dat = fopen_u(s.c_str(), "r");
     if (!dat)
+    {
+        if (lc_des_worker)
+            abort_des_worker();
         end(1, true, "Failed to open %s for reading", s.c_str());
+    }
 
 #ifdef DEBUG_DIAGNOSTICS
     printf("Regenerating des: %s\n", s.c_str());
 #endif
     // won't be seen by the user unless they look for it
-    mprf(MSGCH_PLAIN, "Regenerating des: %s", s.c_str());
+    if (!lc_des_worker)
+        mprf(MSGCH_PLAIN, "Regenerating des: %s", s.c_str());
 
     time_t mtime = file_modtime(dat);
     _reset_map_parser();
@@ -1455,10 +1848,101 @@ static void _parse_maps(const string &s)
     global_preludes.push_back(lc_global_prelude);
 
     _write_map_cache(cache_name, file_start, vdefs.size(), mtime);
+    return mtime;
+}
+
+static void _parse_maps(const string &s)
+{
+    string cache_name = get_cache_name(s);
+    if (map_files_read.count(cache_name))
+        return;
+
+    map_files_read.insert(cache_name);
+
+    des_file_loaded loaded;
+    loaded.cache_name = cache_name;
+    loaded.mtime = file_modtime(s);
+    loaded.first = vdefs.size();
+    const size_t npreludes = global_preludes.size();
+
+    if (!_load_indexed_maps(s, cache_name))
+    {
+        map_index_dirty = true;
+        if (!_load_map_cache(s, cache_name))
+            loaded.mtime = _compile_maps(s, cache_name);
+    }
+
+    loaded.last = vdefs.size();
+    loaded.prelude = global_preludes.size() > npreludes
+                     && !global_preludes.back().empty()
+                         ? global_preludes.size() - 1 : -1;
+    des_files_loaded.push_back(loaded);
+}
+
+// Compile the .des files whose caches are out of date in parallel, so that
+// the first start after an update doesn't have to parse everything in
+// turn. The parser and the Lua state it validates maps with are global, so
+// the workers are forked processes; each writes the per-file caches of its
+// share of the files, and the normal load that follows picks them up.
+static void _compile_des_files()
+{
+#ifdef UNIX
+    const string desdir = datafile_path("dat/des", false, false, dir_exists);
+    if (desdir.empty())
+        return;
+
+    vector<string> stale;
+    for (const string &file : get_dir_files_recursive(desdir, ".des"))
+    {
+        const string path = catpath(desdir, file);
+        const string cache_name = get_cache_name(path);
+        if (_map_index_entry(path, cache_name))
+            continue;
+
+        const string base = get_descache_path(cache_name, "");
+        const time_t mtime = file_modtime(path);
+        if (!_verify_map_index(base, mtime) || !_verify_map_full(base, mtime))
+            stale.push_back(path);
+    }
+
+    const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const int nworkers = min<long>(stale.size(), max(ncpus, 1L));
+    if (nworkers < 2)
+        return;
+
+    dprf("Compiling %u des files with %d workers",
+         (unsigned int)stale.size(), nworkers);
+
+    _check_des_index_dir();
+    // Don't let the children flush copies of our pending output.
+    fflush(nullptr);
+
+    vector<pid_t> workers;
+    for (int w = 0; w < nworkers; ++w)
+    {
+        const pid_t pid = fork();
+        if (pid == -1)
+            break;
+        if (!pid)
+        {
+            lc_des_worker = true;
+            for (size_t i = w; i < stale.size(); i += nworkers)
+                _parse_maps(lc_desfile = stale[i]);
+            _exit(0);
+        }
+        workers.push_back(pid);
+    }
+
+    // A failed worker is not an error here: whatever it didn't finish is
+    // parsed again, with proper error reporting, by the load that follows.
+    for (pid_t pid : workers)
+        waitpid(pid, nullptr, 0);
+#endif
 }
 
 void read_map(const string &file)
 {
+    _invalidate_selector_index();
     _parse_maps(lc_desfile = datafile_path(file));
     _dgn_flush_map_environments();
     // Force GC to prevent heap from swelling unnecessarily.
@@ -1467,9 +1951,17 @@ void read_map(const string &file)
 
 void read_maps()
 {
+    _read_map_index();
+    _compile_des_files();
+
     if (dlua.execfile("dlua/loadmaps.lua", true, true, true))
         end(1, false, "Lua error: %s", dlua.error.c_str());
 
+    // Entries that weren't consumed belong to .des files that are gone.
+    if (map_index_dirty || !map_index.empty())
+        _write_map_index_file();
+    map_index.clear();
+
     lc_loaded_maps.clear();
 
     {
@@ -1493,7 +1985,9 @@ void reread_maps()
 
     // BOOM!
     vdefs.clear();
+    _invalidate_selector_index();
     map_files_read.clear();
+    des_files_loaded.clear();
     read_maps();
 }
 
@@ -1512,6 +2006,7 @@ void add_parsed_map(const map_def &md)
 
     map.fixup();
     vdefs.push_back(map);
+    _invalidate_selector_index();
 }
 
 void run_map_global_preludes()
@@ -1528,6 +2023,8 @@ void run_map_global_preludes()
 
 void run_map_local_preludes()
 {
+    // Preludes may change tags and depths.
+    _invalidate_selector_index();
     for (map_def &vdef : vdefs)
     {
         if (!vdef.prelude.empty())
@@ -68,6 +68,9 @@ extern map_def         lc_map;
 extern depth_ranges    lc_default_depths;
 extern dlua_chunk      lc_global_prelude;
 extern bool            lc_run_global_prelude;
+extern bool            lc_des_worker;
+
+NORETURN void abort_des_worker();
 
 typedef bool (*map_place_check_t)(const map_def &, const coord_def &c,
                                   const coord_def &size);
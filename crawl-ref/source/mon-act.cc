@@ -16,6 +16,7 @@
 #include "colour.h"
 #include "coordit.h"
 #include "corpse.h"
+#include "dbg-prof.h"
 #include "dbg-scan.h"
 #include "delay.h"
 #include "directn.h" // feature_description_at
@@ -260,6 +261,8 @@ static bool _swap_monsters(monster& mover, monster& moved)
 
 static bool _do_mon_spell(monster* mons)
 {
+    PROFILE_MONSTER_ACTION(mons, MACT_SPELL);
+
     if (handle_mon_spell(mons))
     {
         // If a Pan lord/pghost is known to be a spellcaster, it's safer
@@ -528,6 +531,8 @@ bool mons_can_move_towards_target(const monster* mon)
 
 static void _handle_movement(monster* mons)
 {
+    PROFILE_MONSTER_ACTION(mons, MACT_MOVEMENT);
+
     _maybe_set_patrol_route(mons);
 
     if (sanctuary_exists())
@@ -1163,6 +1168,8 @@ static bool _handle_wand(monster& mons)
 
 bool handle_throw(monster* mons, bolt & beem, bool teleport, bool check_only)
 {
+    PROFILE_MONSTER_ACTION(mons, MACT_THROW);
+
     // Yes, there is a logic to this ordering {dlb}:
     if (mons->incapacitated()
         || mons->submerged()
@@ -1534,6 +1541,7 @@ static void _pre_monster_move(monster& mons)
 void handle_monster_move(monster* mons)
 {
     ASSERT(mons); // XXX: change to monster &mons
+    PROFILE_MONSTER_ACTION(mons, MACT_TURN);
     const monsterentry* entry = get_monster_data(mons->type);
     if (!entry)
         return;
@@ -2392,6 +2400,8 @@ static void _display_just_seen()
  */
 void handle_monsters(bool with_noise)
 {
+    PROFILE_STAGE(PROF_HANDLE_MONSTERS);
+
     for (monster_iterator mi; mi; ++mi)
     {
         _pre_monster_move(**mi);
@@ -3368,6 +3378,7 @@ static bool _do_move_monster(monster& mons, const coord_def& delta)
 static bool _monster_move(monster* mons)
 {
     ASSERT(mons); // XXX: change to monster &mons
+    PROFILE_MONSTER_ACTION(mons, MACT_MOVE);
     move_array good_move;
 
     const habitat_type habitat = mons_primary_habitat(*mons);
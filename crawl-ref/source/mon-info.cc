@@ -659,7 +659,8 @@ monster_info::monster_info(const monster* m, int milev)
 
     // book loading for player ghost and vault monsters
     spells.clear();
-    if (m->props.exists(CUSTOM_SPELLS_KEY) || mons_is_pghost(type)
+    static const static_prop_key custom_spells_key(CUSTOM_SPELLS_KEY);
+    if (m->props.exists(custom_spells_key) || mons_is_pghost(type)
         || type == MONS_PANDEMONIUM_LORD)
     {
         spells = m->spells;
@@ -706,11 +707,13 @@ monster_info::monster_info(const monster* m, int milev)
         _blocked_ray(m->pos(), &fire_blocker);
     }
 
-    if (m->props.exists("quote"))
-        quote = m->props["quote"].get_string();
+    static const static_prop_key quote_key("quote");
+    if (m->props.exists(quote_key))
+        quote = m->props[quote_key].get_string();
 
-    if (m->props.exists("description"))
-        description = m->props["description"].get_string();
+    static const static_prop_key description_key("description");
+    if (m->props.exists(description_key))
+        description = m->props[description_key].get_string();
 
     // init names of constrictor and constrictees
     constrictor_name = "";
@@ -211,6 +211,15 @@ bool try_pathfind(monster* mon)
          mon->name(DESC_PLAIN).c_str(), mon->pos().x, mon->pos().y,
          targpos.x, targpos.y, range);
 #endif
+    // Hostiles converging on the same foe can share the work.
+    if (!mon->friendly()
+        && shared_path_waypoints(mon, targpos, range, mon->travel_path))
+    {
+        mon->target = mon->travel_path[0];
+        mon->travel_target = MTRAV_FOE;
+        return true;
+    }
+
     monster_pathfind mp;
     mp.set_range(range);
 
@@ -972,15 +981,26 @@ int mons_find_nearest_level_exit(const monster* mon, vector<level_exit> &e,
     if (e.empty() || reset)
         _find_all_level_exits(e);
 
+    // A single search finds the way to every exit, so that the nearest one
+    // is the nearest on foot rather than as the crow flies, and exits the
+    // monster can't get to at all are passed over.
+    vector<coord_def> dests;
+    for (const level_exit &exit : e)
+        if (!exit.unreachable)
+            dests.push_back(exit.target);
+
+    monster_pathfind mp;
+    mp.init_pathfind(mon, dests);
+
     int retval = -1;
     int old_dist = -1;
 
     for (unsigned int i = 0; i < e.size(); ++i)
     {
-        if (e[i].unreachable)
+        if (e[i].unreachable || !mp.reached(e[i].target))
             continue;
 
-        int dist = grid_distance(mon->pos(), e[i].target);
+        int dist = mp.backtrack(e[i].target).size();
 
         if (old_dist == -1 || old_dist >= dist)
         {
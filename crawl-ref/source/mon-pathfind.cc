@@ -2,6 +2,8 @@
 
 #include "mon-pathfind.h"
 
+#include "coordit.h"
+#include "dbg-prof.h"
 #include "directn.h"
 #include "env.h"
 #include "los.h"
@@ -28,6 +30,63 @@
 // then there's no path that matches the requirements fed into monster_pathfind.
 // (These requirements are usually preference of habitat of a specific monster
 // or a limit of the distance between start and any grid on the path.)
+//
+// The search arrays are several hundred kilobytes, far too much to construct
+// and clear for every search. Instead each monster_pathfind borrows a
+// pathfind_state from a per-thread pool, and a generation stamp tells which
+// entries belong to the current search, so starting a search costs nothing.
+
+struct pathfind_state
+{
+    pathfind_state() : generation(0), stamp(), hash_top(-1)
+    {
+    }
+
+    // dist and prev at p are only meaningful if stamp[p] == generation.
+    unsigned int generation;
+    unsigned int stamp[GXM][GYM];
+    // The array of distances from start to any already tried point.
+    int dist[GXM][GYM];
+    // An array to store where we came from on a given shortest path.
+    int prev[GXM][GYM];
+    // The destinations of a multi-target search.
+    FixedBitArray<GXM, GYM> wanted;
+
+    // The open list, bucketed by estimated total path length.
+    // Buckets above hash_top are known to be empty.
+    FixedVector<vector<coord_def>, GXM * GYM> hash;
+    int hash_top;
+
+    void new_search()
+    {
+        for (int i = 0; i <= hash_top; ++i)
+            hash[i].clear();
+        hash_top = -1;
+
+        if (++generation == 0)
+        {
+            memset(stamp, 0, sizeof(stamp));
+            generation = 1;
+        }
+    }
+};
+
+static thread_local vector<unique_ptr<pathfind_state>> pathfind_pool;
+
+static pathfind_state *_acquire_pathfind_state()
+{
+    if (pathfind_pool.empty())
+        return new pathfind_state;
+
+    pathfind_state *state = pathfind_pool.back().release();
+    pathfind_pool.pop_back();
+    return state;
+}
+
+static void _release_pathfind_state(pathfind_state *state)
+{
+    pathfind_pool.emplace_back(state);
+}
 
 int mons_tracking_range(const monster* mon)
 {
@@ -63,12 +122,15 @@ int mons_tracking_range(const monster* mon)
 monster_pathfind::monster_pathfind()
     : mons(nullptr), start(), target(), pos(), allow_diagonals(true),
       traverse_unmapped(false), range(0), min_length(0), max_length(0),
-      dist(), prev(), hash()
+      multi_target(false), targets_left(),
+      state(_acquire_pathfind_state())
 {
+    state->new_search();
 }
 
 monster_pathfind::~monster_pathfind()
 {
+    _release_pathfind_state(state);
 }
 
 void monster_pathfind::set_range(int r)
@@ -79,7 +141,31 @@ void monster_pathfind::set_range(int r)
 
 coord_def monster_pathfind::next_pos(const coord_def &c) const
 {
-    return c + Compass[prev[c.x][c.y]];
+    return c + Compass[state->prev[c.x][c.y]];
+}
+
+int monster_pathfind::dist(const coord_def &p) const
+{
+    if (state->stamp[p.x][p.y] != state->generation)
+        return INFINITE_DISTANCE;
+    return state->dist[p.x][p.y];
+}
+
+void monster_pathfind::set_dist(const coord_def &p, int d)
+{
+    state->stamp[p.x][p.y] = state->generation;
+    state->dist[p.x][p.y] = d;
+}
+
+bool monster_pathfind::is_target(const coord_def &p) const
+{
+    return multi_target ? state->wanted(p) : p == target;
+}
+
+// Has the last search found a path to p?
+bool monster_pathfind::reached(const coord_def &p) const
+{
+    return p == start || in_bounds(p) && dist(p) != INFINITE_DISTANCE;
 }
 
 // The main method in the monster_pathfind class.
@@ -125,8 +211,71 @@ bool monster_pathfind::init_pathfind(coord_def src, coord_def dest, bool diag,
     return start_pathfind(msg);
 }
 
+// Search for paths from the monster to each of dests with a single
+// search, stopping once all of them have been reached. Returns true if
+// they all were; either way, reached() and backtrack(dest) then tell which
+// of them have a path and what it is.
+//
+// As with a single target, a destination the monster can't enter (a foe
+// in a wall, say) can still be reached, but the search doesn't go on
+// through it to the others.
+bool monster_pathfind::init_pathfind(const monster* mon,
+                                     const vector<coord_def> &dests,
+                                     bool diag, bool pass_unmapped)
+{
+    mons   = mon;
+
+    start  = mon->pos();
+    target = start;
+    pos    = start;
+    allow_diagonals   = diag;
+    traverse_unmapped = pass_unmapped;
+    traverse_in_sight = (!crawl_state.game_is_arena()
+                         && mon->friendly() &&  mon->is_summoned()
+                         && you.see_cell_no_trans(mon->pos()));
+
+    return start_multi_pathfind(dests);
+}
+
+bool monster_pathfind::init_pathfind(coord_def src,
+                                     const vector<coord_def> &dests,
+                                     bool diag)
+{
+    start  = src;
+    target = start;
+    pos    = start;
+    allow_diagonals = diag;
+
+    return start_multi_pathfind(dests);
+}
+
+bool monster_pathfind::start_multi_pathfind(const vector<coord_def> &dests)
+{
+    multi_target = true;
+    targets_left.clear();
+    for (const coord_def &dest : dests)
+    {
+        if (!in_bounds(dest) || dest == start || state->wanted(dest))
+            continue;
+        state->wanted.set(dest);
+        targets_left.push_back(dest);
+    }
+
+    const bool success = targets_left.empty() || start_pathfind();
+
+    for (const coord_def &dest : dests)
+        if (in_bounds(dest))
+            state->wanted.set(dest, false);
+    multi_target = false;
+    targets_left.clear();
+
+    return success;
+}
+
 bool monster_pathfind::start_pathfind(bool msg)
 {
+    PROFILE_MONSTER_COUNT(MCOUNT_PATHFIND);
+
     // NOTE: We never do any traversable() check for the target square.
     //       This means that even if the target cannot be reached
     //       we may still find a path leading adjacent to this position, which
@@ -134,12 +283,9 @@ bool monster_pathfind::start_pathfind(bool msg)
     //       surrounded by shallow water or floor, or if a foe is hiding in
     //       a wall.
 
-    max_length = min_length = grid_distance(pos, target);
-    for (int i = 0; i < GXM; i++)
-        for (int j = 0; j < GYM; j++)
-            dist[i][j] = INFINITE_DISTANCE;
-
-    dist[pos.x][pos.y] = 0;
+    max_length = min_length = estimated_cost(pos);
+    state->new_search();
+    set_dist(pos, 0);
 
     bool success = false;
     do
@@ -201,7 +347,8 @@ bool monster_pathfind::calc_path_to_neighbours()
         if (!in_bounds(npos))
             continue;
 
-        if (!traversable(npos) && npos != target)
+        const bool can_enter = traversable(npos);
+        if (!can_enter && !is_target(npos))
             continue;
 
         // Ignore this grid if it takes us above the allowed distance
@@ -209,8 +356,8 @@ bool monster_pathfind::calc_path_to_neighbours()
         if (range && estimated_cost(npos) > range)
             continue;
 
-        distance = dist[pos.x][pos.y] + travel_cost(npos);
-        old_dist = dist[npos.x][npos.y];
+        distance = dist(pos) + travel_cost(npos);
+        old_dist = dist(npos);
 
         // Also bail out if this would make the path longer than twice the
         // allowed distance from the target. (This factor may need tuning.)
@@ -231,7 +378,12 @@ bool monster_pathfind::calc_path_to_neighbours()
         {
             // Calculate new total path length.
             total = distance + estimated_cost(npos);
-            if (old_dist == INFINITE_DISTANCE)
+            if (multi_target && !can_enter)
+            {
+                // Reached, but not searched onwards from: the other
+                // targets mustn't be found through a wall that holds one.
+            }
+            else if (old_dist == INFINITE_DISTANCE)
             {
 #ifdef DEBUG_PATHFIND
                 mprf("Adding (%d,%d) to hash (total dist = %d)",
@@ -252,7 +404,7 @@ bool monster_pathfind::calc_path_to_neighbours()
             }
 
             // Update distance start->pos.
-            dist[npos.x][npos.y] = distance;
+            set_dist(npos, distance);
 
             // Set backtracking information.
             // Converts the Compass direction to its counterpart.
@@ -260,10 +412,20 @@ bool monster_pathfind::calc_path_to_neighbours()
             //      7  .  3   ==>   3  .  7       e.g. (3 + 4) % 8          = 7
             //      6  5  4         2  1  0            (7 + 4) % 8 = 11 % 8 = 3
 
-            prev[npos.x][npos.y] = (dir + 4) % 8;
+            state->prev[npos.x][npos.y] = (dir + 4) % 8;
 
             // Are we finished?
-            if (npos == target)
+            if (multi_target)
+            {
+                if (old_dist == INFINITE_DISTANCE && is_target(npos))
+                {
+                    targets_left.erase(find(targets_left.begin(),
+                                            targets_left.end(), npos));
+                    if (targets_left.empty())
+                        return true;
+                }
+            }
+            else if (npos == target)
             {
 #ifdef DEBUG_PATHFIND
                 mpr("Arrived at target.");
@@ -282,12 +444,12 @@ bool monster_pathfind::get_best_position()
 {
     for (int i = min_length; i <= max_length; i++)
     {
-        if (!hash[i].empty())
+        if (!state->hash[i].empty())
         {
             if (i > min_length)
                 min_length = i;
 
-            vector<coord_def> &vec = hash[i];
+            vector<coord_def> &vec = state->hash[i];
             // Pick the last position pushed into the vector as it's most
             // likely to be close to the target.
             pos = vec[vec.size()-1];
@@ -312,12 +474,21 @@ bool monster_pathfind::get_best_position()
 // Using the prev vector backtrack from start to target to find all steps to
 // take along the shortest path.
 vector<coord_def> monster_pathfind::backtrack()
+{
+    return backtrack(target);
+}
+
+// As above, but for any destination reached by the last search.
+vector<coord_def> monster_pathfind::backtrack(const coord_def &dest)
 {
 #ifdef DEBUG_PATHFIND
     mpr("Backtracking...");
 #endif
     vector<coord_def> path;
-    pos = target;
+    if (!reached(dest))
+        return path;
+
+    pos = dest;
     path.push_back(pos);
 
     if (pos == start)
@@ -326,7 +497,7 @@ vector<coord_def> monster_pathfind::backtrack()
     int dir;
     do
     {
-        dir = prev[pos.x][pos.y];
+        dir = state->prev[pos.x][pos.y];
         pos = pos + Compass[dir];
         ASSERT_IN_BOUNDS(pos);
 #ifdef DEBUG_PATHFIND
@@ -353,8 +524,12 @@ vector<coord_def> monster_pathfind::backtrack()
 // avoid plants and other monsters in the way.
 vector<coord_def> monster_pathfind::calc_waypoints()
 {
-    vector<coord_def> path = backtrack();
+    return waypoints_along(backtrack());
+}
 
+vector<coord_def> monster_pathfind::waypoints_along(
+    const vector<coord_def> &path)
+{
     // If no path found, nothing to be done.
     if (path.empty())
         return path;
@@ -483,24 +658,36 @@ int monster_pathfind::mons_travel_cost(coord_def npos)
     return 1;
 }
 
-// The estimated cost to reach a grid is simply max(dx, dy).
+// The estimated cost to reach a grid is simply max(dx, dy). With several
+// targets it is that to the nearest one not yet reached, which also keeps
+// a range-limited search near the targets. Reaching a target can only
+// raise that, so totals still never drop below the current minimum.
 int monster_pathfind::estimated_cost(coord_def p)
 {
+    if (multi_target)
+    {
+        int best = INFINITE_DISTANCE;
+        for (const coord_def &t : targets_left)
+            best = min(best, grid_distance(p, t));
+        return best;
+    }
     return grid_distance(p, target);
 }
 
 void monster_pathfind::add_new_pos(coord_def npos, int total)
 {
-    hash[total].push_back(npos);
+    state->hash[total].push_back(npos);
+    if (total > state->hash_top)
+        state->hash_top = total;
 }
 
 void monster_pathfind::update_pos(coord_def npos, int total)
 {
     // Find hash position of old distance and delete it,
     // then call_add_new_pos.
-    int old_total = dist[npos.x][npos.y] + estimated_cost(npos);
+    int old_total = dist(npos) + estimated_cost(npos);
 
-    vector<coord_def> &vec = hash[old_total];
+    vector<coord_def> &vec = state->hash[old_total];
     for (unsigned int i = 0; i < vec.size(); i++)
     {
         if (vec[i] == npos)
@@ -512,3 +699,193 @@ void monster_pathfind::update_pos(coord_def npos, int total)
 
     add_new_pos(npos, total);
 }
+
+/////////////////////////////////////////////////////////////////////////////
+// Shared distance fields
+//
+// When a horde is converging on the same foe, every monster running its own
+// A* search repeats nearly the same work. Instead, monsters moving the same
+// way (same habitat, flight, intelligence and door handling) share one
+// distance field per destination, built by a reverse Dijkstra flood from the
+// destination. Each monster then just walks downhill from its position.
+//
+// The field is built with the movement rules of the second monster to ask,
+// which is when it is first needed, so each path read from it is rechecked
+// against the monster actually following it; anything that doesn't hold up
+// falls back to a private search.
+// Fields last for the current player turn, and are dropped early whenever
+// terrain changes.
+
+struct distance_field
+{
+    coord_def dest;
+    int traversal;
+    int requests;
+    unique_ptr<FixedArray<int, GXM, GYM>> dist;
+};
+
+#define MAX_DISTANCE_FIELDS 8
+
+static vector<distance_field> distance_fields;
+static int distance_field_time = -1;
+
+void invalidate_shared_paths()
+{
+    distance_fields.clear();
+}
+
+// Monsters with the same traversal class should agree on which cells can
+// be entered and what they cost, wherever they happen to be standing.
+static int _traversal_class(const monster* mon)
+{
+    COMPILE_CHECK(NUM_HABITATS <= 8);
+    return mons_habitat(*mon, true)
+           | mons_primary_habitat(*mon) << 3
+           | mons_intel(*mon) << 6
+           | mon->airborne() << 8
+           | mons_can_pass_doors(*mon) << 9;
+}
+
+class field_pathfind : public monster_pathfind
+{
+public:
+    field_pathfind(const monster* mon)
+    {
+        mons = mon;
+        traverse_in_sight = false;
+    }
+
+    void fill(distance_field &field);
+    bool follow(const distance_field &field, vector<coord_def> &waypoints);
+};
+
+// Flood outward from the destination. A cell's distance is the cost of the
+// cheapest path from it to the destination, counting the cost of every cell
+// entered, as calc_path_to_neighbours() does going the other way.
+void field_pathfind::fill(distance_field &field)
+{
+    FixedArray<int, GXM, GYM> &dist = *field.dist;
+    dist.init(INFINITE_DISTANCE);
+    dist(field.dest) = 0;
+
+    // Travel costs are small, so bucket the open cells by distance.
+    vector<vector<coord_def>> open(1, vector<coord_def>(1, field.dest));
+    for (unsigned int d = 0; d < open.size(); ++d)
+        for (unsigned int i = 0; i < open[d].size(); ++i)
+        {
+            const coord_def c = open[d][i];
+            if (dist(c) != (int)d)
+                continue;
+
+            pos = c;
+            const int next = d + travel_cost(c);
+            for (adjacent_iterator ai(c); ai; ++ai)
+            {
+                if (!in_bounds(*ai) || next >= dist(*ai))
+                    continue;
+
+                // Record the distance even if we can't path through here,
+                // so that a monster standing in such a spot can get out.
+                dist(*ai) = next;
+                if (!traversable(*ai))
+                    continue;
+
+                if ((int)open.size() <= next)
+                    open.resize(next + 1);
+                open[next].push_back(*ai);
+            }
+        }
+}
+
+// Walk downhill from our monster to the destination, checking every step
+// against the monster's own movement rules and the limits that
+// calc_path_to_neighbours() would have applied.
+bool field_pathfind::follow(const distance_field &field,
+                            vector<coord_def> &waypoints)
+{
+    const FixedArray<int, GXM, GYM> &dist = *field.dist;
+    start = mons->pos();
+    target = field.dest;
+
+    if (dist(start) == INFINITE_DISTANCE || dist(start) > range * 2)
+        return false;
+
+    vector<coord_def> path(1, start);
+    coord_def c = start;
+    while (c != target)
+    {
+        // Check orthogonals first, so that they win ties.
+        coord_def best = c;
+        for (int i = 0; i < 8; ++i)
+        {
+            const coord_def n = c + Compass[(i * 2 + i / 4) % 8];
+            if (in_bounds(n) && dist(n) < dist(best))
+                best = n;
+        }
+
+        if (best == c
+            || best != target && !traversable(best)
+            || estimated_cost(best) > range)
+        {
+            return false;
+        }
+
+        c = best;
+        path.push_back(c);
+    }
+
+    waypoints = waypoints_along(path);
+    return !waypoints.empty();
+}
+
+/**
+ * Try to find a path for a monster using a distance field shared with other
+ * monsters heading to the same place.
+ *
+ * @param mon        The monster looking for a path.
+ * @param dest       Where it wants to go.
+ * @param range      The limit monster_pathfind::set_range() would be given.
+ * @param waypoints  Filled with the waypoints, as calc_waypoints() would.
+ * @return           Whether a path was found. If not, the caller should fall
+ *                   back to a private monster_pathfind search.
+ */
+bool shared_path_waypoints(const monster* mon, const coord_def &dest,
+                           int range, vector<coord_def> &waypoints)
+{
+    if (distance_field_time != you.elapsed_time)
+    {
+        invalidate_shared_paths();
+        distance_field_time = you.elapsed_time;
+    }
+
+    const int traversal = _traversal_class(mon);
+    distance_field *field = nullptr;
+    for (distance_field &df : distance_fields)
+        if (df.dest == dest && df.traversal == traversal)
+            field = &df;
+
+    if (!field)
+    {
+        if (distance_fields.size() >= MAX_DISTANCE_FIELDS)
+            return false;
+        distance_fields.push_back({dest, traversal, 0, nullptr});
+        field = &distance_fields.back();
+    }
+
+    // A lone monster is better served by its own A* search; only build the
+    // field once a second one wants to go the same way.
+    if (++field->requests < 2)
+        return false;
+
+    PROFILE_MONSTER_COUNT(MCOUNT_PATHFIND);
+
+    field_pathfind fp(mon);
+    if (!field->dist)
+    {
+        field->dist.reset(new FixedArray<int, GXM, GYM>);
+        fp.fill(*field);
+    }
+
+    fp.set_range(range);
+    return fp.follow(*field, waypoints);
+}
@@ -1,13 +1,20 @@
 #pragma once
 
 class monster;
+struct pathfind_state;
 
 int mons_tracking_range(const monster* mon);
 
+bool shared_path_waypoints(const monster* mon, const coord_def &dest,
+                           int range, vector<coord_def> &waypoints);
+void invalidate_shared_paths();
+
 class monster_pathfind
 {
 public:
     monster_pathfind();
+    monster_pathfind(const monster_pathfind &other) = delete;
+    monster_pathfind &operator=(const monster_pathfind &other) = delete;
     virtual ~monster_pathfind();
 
     // public methods
@@ -18,12 +25,19 @@ public:
                        bool pass_unmapped = false);
     bool init_pathfind(coord_def src, coord_def dest,
                        bool diag = true, bool msg = false);
+    bool init_pathfind(const monster* mon, const vector<coord_def> &dests,
+                       bool diag = true, bool pass_unmapped = false);
+    bool init_pathfind(coord_def src, const vector<coord_def> &dests,
+                       bool diag = true);
     bool start_pathfind(bool msg = false);
+    bool reached(const coord_def &p) const;
     vector<coord_def> backtrack();
+    vector<coord_def> backtrack(const coord_def &dest);
     vector<coord_def> calc_waypoints();
 
 protected:
     // protected methods
+    bool start_multi_pathfind(const vector<coord_def> &dests);
     bool calc_path_to_neighbours();
     bool traversable(const coord_def& p);
     int  travel_cost(coord_def npos);
@@ -33,6 +47,10 @@ protected:
     void add_new_pos(coord_def pos, int total);
     void update_pos(coord_def pos, int total);
     bool get_best_position();
+    int  dist(const coord_def &p) const;
+    void set_dist(const coord_def &p, int d);
+    bool is_target(const coord_def &p) const;
+    vector<coord_def> waypoints_along(const vector<coord_def> &path);
 
     // The monster trying to find a path.
     const monster* mons;
@@ -59,10 +77,12 @@ protected:
     int min_length;
     int max_length;
 
-    // The array of distances from start to any already tried point.
-    int dist[GXM][GYM];
-    // An array to store where we came from on a given shortest path.
-    int prev[GXM][GYM];
+    // Whether we are searching for several destinations at once, and
+    // those of them that have yet to be reached.
+    bool multi_target;
+    vector<coord_def> targets_left;
 
-    FixedVector<vector<coord_def>, GXM * GYM> hash;
+    // Distances, backtracking information and the open list. Borrowed
+    // from a pool for the lifetime of this object; see mon-pathfind.cc.
+    pathfind_state *state;
 };
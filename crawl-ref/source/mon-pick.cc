@@ -72,11 +72,29 @@ monster_type pick_monster(level_id place, monster_picker &picker, mon_pick_vetoe
     return picker.pick_with_veto(population[place.branch].pop, place.depth, MONS_0, veto);
 }
 
+typedef random_pick_table<monster_type> pop_table;
+
+// The populations are fixed, so each (population, depth) table is built the
+// first time it's wanted and kept.
+static const pop_table &_population_at(const pop_entry *pop, int depth)
+{
+    static map<pair<const pop_entry *, int>, pop_table> tables;
+
+    auto it = tables.find({pop, depth});
+    if (it == tables.end())
+    {
+        it = tables.emplace(make_pair(pop, depth),
+                            monster_picker().level_table(pop, depth)).first;
+    }
+    return it->second;
+}
+
 monster_type pick_monster_from(const pop_entry *fpop, int depth,
                                mon_pick_vetoer veto)
 {
-    // XXX: If creating/destroying instances has performance issues, cache a
-    // static instance
+    if (!veto)
+        return _population_at(fpop, depth).pick(MONS_0);
+
     monster_picker picker = monster_picker();
     return picker.pick_with_veto(fpop, depth, MONS_0, veto);
 }
@@ -86,7 +104,7 @@ monster_type monster_picker::pick_with_veto(const pop_entry *weights,
                                             mon_pick_vetoer vetoer)
 {
     _veto = vetoer;
-    return pick(weights, level, none);
+    return pick(_population_at(weights, level), none);
 }
 
 // Veto specialisation for the monster_picker class; this simply calls the
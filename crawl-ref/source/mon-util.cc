@@ -4155,6 +4155,17 @@ static bool _mons_can_pass_door(const monster* mon, const coord_def& pos)
                || mons_can_destroy_door(*mon, pos));
 }
 
+// Whether the monster can get through doors at all, leaving aside doors
+// that markers close to it.
+bool mons_can_pass_doors(const monster& mon)
+{
+    return mon.can_pass_through_feat(DNGN_FLOOR)
+           && (_mons_can_open_doors(&mon) && !mon.friendly()
+               || mons_eats_items(mon)
+               || mons_class_flag(mons_base_type(mon), M_EAT_DOORS)
+               || mons_class_flag(mons_base_type(mon), M_CRASH_DOORS));
+}
+
 bool mons_can_traverse(const monster& mon, const coord_def& p,
                        bool only_in_sight, bool checktraps)
 {
@@ -6533,9 +6533,10 @@ bool monster::cloud_immune(bool calc_unid, bool items) const
 
 bool monster::is_illusion() const
 {
+    static const static_prop_key clone_slave_key(CLONE_SLAVE_KEY);
     return type == MONS_PLAYER_ILLUSION
            || has_ench(ENCH_PHANTOM_MIRROR)
-           || props.exists(CLONE_SLAVE_KEY);
+           || props.exists(clone_slave_key);
 }
 
 bool monster::is_divine_companion() const
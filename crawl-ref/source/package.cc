@@ -32,10 +32,14 @@ Notes:
 #if defined(UNIX) || defined(TARGET_COMPILER_MINGW)
 #include <unistd.h>
 #endif
+#ifdef USE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "end.h"
 #include "endianness.h"
 #include "errors.h"
+#include "lz-block.h"
 #include "syscalls.h"
 #include "libutil.h" // map_find
 
@@ -59,9 +63,47 @@ static plen_t htole(plen_t x)
 #define dprintf(...) do {} while (0)
 #endif
 
-#define PACKAGE_VERSION 1
+// 1: name, start; 2: name, start, codec
+#define PACKAGE_VERSION 2
 #define PACKAGE_MAGIC   0x53534344 /* "DCSS" */
 
+#define ZB_SIZE 32768
+
+// A CODEC_LZ chunk is a series of frames, each an lz_frame_header and then
+// the packed data. Every frame but the last holds LZ_FRAME bytes; one that
+// wouldn't shrink is stored as is, with both lengths the same.
+#define LZ_FRAME 65536
+
+struct lz_frame_header
+{
+    plen_t len;
+    plen_t packed;
+};
+
+const char *codec_name(chunk_codec codec)
+{
+    switch (codec)
+    {
+    case CODEC_ZLIB:      return "zlib";
+    case CODEC_ZLIB_FAST: return "zlib-fast";
+    case CODEC_STORE:     return "store";
+    case CODEC_LZ:        return "lz";
+    default:              return "buggy";
+    }
+}
+
+// Saves without any non-default codecs are still written in the old format,
+// which older versions can read too.
+static bool _is_zlib(chunk_codec codec)
+{
+    return codec == CODEC_ZLIB || codec == CODEC_ZLIB_FAST;
+}
+
+static uint8_t _directory_version(const map<string, chunk_codec> &codecs)
+{
+    return codecs.empty() ? 1 : PACKAGE_VERSION;
+}
+
 struct file_header
 {
     uint32_t magic;
@@ -86,6 +128,12 @@ package::package(const char* file, bool writeable, bool empty)
 #ifdef DO_FSYNC
     , tmp(false)
 #endif
+#ifdef ASYNC_COMMIT
+    , committing(false), commit_error(nullptr), commit_errno(0)
+#endif
+#ifdef USE_MMAP
+    , map_base(nullptr), map_len(0), map_failed(false)
+#endif
 {
     dprintf("package: initializing file=\"%s\" rw=%d\n", file, writeable);
     ASSERT(writeable || !empty);
@@ -136,6 +184,12 @@ package::package()
 #ifdef DO_FSYNC
     , tmp(true)
 #endif
+#ifdef ASYNC_COMMIT
+    , committing(false), commit_error(nullptr), commit_errno(0)
+#endif
+#ifdef USE_MMAP
+    , map_base(nullptr), map_len(0), map_failed(false)
+#endif
 {
     dprintf("package: initializing tmp file\n");
     filename = "[tmp]";
@@ -217,9 +271,17 @@ package::~package()
     if (rw && !aborted)
     {
         commit();
+        finish_commit();
         if (ftruncate(fd, file_len))
             sysfail("failed to update save file");
     }
+    // an aborted save may still have a commit in flight
+    finish_commit();
+
+#ifdef USE_MMAP
+    // Only now: committing may view() the file, which maps it again.
+    unmap();
+#endif
 
     // all errors here should be cached write errors
     if (fd != -1)
@@ -234,6 +296,8 @@ package::~package()
 void package::commit()
 {
     ASSERT(rw);
+    // Only one commit may be in flight at a time.
+    finish_commit();
     if (!dirty)
         return;
     ASSERT(!aborted);
@@ -242,11 +306,38 @@ void package::commit()
     fsck();
 #endif
 
+    const plen_t start = write_directory();
+    const uint8_t version = _directory_version(codecs);
+
+#ifdef ASYNC_COMMIT
+    if (!tmp)
+    {
+        // The header on disk still points at the old directory, so blocks
+        // unlinked up to now may only be reused once the new one is durable.
+        commit_unlinked.swap(unlinked_blocks);
+        commit_start = start;
+        commit_version = version;
+        commit_error = nullptr;
+        new_chunks.clear();
+        dirty = false;
+
+        if (thread_create_joinable(&commit_thread, commit_job, this))
+        {
+            dprintf("package: can't start a commit thread, committing here\n");
+            commit_job(this);
+            finish_commit();
+        }
+        else
+            committing = true;
+        return;
+    }
+#endif
+
     file_header head;
     head.magic = htole(PACKAGE_MAGIC);
-    head.version = PACKAGE_VERSION;
+    head.version = version;
     memset(&head.padding, 0, sizeof(head.padding));
-    head.start = htole(write_directory());
+    head.start = htole(start);
 #ifdef DO_FSYNC
     // We need a barrier before updating the link to point at the new directory.
     if (!tmp && fdatasync(fd))
@@ -269,6 +360,116 @@ void package::commit()
 #endif
 }
 
+#ifdef ASYNC_COMMIT
+// Runs on the commit thread, which touches nothing but fd and the commit_
+// fields until it is joined by finish_commit().
+void *package::commit_job(void *arg)
+{
+    package *pkg = static_cast<package*>(arg);
+
+    file_header head;
+    head.magic = htole(PACKAGE_MAGIC);
+    head.version = pkg->commit_version;
+    memset(&head.padding, 0, sizeof(head.padding));
+    head.start = htole(pkg->commit_start);
+
+    // We need a barrier before updating the link to point at the new
+    // directory. The game thread may be seeking around meanwhile, hence
+    // pwrite().
+    if (fdatasync(pkg->fd))
+        pkg->commit_error = "flush error while saving";
+    else if (pwrite(pkg->fd, &head, sizeof(head), 0) != sizeof(head))
+        pkg->commit_error = "write error while saving";
+    else if (fdatasync(pkg->fd))
+        pkg->commit_error = "flush error while saving";
+    if (pkg->commit_error)
+        pkg->commit_errno = errno;
+    return nullptr;
+}
+#endif
+
+// Wait until the last commit() has reached the disk.
+void package::finish_commit()
+{
+#ifdef ASYNC_COMMIT
+    if (committing)
+    {
+        thread_join(commit_thread);
+        committing = false;
+    }
+    if (aborted)
+        return;
+    if (const char *error = commit_error)
+    {
+        commit_error = nullptr;
+        errno = commit_errno;
+        sysfail("%s", error);
+    }
+
+    // The old directory is gone from the disk, and with it the last
+    // references to these blocks.
+    vector<plen_t> done;
+    done.swap(commit_unlinked);
+    for (plen_t at : done)
+        free_block_chain(at);
+#endif
+}
+
+#ifdef USE_MMAP
+// Map the whole file as it is now, so that `need` bytes are viewable.
+bool package::remap(plen_t need)
+{
+    if (map_failed || fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st))
+        return false;
+    // Blocks still being written may not have reached the file yet; touching
+    // a mapping past the end of the file would SIGBUS.
+    if ((off_t)need > st.st_size)
+        return false;
+
+    unmap();
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        dprintf("package: mmap failed, reading through read()\n");
+        map_failed = true;
+        return false;
+    }
+    map_base = (const char*)base;
+    map_len = st.st_size;
+    return true;
+}
+
+void package::unmap()
+{
+    if (map_base)
+        munmap((void*)map_base, map_len);
+    map_base = nullptr;
+    map_len = 0;
+}
+#endif
+
+// Return a pointer to `len` bytes of the file at `at`, or nullptr if they
+// can't be mapped -- callers then fall back to seek() and read(). The pointer
+// is only good until the next call, as the file may be remapped when it grows.
+const char *package::view(plen_t at, plen_t len)
+{
+#ifdef USE_MMAP
+    ASSERT(!aborted);
+    if (at + len < at || at + len > file_len)
+        return nullptr;
+    if (at + len > map_len && !remap(at + len))
+        return nullptr;
+    return map_base + at;
+#else
+    UNUSED(at, len);
+    return nullptr;
+#endif
+}
+
 void package::seek(plen_t to)
 {
     ASSERT(!aborted);
@@ -287,7 +488,7 @@ chunk_writer* package::writer(const string &name)
 chunk_reader* package::reader(const string &name)
 {
     if (plen_t *ch = map_find(directory, name))
-        return new chunk_reader(this, *ch);
+        return new chunk_reader(this, *ch, get_chunk_codec(name));
     return 0;
 }
 
@@ -359,10 +560,16 @@ plen_t package::alloc_block(plen_t &size)
     return at;
 }
 
-void package::finish_chunk(const string &name, plen_t at)
+void package::finish_chunk(const string &name, plen_t at, chunk_codec codec)
 {
     free_chunk(name);
     directory[name] = at;
+    // Fast zlib chunks inflate like any other, so they're recorded as plain
+    // zlib; only real format differences need a directory in the new format.
+    if (_is_zlib(codec))
+        codecs.erase(name);
+    else
+        codecs[name] = codec;
     new_chunks.insert(at);
     dirty = true;
 }
@@ -386,12 +593,14 @@ void package::delete_chunk(const string &name)
 {
     free_chunk(name);
     directory.erase(name);
+    codecs.erase(name);
 }
 
 plen_t package::write_directory()
 {
     delete_chunk("");
 
+    const bool with_codecs = _directory_version(codecs) >= 2;
     stringstream dir;
     for (const auto &entry : directory)
     {
@@ -400,12 +609,18 @@ plen_t package::write_directory()
         dir.write(&entry.first[0], entry.first.length());
         plen_t start = htole(entry.second);
         dir.write((const char*)&start, sizeof(plen_t));
+        if (with_codecs)
+        {
+            uint8_t codec = get_chunk_codec(entry.first);
+            dir.write((const char*)&codec, sizeof(codec));
+        }
     }
 
     ASSERT(dir.str().size());
     dprintf("writing directory (%u bytes)\n", (unsigned int)dir.str().size());
     {
-        chunk_writer dch(this, "");
+        // The directory is read before we know any codecs.
+        chunk_writer dch(this, "", CODEC_ZLIB);
         dch.write(&dir.str()[0], dir.str().size());
     }
 
@@ -540,6 +755,7 @@ void package::read_directory(plen_t start, uint8_t version)
         }
         break;
     case 1:
+    case 2:
         uint8_t name_len;
         plen_t bstart;
         while (plen_t res = rd.read(&name_len, sizeof(name_len)))
@@ -553,6 +769,19 @@ void package::read_directory(plen_t start, uint8_t version)
             if (rd.read(&bstart, sizeof(bstart)) != sizeof(bstart))
                 corrupted("save file corrupted -- truncated directory");
             directory[chname] = htole(bstart);
+            if (version >= 2)
+            {
+                uint8_t codec;
+                if (rd.read(&codec, sizeof(codec)) != sizeof(codec))
+                    corrupted("save file corrupted -- truncated directory");
+                if (codec >= NUM_CODECS)
+                {
+                    corrupted("save file (%s) uses an unknown codec %u",
+                              filename.c_str(), codec);
+                }
+                if (codec != CODEC_ZLIB)
+                    codecs[chname] = (chunk_codec)codec;
+            }
             dprintf("* %s\n", chname.c_str());
         }
         break;
@@ -567,6 +796,13 @@ bool package::has_chunk(const string &name)
     return !name.empty() && directory.count(name);
 }
 
+chunk_codec package::get_chunk_codec(const string &name) const
+{
+    if (const chunk_codec *codec = map_find(codecs, name))
+        return *codec;
+    return CODEC_ZLIB;
+}
+
 vector<string> package::list_chunks()
 {
     vector<string> list;
@@ -625,6 +861,10 @@ void package::abort()
 void package::unlink()
 {
     abort();
+    finish_commit();
+#ifdef USE_MMAP
+    unmap();
+#endif
     close(fd);
     fd = -1;
     ::unlink_u(filename.c_str());
@@ -673,8 +913,9 @@ plen_t package::get_chunk_compressed_length(const string &name)
     return len;
 }
 
-chunk_writer::chunk_writer(package *parent, const string &_name)
-    : first_block(0), cur_block(0), block_len(0)
+chunk_writer::chunk_writer(package *parent, const string &_name,
+                           chunk_codec _codec)
+    : codec(_codec), first_block(0), cur_block(0), block_len(0)
 {
     ASSERT(parent);
     ASSERT(!parent->aborted);
@@ -688,16 +929,32 @@ chunk_writer::chunk_writer(package *parent, const string &_name)
     pkg->n_users++;
     name = _name;
 
+    lz_buffer = nullptr;
+    lz_len = 0;
+#ifdef USE_ZLIB
+    z_buffer = nullptr;
+#endif
+    if (codec == CODEC_STORE)
+        return;
+    if (codec == CODEC_LZ)
+    {
+        lz_buffer = (char*)malloc(LZ_FRAME + lz_compress_bound(LZ_FRAME));
+        return;
+    }
+
 #ifdef USE_ZLIB
     zs.data_type = Z_BINARY;
     zs.zalloc    = 0;
     zs.zfree     = 0;
     zs.opaque    = Z_NULL;
-    if (deflateInit(&zs, Z_DEFAULT_COMPRESSION))
+    const int level = codec == CODEC_ZLIB_FAST ? Z_BEST_SPEED
+                                               : Z_DEFAULT_COMPRESSION;
+    if (deflateInit(&zs, level))
         fail("save file compression failed during init: %s", zs.msg);
-#define ZB_SIZE 32768
     zs.next_out  = z_buffer = (Bytef*)malloc(ZB_SIZE);
     zs.avail_out = ZB_SIZE;
+#else
+    fail("save file compression (%s) not supported", codec_name(codec));
 #endif
 }
 
@@ -711,31 +968,41 @@ chunk_writer::~chunk_writer()
     {
 #ifdef USE_ZLIB
         // ignore errors, they're not relevant anymore
-        deflateEnd(&zs);
+        if (z_buffer)
+            deflateEnd(&zs);
         free(z_buffer);
 #endif
+        free(lz_buffer);
         return;
     }
 
+    if (codec == CODEC_LZ)
+    {
+        write_lz_frame();
+        free(lz_buffer);
+    }
 #ifdef USE_ZLIB
-    zs.avail_in = 0;
-    int res;
-    do
+    if (_is_zlib(codec))
     {
-        res = deflate(&zs, Z_FINISH);
-        if (res != Z_STREAM_END && res != Z_OK && res != Z_BUF_ERROR)
-            fail("save file compression failed: %s", zs.msg);
-        raw_write(z_buffer, zs.next_out - z_buffer);
-        zs.next_out = z_buffer;
-        zs.avail_out = ZB_SIZE;
-    } while (res != Z_STREAM_END);
-    if (deflateEnd(&zs) != Z_OK)
-        fail("save file compression failed during clean-up: %s", zs.msg);
-    free(z_buffer);
+        zs.avail_in = 0;
+        int res;
+        do
+        {
+            res = deflate(&zs, Z_FINISH);
+            if (res != Z_STREAM_END && res != Z_OK && res != Z_BUF_ERROR)
+                fail("save file compression failed: %s", zs.msg);
+            raw_write(z_buffer, zs.next_out - z_buffer);
+            zs.next_out = z_buffer;
+            zs.avail_out = ZB_SIZE;
+        } while (res != Z_STREAM_END);
+        if (deflateEnd(&zs) != Z_OK)
+            fail("save file compression failed during clean-up: %s", zs.msg);
+        free(z_buffer);
+    }
 #endif
     if (cur_block)
         finish_block(0);
-    pkg->finish_chunk(name, first_block);
+    pkg->finish_chunk(name, first_block, codec);
 }
 
 void chunk_writer::raw_write(const void *data, plen_t len)
@@ -777,12 +1044,54 @@ void chunk_writer::finish_block(plen_t next)
     pkg->block_map[cur_block] = bm_p(block_len, next);
 }
 
+void chunk_writer::write_lz_frame()
+{
+    if (!lz_len)
+        return;
+
+    const char *packed = lz_buffer + LZ_FRAME;
+    plen_t packed_len = lz_compress(lz_buffer, lz_len, lz_buffer + LZ_FRAME);
+    if (packed_len >= lz_len)
+    {
+        packed = lz_buffer;
+        packed_len = lz_len;
+    }
+
+    lz_frame_header head;
+    head.len = htole(lz_len);
+    head.packed = htole(packed_len);
+    raw_write(&head, sizeof(head));
+    raw_write(packed, packed_len);
+    lz_len = 0;
+}
+
 void chunk_writer::write(const void *data, plen_t len)
 {
     ASSERT(data);
     ASSERT(!pkg->aborted);
 
+    if (codec == CODEC_LZ)
+    {
+        while (len)
+        {
+            const plen_t s = min<plen_t>(len, LZ_FRAME - lz_len);
+            memcpy(lz_buffer + lz_len, data, s);
+            data = (const char*)data + s;
+            len -= s;
+            lz_len += s;
+            if (lz_len == LZ_FRAME)
+                write_lz_frame();
+        }
+        return;
+    }
+
 #ifdef USE_ZLIB
+    if (codec == CODEC_STORE)
+    {
+        raw_write(data, len);
+        return;
+    }
+
     zs.next_in  = (Bytef*)data;
     zs.avail_in = len;
     while (zs.avail_in)
@@ -810,7 +1119,23 @@ void chunk_reader::init(plen_t start)
     first_block = next_block = start;
     block_left = 0;
 
+    lz_buffer = nullptr;
+    lz_pos = lz_len = 0;
+#ifdef USE_ZLIB
+    // only needed if the package can't be mapped
+    z_buffer = nullptr;
+#endif
+    if (codec == CODEC_STORE)
+        return;
+    // Packed frames are never larger than unpacked ones.
+    if (codec == CODEC_LZ)
+    {
+        lz_buffer = (char*)malloc(LZ_FRAME * 2);
+        return;
+    }
+
 #ifdef USE_ZLIB
+
     if (!start)
         corrupted("save file corrupted -- zlib header missing");
 
@@ -822,14 +1147,17 @@ void chunk_reader::init(plen_t start)
     if (inflateInit(&zs))
         fail("save file decompression failed during init: %s", zs.msg);
     eof = false;
+#else
+    corrupted("save file compression (%s) not supported", codec_name(codec));
 #endif
 }
 
-chunk_reader::chunk_reader(package *parent, plen_t start)
+chunk_reader::chunk_reader(package *parent, plen_t start, chunk_codec _codec)
 {
     ASSERT(parent);
     dprintf("chunk_reader[%u]: starting\n", start);
     pkg = parent;
+    codec = _codec;
     init(start);
 }
 
@@ -840,6 +1168,7 @@ chunk_reader::chunk_reader(package *parent, const string &_name)
         corrupted("save file corrupted -- chunk \"%s\" missing", _name.c_str());
     dprintf("chunk_reader(%s): starting\n", _name.c_str());
     pkg = parent;
+    codec = parent->get_chunk_codec(_name);
     init(parent->directory[_name]);
 }
 
@@ -848,9 +1177,11 @@ chunk_reader::~chunk_reader()
     dprintf("chunk_reader: closing\n");
 
 #ifdef USE_ZLIB
-    if (inflateEnd(&zs) != Z_OK)
+    if (_is_zlib(codec) && inflateEnd(&zs) != Z_OK)
         fail("save file decompression failed during clean-up: %s", zs.msg);
+    free(z_buffer);
 #endif
+    free(lz_buffer);
     ASSERT(pkg->reader_count[first_block] > 0);
     if (!--pkg->reader_count[first_block])
         pkg->reader_count.erase(first_block);
@@ -858,42 +1189,72 @@ chunk_reader::~chunk_reader()
     pkg->n_users--;
 }
 
+// Move on to the next block of the chunk; false if there are no more.
+bool chunk_reader::read_header()
+{
+    if (!next_block)
+        return false;
+
+    block_header bl;
+    if (const char *mapped = pkg->view(next_block, sizeof(block_header)))
+        memcpy(&bl, mapped, sizeof(block_header));
+    else
+    {
+        pkg->seek(next_block);
+        ssize_t res = ::read(pkg->fd, &bl, sizeof(block_header));
+        if (res < 0)
+            sysfail("error reading the save file");
+        if (res != sizeof(block_header))
+            corrupted("save file corrupted -- block past eof");
+    }
+
+    off = next_block + sizeof(block_header);
+    block_left = htole(bl.len);
+    next_block = htole(bl.next);
+    // This reeks of on-disk corruption (zeroed data).
+    if (!block_left)
+        corrupted("save file corrupted -- empty block");
+    return true;
+}
+
+// Point `span` at the unread rest of the current block, inside the package's
+// mapping; at the end of the chunk it is left empty. Returns false if the
+// block can't be mapped, in which case nothing has been consumed.
+bool chunk_reader::mapped_span(const char *&span, plen_t &len)
+{
+    span = nullptr;
+    len = 0;
+    if (!block_left && !read_header())
+        return true;
+    if (!(span = pkg->view(off, block_left)))
+        return false;
+    len = block_left;
+    return true;
+}
+
 plen_t chunk_reader::raw_read(void *data, plen_t len)
 {
     void *buf = data;
     while (len)
     {
-        if (!block_left)
-        {
-            if (!next_block)
-                return (char*)buf - (char*)data;
+        if (!block_left && !read_header())
+            return (char*)buf - (char*)data;
+
+        plen_t s = len;
+        if (s > block_left)
+            s = block_left;
 
-            block_header bl;
-            pkg->seek(next_block);
-            ssize_t res = ::read(pkg->fd, &bl, sizeof(block_header));
+        if (const char *mapped = pkg->view(off, s))
+            memcpy(buf, mapped, s);
+        else
+        {
+            pkg->seek(off);
+            ssize_t res = ::read(pkg->fd, buf, s);
             if (res < 0)
                 sysfail("error reading the save file");
-            if (res != sizeof(block_header))
+            if ((plen_t)res != s)
                 corrupted("save file corrupted -- block past eof");
-
-            off = next_block + sizeof(block_header);
-            block_left = htole(bl.len);
-            next_block = htole(bl.next);
-            // This reeks of on-disk corruption (zeroed data).
-            if (!block_left)
-                corrupted("save file corrupted -- empty block");
         }
-        else
-            pkg->seek(off);
-
-        plen_t s = len;
-        if (s > block_left)
-            s = block_left;
-        ssize_t res = ::read(pkg->fd, buf, s);
-        if (res < 0)
-            sysfail("error reading the save file");
-        if ((plen_t)res != s)
-            corrupted("save file corrupted -- block past eof");
 
         buf = (char*)buf + s;
         off += s;
@@ -904,13 +1265,59 @@ plen_t chunk_reader::raw_read(void *data, plen_t len)
     return (char*)buf - (char*)data;
 }
 
+// Unpack the next frame of a CODEC_LZ chunk; false at the end of the chunk.
+bool chunk_reader::read_lz_frame()
+{
+    lz_frame_header head;
+    const plen_t got = raw_read(&head, sizeof(head));
+    if (!got)
+        return false;
+    if (got != sizeof(head))
+        corrupted("save file corrupted -- frame header truncated");
+
+    const plen_t len = htole(head.len);
+    const plen_t packed = htole(head.packed);
+    if (!len || len > LZ_FRAME || packed > len)
+        corrupted("save file corrupted -- bad frame header");
+
+    char *in = packed == len ? lz_buffer : lz_buffer + LZ_FRAME;
+    if (raw_read(in, packed) != packed)
+        corrupted("save file corrupted -- block truncated");
+    if (packed != len
+        && lz_decompress(in, packed, lz_buffer, len) != (int)len)
+    {
+        corrupted("save file decompression failed: bad frame");
+    }
+
+    lz_pos = 0;
+    lz_len = len;
+    return true;
+}
+
 plen_t chunk_reader::read(void *data, plen_t len)
 {
     ASSERT(data);
     if (pkg->aborted)
         return 0;
 
+    if (codec == CODEC_LZ)
+    {
+        plen_t done = 0;
+        while (done < len)
+        {
+            if (lz_pos == lz_len && !read_lz_frame())
+                break;
+            const plen_t s = min(len - done, lz_len - lz_pos);
+            memcpy((char*)data + done, lz_buffer + lz_pos, s);
+            lz_pos += s;
+            done += s;
+        }
+        return done;
+    }
+
 #ifdef USE_ZLIB
+    if (codec == CODEC_STORE)
+        return raw_read(data, len);
     if (!len)
         return 0;
     if (eof)
@@ -920,14 +1327,36 @@ plen_t chunk_reader::read(void *data, plen_t len)
     zs.avail_out = len;
     while (zs.avail_out)
     {
+        // Inflate directly out of the mapped file where we can. The mapping
+        // may move between calls, so such input is never left in zs.
+        const char *span = nullptr;
         if (!zs.avail_in)
         {
-            zs.next_in  = z_buffer;
-            zs.avail_in = raw_read(z_buffer, sizeof(z_buffer));
+            plen_t span_len;
+            if (mapped_span(span, span_len))
+            {
+                zs.next_in  = (Bytef*)span;
+                zs.avail_in = span_len;
+            }
+            else
+            {
+                if (!z_buffer)
+                    z_buffer = (Bytef*)malloc(ZB_SIZE);
+                zs.next_in  = z_buffer;
+                zs.avail_in = raw_read(z_buffer, ZB_SIZE);
+            }
             if (!zs.avail_in)
                 corrupted("save file corrupted -- block truncated");
         }
         int res = inflate(&zs, Z_NO_FLUSH);
+        if (span)
+        {
+            const plen_t used = (const char*)zs.next_in - span;
+            off += used;
+            block_left -= used;
+            zs.next_in  = Z_NULL;
+            zs.avail_in = 0;
+        }
         if (res == Z_STREAM_END)
         {
             eof = true;
@@ -944,14 +1373,15 @@ plen_t chunk_reader::read(void *data, plen_t len)
 
 void chunk_reader::read_all(vector<char> &data)
 {
-#define SPACE 1024
-    plen_t s, at;
+    // Grow geometrically and read straight into the vector, rather than
+    // through a fixed-size bounce buffer.
+    plen_t s, want;
     do
     {
-        at = data.size();
-        data.resize(at + SPACE);
-        s = read(&data[at], SPACE);
-    } while (s == SPACE);
-    data.resize(at + s);
-#undef SPACE
+        const size_t at = data.size();
+        want = max<size_t>(at, 16384);
+        data.resize(at + want);
+        s = read(&data[at], want);
+        data.resize(at + s);
+    } while (s == want);
 }
@@ -13,10 +13,45 @@
 #define DO_FSYNC
 #endif
 
+// Do the syncs and header write of commit() on a background thread.
+#if defined(DO_FSYNC) && defined(UNIX)
+#define ASYNC_COMMIT
+#include "threads.h"
+#endif
+
+// Read chunks straight out of a read-only mapping of the save rather than
+// through lseek()+read() per block.
+#ifdef UNIX
+#define USE_MMAP
+#endif
+
 #define MAX_CHUNK_NAME_LENGTH 255
 
 typedef uint32_t plen_t;
 
+// How a chunk's data is stored. The directory records each chunk's codec, so
+// changing the codec for new chunks leaves existing saves readable.
+enum chunk_codec
+{
+    CODEC_ZLIB,         // deflate, zlib's default level
+    CODEC_ZLIB_FAST,    // deflate, Z_BEST_SPEED; inflated like CODEC_ZLIB
+    CODEC_STORE,        // uncompressed
+    CODEC_LZ,           // lz-block.h frames; fast, but larger than deflate
+    NUM_CODECS
+};
+
+// The codec new chunks are written with; servers that would rather trade
+// save size for speed can build with -DSAVE_CODEC=CODEC_LZ.
+#ifndef SAVE_CODEC
+# ifdef USE_ZLIB
+#  define SAVE_CODEC CODEC_ZLIB
+# else
+#  define SAVE_CODEC CODEC_STORE
+# endif
+#endif
+
+const char *codec_name(chunk_codec codec);
+
 class package;
 
 class chunk_writer
@@ -24,6 +59,7 @@ class chunk_writer
 private:
     package *pkg;
     string name;
+    chunk_codec codec;
     plen_t first_block;
     plen_t cur_block;
     plen_t block_len;
@@ -31,10 +67,15 @@ private:
     z_stream zs;
     Bytef *z_buffer;
 #endif
+    // CODEC_LZ: the frame being filled, then room to pack it.
+    char *lz_buffer;
+    plen_t lz_len;
     void raw_write(const void *data, plen_t len);
     void finish_block(plen_t next);
+    void write_lz_frame();
 public:
-    chunk_writer(package *parent, const string &_name);
+    chunk_writer(package *parent, const string &_name,
+                 chunk_codec _codec = SAVE_CODEC);
     ~chunk_writer();
     void write(const void *data, plen_t len);
     friend class package;
@@ -43,16 +84,24 @@ public:
 class chunk_reader
 {
 private:
-    chunk_reader(package *parent, plen_t start);
+    chunk_reader(package *parent, plen_t start,
+                 chunk_codec _codec = CODEC_ZLIB);
     void init(plen_t start);
     package *pkg;
+    chunk_codec codec;
     plen_t first_block, next_block;
     plen_t off, block_left;
 #ifdef USE_ZLIB
     bool eof;
     z_stream zs;
-    Bytef z_buffer[32768];
+    Bytef *z_buffer;
 #endif
+    // CODEC_LZ: the unpacked frame being read, then room for it packed.
+    char *lz_buffer;
+    plen_t lz_pos, lz_len;
+    bool read_header();
+    bool read_lz_frame();
+    bool mapped_span(const char *&span, plen_t &len);
     plen_t raw_read(void *data, plen_t len);
 public:
     chunk_reader(package *parent, const string &_name);
@@ -71,8 +120,10 @@ public:
     chunk_writer* writer(const string &name);
     chunk_reader* reader(const string &name);
     void commit();
+    void finish_commit();
     void delete_chunk(const string &name);
     bool has_chunk(const string &name);
+    chunk_codec get_chunk_codec(const string &name) const;
     vector<string> list_chunks();
     void abort();
     void unlink();
@@ -92,16 +143,37 @@ private:
     bool aborted;
 #ifdef DO_FSYNC
     bool tmp;
+#endif
+#ifdef ASYNC_COMMIT
+    bool committing;
+    thread_t commit_thread;
+    plen_t commit_start;
+    uint8_t commit_version;
+    const char *commit_error;
+    int commit_errno;
+    vector<plen_t> commit_unlinked;
+    static void *commit_job(void *arg);
 #endif
     map<string, plen_t> directory;
+    // How to read each chunk; entries absent for CODEC_ZLIB (and so for
+    // CODEC_ZLIB_FAST, which is read the same way).
+    map<string, chunk_codec> codecs;
     map<plen_t, plen_t> free_blocks;
     vector<plen_t> unlinked_blocks;
     map<plen_t, pair<plen_t, plen_t> > block_map;
     set<plen_t> new_chunks;
     map<plen_t, uint32_t> reader_count;
+#ifdef USE_MMAP
+    const char *map_base;
+    plen_t map_len;
+    bool map_failed;
+    bool remap(plen_t need);
+    void unmap();
+#endif
+    const char *view(plen_t at, plen_t len);
     plen_t extend_block(plen_t at, plen_t size, plen_t by);
     plen_t alloc_block(plen_t &size);
-    void finish_chunk(const string &name, plen_t at);
+    void finish_chunk(const string &name, plen_t at, chunk_codec codec);
     void free_chunk(const string &name);
     plen_t write_directory();
     void collect_blocks();
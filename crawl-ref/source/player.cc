@@ -1178,7 +1178,8 @@ int player_mp_regen()
     if (you.get_mutation_level(MUT_MANA_REGENERATION))
         regen_amount *= 2;
 
-    if (you.props[MANA_REGEN_AMULET_ACTIVE].get_int() == 1)
+    static const static_prop_key mana_regen_key(MANA_REGEN_AMULET_ACTIVE);
+    if (you.props[mana_regen_key].get_int() == 1)
         regen_amount += 25;
 
     return regen_amount;
@@ -5220,8 +5221,9 @@ bool player::airborne() const
     if (get_form()->forbids_flight())
         return false;
 
+    static const static_prop_key emergency_flight_key(EMERGENCY_FLIGHT_KEY);
     if (duration[DUR_FLIGHT]
-        || you.props[EMERGENCY_FLIGHT_KEY].get_bool()
+        || you.props[emergency_flight_key].get_bool()
         || attribute[ATTR_PERM_FLIGHT]
         || get_form()->enables_flight())
     {
@@ -5267,8 +5269,9 @@ bool player::can_swim(bool permanently) const
 /// Can the player do a passing imitation of a notorious Palestinian?
 bool player::can_water_walk() const
 {
+    static const static_prop_key temp_waterwalk_key(TEMP_WATERWALK_KEY);
     return have_passive(passive_t::water_walk)
-           || you.props.exists(TEMP_WATERWALK_KEY);
+           || you.props.exists(temp_waterwalk_key);
 }
 
 int player::visible_igrd(const coord_def &where) const
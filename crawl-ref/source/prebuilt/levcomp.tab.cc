@@ -85,6 +85,9 @@ extern int yylineno;
 
 static NORETURN void yyerror(const char *e)
 {
+    // A des compiler worker leaves the reporting to the parent.
+    if (lc_des_worker)
+        abort_des_worker();
     if (strstr(e, lc_desfile.c_str()) == e)
         fprintf(stderr, "%s\n", e);
     else
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "bitary.h"
 #include "random.h"
 
 enum distrib_type
@@ -27,12 +28,104 @@ struct random_pick_entry
     T value;
 };
 
+// The entries of a weight list that can appear at one level, with their
+// rarities there, and a Walker alias table over them: one column per entry,
+// each holding total rarity's worth of weight, split between the entry and
+// one other. Picking a column and then a side of it takes two rolls
+// whatever the length of the list.
+template <typename T>
+class random_pick_table
+{
+public:
+    struct entry
+    {
+        T value;
+        int rarity;
+    };
+
+    random_pick_table() : total(0) { }
+
+    void add(T value, int rarity);
+    void build();
+
+    bool empty() const { return entries.empty(); }
+    const vector<entry> &get_entries() const { return entries; }
+    int total_rarity() const { return total; }
+
+    T pick(T none) const;
+
+private:
+    vector<entry> entries;     // in weight list order
+    int total;
+    vector<int> keep;          // how much of each column is its own entry
+    vector<int> alias;         // the entry that has the rest of the column
+};
+
+template <typename T>
+void random_pick_table<T>::add(T value, int rarity)
+{
+    entries.push_back({value, rarity});
+    total += rarity;
+}
+
+// Vose's construction, in integers so the table's distribution is exactly
+// the rarities': entries are scaled by the number of columns, so each
+// column holds the total.
+template <typename T>
+void random_pick_table<T>::build()
+{
+    const int n = entries.size();
+    keep.assign(n, total);
+    alias.resize(n);
+
+    vector<int64_t> scaled(n);
+    vector<int> small, large;
+    for (int i = 0; i < n; i++)
+    {
+        alias[i] = i;
+        scaled[i] = (int64_t)entries[i].rarity * n;
+        (scaled[i] < total ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        const int s = small.back();
+        const int l = large.back();
+        small.pop_back();
+
+        keep[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= total - scaled[s];
+        if (scaled[l] < total)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // The scaled weights sum to n * total, so whatever is left fills its
+    // own column exactly and keeps the default of all of it.
+}
+
+template <typename T>
+T random_pick_table<T>::pick(T none) const
+{
+    if (entries.empty())
+        return none;
+
+    const int col = random2(entries.size());
+    return random2(total) < keep[col] ? entries[col].value
+                                      : entries[alias[col]].value;
+}
+
 template <typename T, int max>
 class random_picker
 {
 public:
     virtual ~random_picker();
     T pick(const random_pick_entry<T> *weights, int level, T none);
+    T pick(const random_pick_table<T> &table, T none);
+    random_pick_table<T> level_table(const random_pick_entry<T> *weights,
+                                     int level);
     int probability_at(T entry, const random_pick_entry<T> *weights, int level);
     int rarity_at(const random_pick_entry<T> *pop,
                   int depth);
@@ -81,6 +174,56 @@ T random_picker<T, max>::pick(const random_pick_entry<T> *weights, int level,
     die("random_pick roll out of range");
 }
 
+// Pick from a prepared table, honouring veto(). This rolls just as
+// pick(weights, level, none) does, so the two agree given the same RNG state;
+// the table only saves redoing the level check and rarities.
+template <typename T, int max>
+T random_picker<T, max>::pick(const random_pick_table<T> &table, T none)
+{
+    const auto &entries = table.get_entries();
+    ASSERT(entries.size() <= (size_t)max);
+
+    FixedBitVector<max> vetoed;
+    int totalrar = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (veto(entries[i].value))
+            vetoed.set(i);
+        else
+            totalrar += entries[i].rarity;
+    }
+
+    if (!totalrar)
+        return none;
+
+    totalrar = random2(totalrar); // the roll!
+
+    for (size_t i = 0; i < entries.size(); i++)
+        if (!vetoed[i] && (totalrar -= entries[i].rarity) < 0)
+            return entries[i].value;
+
+    die("random_pick roll out of range");
+}
+
+// The entries of weights possible at level, ignoring veto().
+template <typename T, int max>
+random_pick_table<T> random_picker<T, max>::level_table(
+                            const random_pick_entry<T> *weights, int level)
+{
+    random_pick_table<T> table;
+    for (const random_pick_entry<T> *pop = weights; pop->rarity; pop++)
+    {
+        if (level < pop->minr || level > pop->maxr)
+            continue;
+
+        int rar = rarity_at(pop, level);
+        ASSERTM(rar > 0, "Rarity %d: %d at level %d", rar, pop->value, level);
+        table.add(pop->value, rar);
+    }
+    table.build();
+    return table;
+}
+
 template <typename T, int max>
 int random_picker<T, max>::probability_at(T entry,
                     const random_pick_entry<T> *weights, int level)
@@ -66,6 +66,8 @@ struct game_state
     bool map_stat_dump_disconnect; // Set if we dump disconnected maps and exit
                                    // under mapstat.
     bool obj_stat_gen;      // Set if we're generating object stats.
+    bool levelgen_bench;    // Set if we're timing level generation (implies
+                            // map_stat_gen).
 
     string force_map;       // Set if we're forcing a specific map to generate.
 
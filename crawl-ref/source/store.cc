@@ -9,6 +9,7 @@
 #include "store.h"
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "dlua.h"
 #include "monster.h"
@@ -1202,6 +1203,244 @@ string &CrawlStoreValue::operator += (const string &_val)
     return get_string() += _val;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Interned property keys
+
+// Function-local so that static_prop_keys in other files can be
+// constructed before this file's statics are, and never destroyed, since
+// tables destroyed at exit (you.props, for one) still release their atoms.
+static unordered_map<string, prop_atom> &_prop_atoms()
+{
+    static auto *atoms = new unordered_map<string, prop_atom>;
+    return *atoms;
+}
+
+// The name and number of references (table entries and static_prop_keys)
+// of each atom. Names point into the keys of _prop_atoms(), which never
+// move; released atoms have no name, and are reused before new ones.
+struct prop_atom_info
+{
+    const string *name;
+    unsigned int refs;
+};
+
+static vector<prop_atom_info> &_prop_atom_info()
+{
+    static auto *info = new vector<prop_atom_info>;
+    return *info;
+}
+
+static vector<prop_atom> &_free_prop_atoms()
+{
+    static auto *free_atoms = new vector<prop_atom>;
+    return *free_atoms;
+}
+
+static prop_atom _find_prop_atom(const string &name)
+{
+    auto &atoms = _prop_atoms();
+    auto found = atoms.find(name);
+    return found == atoms.end() ? NO_PROP_ATOM : found->second;
+}
+
+static prop_atom _intern_prop_key(const string &name)
+{
+    auto &atoms = _prop_atoms();
+    auto found = atoms.find(name);
+    if (found != atoms.end())
+        return found->second;
+
+    auto &info = _prop_atom_info();
+    auto &free_atoms = _free_prop_atoms();
+    prop_atom atom;
+    if (free_atoms.empty())
+    {
+        atom = info.size();
+        info.push_back({nullptr, 0});
+    }
+    else
+    {
+        atom = free_atoms.back();
+        free_atoms.pop_back();
+    }
+    info[atom].name = &atoms.emplace(name, atom).first->first;
+    return atom;
+}
+
+static void _ref_prop_atom(prop_atom atom)
+{
+    ++_prop_atom_info()[atom].refs;
+}
+
+static void _unref_prop_atom(prop_atom atom)
+{
+    prop_atom_info &info = _prop_atom_info()[atom];
+    ASSERT(info.refs);
+    if (--info.refs)
+        return;
+
+    auto &atoms = _prop_atoms();
+    atoms.erase(atoms.find(*info.name));
+    info.name = nullptr;
+    _free_prop_atoms().push_back(atom);
+}
+
+prop_key::prop_key(const string &_name)
+    : id(_find_prop_atom(_name)), str(_name.c_str()), len(_name.size())
+{
+}
+
+prop_key::prop_key(const char *_name)
+    : id(_find_prop_atom(_name)), str(_name), len(strlen(_name))
+{
+}
+
+prop_atom prop_key::intern() const
+{
+    return interned() ? id : _intern_prop_key(string(str, len));
+}
+
+string prop_key::name() const
+{
+    return string(str, len);
+}
+
+const string &prop_key::name(prop_atom atom)
+{
+    return *_prop_atom_info()[atom].name;
+}
+
+static_prop_key::static_prop_key(const char *_name) : prop_key(_name)
+{
+    id = intern();
+    // Never released.
+    _ref_prop_atom(id);
+}
+
+CrawlHashTable::value_type::value_type(prop_atom _atom)
+    : atom(_atom), first(prop_key::name(_atom)), second()
+{
+    _ref_prop_atom(atom);
+}
+
+CrawlHashTable::value_type::value_type(const value_type &other)
+    : atom(other.atom), first(other.first), second(other.second)
+{
+    _ref_prop_atom(atom);
+}
+
+CrawlHashTable::value_type::~value_type()
+{
+    _unref_prop_atom(atom);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CrawlHashTable
+
+CrawlHashTable::CrawlHashTable() : count(0)
+{
+}
+
+CrawlHashTable::CrawlHashTable(const CrawlHashTable &other)
+    : slots(other.slots), count(other.count)
+{
+    for (slot &s : slots)
+        if (s.entry)
+            s.entry = new value_type(*s.entry);
+}
+
+CrawlHashTable::CrawlHashTable(CrawlHashTable &&other)
+    : slots(move(other.slots)), count(other.count)
+{
+    other.slots.clear();
+    other.count = 0;
+}
+
+CrawlHashTable::~CrawlHashTable()
+{
+    for (const slot &s : slots)
+        delete s.entry;
+}
+
+CrawlHashTable &CrawlHashTable::operator = (CrawlHashTable other)
+{
+    swap(other);
+    return *this;
+}
+
+void CrawlHashTable::swap(CrawlHashTable &other)
+{
+    slots.swap(other.slots);
+    std::swap(count, other.count);
+}
+
+void CrawlHashTable::clear()
+{
+    for (const slot &s : slots)
+        delete s.entry;
+    slots.clear();
+    count = 0;
+}
+
+size_t CrawlHashTable::home(prop_atom atom) const
+{
+    // Fibonacci hashing; atoms are handed out sequentially, so this mostly
+    // just spreads neighbouring keys apart.
+    return (atom * 2654435769U) & (slots.size() - 1);
+}
+
+// The slot holding atom, or the empty slot where it would go. The table
+// must not be full.
+size_t CrawlHashTable::find_slot(prop_atom atom) const
+{
+    const size_t mask = slots.size() - 1;
+    size_t i = home(atom);
+    while (slots[i].entry && slots[i].atom != atom)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void CrawlHashTable::grow()
+{
+    vector<slot> old(max<size_t>(4, slots.size() * 2), slot{0, nullptr});
+    old.swap(slots);
+    for (const slot &s : old)
+        if (s.entry)
+            slots[find_slot(s.atom)] = s;
+}
+
+size_t CrawlHashTable::erase(const prop_key &key)
+{
+    ASSERT_VALIDITY();
+    if (!count || !key.interned())
+        return 0;
+
+    const size_t mask = slots.size() - 1;
+    size_t hole = find_slot(key.atom());
+    if (!slots[hole].entry)
+        return 0;
+
+    delete slots[hole].entry;
+    slots[hole].entry = nullptr;
+    --count;
+
+    // Linear probing without tombstones: pull later members of the probe
+    // run back into the hole unless that would put them before their
+    // home slot.
+    for (size_t i = (hole + 1) & mask; slots[i].entry; i = (i + 1) & mask)
+    {
+        const size_t h = home(slots[i].atom);
+        const bool stays = hole <= i ? hole < h && h <= i
+                                     : hole < h || h <= i;
+        if (stays)
+            continue;
+        slots[hole] = slots[i];
+        slots[i].entry = nullptr;
+        hole = i;
+    }
+    return 1;
+}
+
 //////////////////////////////
 // Read/write from/to savefile
 void CrawlHashTable::write(writer &th) const
@@ -1215,10 +1454,19 @@ void CrawlHashTable::write(writer &th) const
 
     marshallUnsigned(th, size());
 
+    // Sorted, as the old std::map was, to keep save files deterministic.
+    vector<const value_type *> entries;
+    entries.reserve(size());
     for (const auto &entry : *this)
+        entries.push_back(&entry);
+    sort(entries.begin(), entries.end(),
+         [](const value_type *a, const value_type *b)
+         { return a->first < b->first; });
+
+    for (const value_type *entry : entries)
     {
-        marshallString(th, entry.first);
-        entry.second.write(th);
+        marshallString(th, entry->first);
+        entry->second.write(th);
     }
 
     ASSERT_VALIDITY();
@@ -1261,11 +1509,11 @@ static map<string, int> accesses;
 //////////////////
 // Misc functions
 
-bool CrawlHashTable::exists(const string &key) const
+bool CrawlHashTable::exists(const prop_key &key) const
 {
-    ACCESS(key);
+    ACCESS(key.name());
     ASSERT_VALIDITY();
-    return find(key) != end();
+    return count && key.interned() && slots[find_slot(key.atom())].entry;
 }
 
 void CrawlHashTable::assert_validity() const
@@ -1332,22 +1580,41 @@ void CrawlHashTable::assert_validity() const
 ////////////////////////////////
 // Accessors to contained values
 
-CrawlStoreValue& CrawlHashTable::get_value(const string &key)
+CrawlStoreValue& CrawlHashTable::get_value(const prop_key &key)
 {
     ASSERT_VALIDITY();
-    ACCESS(key);
-    // Inserts CrawlStoreValue() if the key was not found.
-    return map::operator[](key);
+    ACCESS(key.name());
+
+    if (count && key.interned())
+    {
+        const slot &s = slots[find_slot(key.atom())];
+        if (s.entry)
+            return s.entry->second;
+    }
+
+    // Inserts CrawlStoreValue() if the key was not found. Keep the load
+    // factor at or under 3/4.
+    if ((count + 1) * 4 > slots.size() * 3)
+        grow();
+    const prop_atom atom = key.intern();
+    slot &s = slots[find_slot(atom)];
+    s.atom = atom;
+    s.entry = new value_type(atom);
+    ++count;
+    return s.entry->second;
 }
 
-const CrawlStoreValue& CrawlHashTable::get_value(const string &key) const
+const CrawlStoreValue& CrawlHashTable::get_value(const prop_key &key) const
 {
     ASSERT_VALIDITY();
-    ACCESS(key);
-    auto iter = find(key);
-    ASSERTM(iter != end(), "trying to read non-existent property \"%s\"", key.c_str());
-
-    const CrawlStoreValue& store = iter->second;
+    ACCESS(key.name());
+    const value_type *entry = count && key.interned()
+                              ? slots[find_slot(key.atom())].entry
+                              : nullptr;
+    ASSERTM(entry, "trying to read non-existent property \"%s\"",
+            key.name().c_str());
+
+    const CrawlStoreValue& store = entry->second;
     ASSERT(store.type != SV_NONE);
     ASSERT(!(store.flags & SFLAG_UNSET));
 
@@ -241,27 +241,128 @@ protected:
     friend class CrawlVector;
 };
 
-class CrawlHashTable : public map<string, CrawlStoreValue>
+// Keys of a CrawlHashTable are interned: a key string stored in any table
+// is given a small integer atom, and tables hash and compare atoms instead
+// of strings. Strings convert to prop_key implicitly, so props["foo"]
+// still works. Looking a key up doesn't intern it, and an atom is released
+// again once no table holds its key, so keys built at run time don't pile
+// up. A key used on a hot path can be kept in a static_prop_key to skip
+// the string lookup as well.
+typedef uint32_t prop_atom;
+#define NO_PROP_ATOM ((prop_atom) -1)
+
+class prop_key
+{
+public:
+    prop_key(const string &name);
+    prop_key(const char *name);
+
+    // NO_PROP_ATOM if no table holds this key.
+    prop_atom atom() const { return id; }
+    bool interned() const { return id != NO_PROP_ATOM; }
+    string name() const;
+
+    static const string &name(prop_atom atom);
+
+protected:
+    // The atom for storing a value under this key, interning it if need be.
+    prop_atom intern() const;
+
+    prop_atom id;
+    // The key string, which must outlive the prop_key; a prop_key made from
+    // a string is only meant to last for a single call.
+    const char *str;
+    size_t len;
+
+    friend class CrawlHashTable;
+};
+
+// A key interned once and for good, for keys used on hot paths:
+//     static const static_prop_key key(ARTEFACT_PROPS_KEY);
+//     if (item.props.exists(key)) ...
+class static_prop_key : public prop_key
+{
+public:
+    explicit static_prop_key(const char *name);
+};
+
+// An open-addressing hash table of interned keys. The slots are small and
+// flat; each value lives in its own allocation, so references to values
+// stay valid while other keys are added or removed, as they did when this
+// was a std::map. Iteration order is unspecified.
+class CrawlHashTable
 {
 public:
     friend class CrawlStoreValue;
 
+    struct value_type
+    {
+        // Entries hold a reference to their atom.
+        value_type(prop_atom _atom);
+        value_type(const value_type &other);
+        ~value_type();
+
+        const prop_atom atom;
+        const string &first;
+        CrawlStoreValue second;
+    };
+
+private:
+    struct slot
+    {
+        prop_atom atom;
+        value_type *entry; // nullptr for an empty slot
+    };
+
+    template <typename T, typename S>
+    class iterator_base
+    {
+    public:
+        iterator_base(S *_pos, S *_end) : pos(_pos), end(_end) { skip(); }
+
+        T &operator * () const { return *pos->entry; }
+        T *operator -> () const { return pos->entry; }
+        iterator_base &operator ++ () { ++pos; skip(); return *this; }
+        bool operator == (const iterator_base &other) const
+        { return pos == other.pos; }
+        bool operator != (const iterator_base &other) const
+        { return pos != other.pos; }
+
+    private:
+        void skip()
+        {
+            while (pos != end && !pos->entry)
+                ++pos;
+        }
+
+        S *pos;
+        S *end;
+    };
+
+public:
+    typedef iterator_base<value_type, slot> iterator;
+    typedef iterator_base<const value_type, const slot> const_iterator;
+
+    CrawlHashTable();
+    CrawlHashTable(const CrawlHashTable &other);
+    CrawlHashTable(CrawlHashTable &&other);
+    ~CrawlHashTable();
+
+    CrawlHashTable &operator = (CrawlHashTable other);
+    void swap(CrawlHashTable &other);
+
     void write(writer &) const;
     void read(reader &);
 
-    bool exists(const string &key) const;
+    bool exists(const prop_key &key) const;
 
     void assert_validity() const;
 
     // NOTE: If the const versions of get_value() or [] are given a
     // key which doesn't exist, they will assert.
-    const CrawlStoreValue& get_value(const string &key) const;
-    const CrawlStoreValue& get_value(const char *key) const
-    { return get_value(string(key)); }
-    const CrawlStoreValue& operator[] (const string &key) const
+    const CrawlStoreValue& get_value(const prop_key &key) const;
+    const CrawlStoreValue& operator[] (const prop_key &key) const
     { return get_value(key); }
-    const CrawlStoreValue& operator[] (const char *key) const
-    { return get_value(string(key)); }
 
     // NOTE: If get_value() or [] is given a key which doesn't exist
     // in the table, an unset/empty CrawlStoreValue will be created
@@ -270,12 +371,40 @@ public:
     // hash table has a type (rather than being heterogeneous)
     // then trying to assign a different type to the CrawlStoreValue
     // will assert.
-    CrawlStoreValue& get_value(const string &key);
-    CrawlStoreValue& get_value(const char *key)
-    { return get_value(string(key)); }
-    using map::operator[];
-    CrawlStoreValue& operator[] (const char *key)
-    { return get_value(string(key)); }
+    CrawlStoreValue& get_value(const prop_key &key);
+    CrawlStoreValue& operator[] (const prop_key &key)
+    { return get_value(key); }
+
+    // std::map style interface
+    size_t size() const { return count; }
+    bool   empty() const { return !count; }
+    void   clear();
+    size_t erase(const prop_key &key);
+
+    iterator begin()
+    { return iterator(slots.data(), slots.data() + slots.size()); }
+    iterator end()
+    {
+        slot *last = slots.data() + slots.size();
+        return iterator(last, last);
+    }
+    const_iterator begin() const
+    { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const
+    {
+        const slot *last = slots.data() + slots.size();
+        return const_iterator(last, last);
+    }
+
+private:
+    size_t home(prop_atom atom) const;
+    size_t find_slot(prop_atom atom) const;
+    void   grow();
+
+    // Empty until the first insertion, since most tables (on items, for
+    // instance) never get any keys. Otherwise a power of two in size.
+    vector<slot> slots;
+    size_t       count;
 };
 
 // A CrawlVector is the vector version of CrawlHashTable, except that
@@ -503,3 +503,37 @@ string make_file_time(time_t when)
     }
     return "";
 }
+
+void append_varint(string &out, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += (char) ((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += (char) v;
+}
+
+string base64_encode(const string &data)
+{
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        const size_t n = min<size_t>(3, data.size() - i);
+        uint32_t chunk = (uint8_t) data[i] << 16;
+        if (n > 1)
+            chunk |= (uint8_t) data[i + 1] << 8;
+        if (n > 2)
+            chunk |= (uint8_t) data[i + 2];
+
+        out += digits[chunk >> 18];
+        out += digits[(chunk >> 12) & 0x3F];
+        out += n > 1 ? digits[(chunk >> 6) & 0x3F] : '=';
+        out += n > 2 ? digits[chunk & 0x3F] : '=';
+    }
+    return out;
+}
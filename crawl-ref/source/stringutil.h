@@ -247,6 +247,14 @@ vector<string> split_string(const string &sep, string s, bool trim = true,
 string make_time_string(time_t abs_time, bool terse = false);
 string make_file_time(time_t when);
 
+// binary data
+
+// Append v as a little-endian base-128 varint: seven bits per byte, with
+// the high bit set on every byte but the last.
+void append_varint(string &out, uint64_t v);
+// Standard base64 (RFC 4648), with '=' padding.
+string base64_encode(const string &data);
+
 // Work around older Cygwin's missing std::to_string, resulting from a lack
 // of long double support. Newer versions do provide long double and
 // std::to_string.
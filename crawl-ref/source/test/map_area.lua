@@ -0,0 +1,249 @@
+-- Checks the whole-area map functions (get_area, set_area,
+-- count_neighbors_in_area, cellular_step, flood_fill and distance_map)
+-- against the same operations done a cell at a time in Lua, on random maps.
+
+local iterations = 30
+local width, height = 23, 14
+local glyphs = { "x", "x", ".", ".", ".", "+", "w", "c" }
+local passable = ".+w"
+
+debug.reset_rng(1)
+
+-- A scratch map to draw on; the lines of the debug map are thrown away.
+local scratch = dgn.resolve_map(dgn.map_by_tag("debug_los"), false)
+assert(scratch, "Could not resolve a debug_los map")
+
+local function random_grid()
+  local grid = { }
+  for y = 0, height - 1 do
+    grid[y] = { }
+    for x = 0, width - 1 do
+      grid[y][x] = glyphs[crawl.random2(#glyphs) + 1]
+    end
+  end
+  return grid
+end
+
+local function load_grid(grid)
+  dgn.map(scratch, nil)
+  for y = 0, height - 1 do
+    local line = ""
+    for x = 0, width - 1 do
+      line = line .. grid[y][x]
+    end
+    dgn.map(scratch, line)
+  end
+end
+
+local function grid_string(grid)
+  local s = ""
+  for y = 0, height - 1 do
+    for x = 0, width - 1 do
+      s = s .. grid[y][x]
+    end
+  end
+  return s
+end
+
+local function copy_grid(grid)
+  local copy = { }
+  for y = 0, height - 1 do
+    copy[y] = { }
+    for x = 0, width - 1 do
+      copy[y][x] = grid[y][x]
+    end
+  end
+  return copy
+end
+
+local function in_grid(x, y)
+  return x >= 0 and x < width and y >= 0 and y < height
+end
+
+local function neighbours(x, y, fn)
+  for dy = -1, 1 do
+    for dx = -1, 1 do
+      if (dx ~= 0 or dy ~= 0) and in_grid(x + dx, y + dy) then
+        fn(x + dx, y + dy)
+      end
+    end
+  end
+end
+
+local function is_in(set, glyph)
+  return string.find(set, glyph, 1, true) ~= nil
+end
+
+local function check_area(grid)
+  assert(dgn.get_area(scratch, { }) == grid_string(grid),
+         "get_area doesn't match the map")
+end
+
+local function test_counts(grid)
+  local counts = dgn.count_neighbors_in_area(scratch, { find = "x+" })
+  local i = 1
+  for y = 0, height - 1 do
+    for x = 0, width - 1 do
+      local count = 0
+      neighbours(x, y, function (nx, ny)
+                         if is_in("x+", grid[ny][nx]) then
+                           count = count + 1
+                         end
+                       end)
+      assert(tonumber(string.sub(counts, i, i)) == count,
+             "count_neighbors_in_area is wrong at " .. x .. "," .. y)
+      i = i + 1
+    end
+  end
+end
+
+local function test_cellular_step(grid, passes)
+  dgn.cellular_step(scratch, { alive = "xc", wall = "x", floor = ".",
+                               birth = "678", survive = "3456",
+                               edges_alive = true, passes = passes })
+  for pass = 1, passes do
+    local old = copy_grid(grid)
+    for y = 0, height - 1 do
+      for x = 0, width - 1 do
+        local count = 0
+        for dy = -1, 1 do
+          for dx = -1, 1 do
+            if dx ~= 0 or dy ~= 0 then
+              local nx, ny = x + dx, y + dy
+              if not in_grid(nx, ny) or is_in("xc", old[ny][nx]) then
+                count = count + 1
+              end
+            end
+          end
+        end
+        local alive = is_in("xc", old[y][x])
+        if alive and not is_in("3456", tostring(count)) then
+          grid[y][x] = "."
+        elseif not alive and is_in("678", tostring(count)) then
+          grid[y][x] = "x"
+        end
+      end
+    end
+  end
+  check_area(grid)
+end
+
+local function test_flood_fill(grid)
+  local x, y = crawl.random2(width), crawl.random2(height)
+  local filled = dgn.flood_fill(scratch, { x = x, y = y,
+                                           passable = passable, fill = "F" })
+  local count = 0
+  if is_in(passable, grid[y][x]) then
+    local seen = { [y * width + x] = true }
+    local todo = { { x = x, y = y } }
+    while #todo > 0 do
+      local c = table.remove(todo)
+      grid[c.y][c.x] = "F"
+      count = count + 1
+      neighbours(c.x, c.y, function (nx, ny)
+                             if not seen[ny * width + nx]
+                                and is_in(passable, grid[ny][nx]) then
+                               seen[ny * width + nx] = true
+                               table.insert(todo, { x = nx, y = ny })
+                             end
+                           end)
+    end
+  end
+  assert(filled == count, "flood_fill filled " .. filled .. " cells, not "
+                          .. count)
+  check_area(grid)
+end
+
+local function test_distance_map(grid)
+  local x1, y1 = crawl.random2(width), crawl.random2(height)
+  local x2, y2 = crawl.random2(width), crawl.random2(height)
+  if x2 < x1 then x1, x2 = x2, x1 end
+  if y2 < y1 then y1, y2 = y2, y1 end
+  local dist = dgn.distance_map(scratch, { x1 = x1, y1 = y1, x2 = x2,
+                                           y2 = y2, from = "+",
+                                           passable = passable })
+
+  local box_width = x2 - x1 + 1
+  local want = { }
+  local queue = { }
+  for y = y1, y2 do
+    for x = x1, x2 do
+      local i = (y - y1) * box_width + x - x1 + 1
+      if grid[y][x] == "+" then
+        want[i] = 0
+        table.insert(queue, { x = x, y = y, d = 0 })
+      end
+    end
+  end
+  local head = 1
+  while head <= #queue do
+    local c = queue[head]
+    head = head + 1
+    neighbours(c.x, c.y, function (nx, ny)
+                           local i = (ny - y1) * box_width + nx - x1 + 1
+                           if nx >= x1 and nx <= x2 and ny >= y1 and ny <= y2
+                              and want[i] == nil
+                              and is_in(passable, grid[ny][nx]) then
+                             want[i] = c.d + 1
+                             table.insert(queue, { x = nx, y = ny,
+                                                   d = c.d + 1 })
+                           end
+                         end)
+  end
+
+  assert(#dist == box_width * (y2 - y1 + 1), "distance_map is the wrong size")
+  for i = 1, #dist do
+    assert(dist[i] == (want[i] or -1), "distance_map is wrong at " .. i)
+  end
+end
+
+local function test_set_area(grid)
+  local x1, y1 = crawl.random2(width), crawl.random2(height)
+  local x2, y2 = crawl.random2(width), crawl.random2(height)
+  if x2 < x1 then x1, x2 = x2, x1 end
+  if y2 < y1 then y1, y2 = y2, y1 end
+  local area = ""
+  for y = y1, y2 do
+    for x = x1, x2 do
+      local glyph = glyphs[crawl.random2(#glyphs) + 1]
+      grid[y][x] = glyph
+      area = area .. glyph
+    end
+  end
+  dgn.set_area(scratch, { x1 = x1, y1 = y1, x2 = x2, y2 = y2,
+                          glyphs = area })
+  assert(dgn.get_area(scratch, { x1 = x1, y1 = y1, x2 = x2, y2 = y2 })
+         == area, "get_area doesn't return what set_area set")
+  check_area(grid)
+end
+
+-- set_area, cellular_step and flood_fill leave the padding past the end of
+-- a short line alone.
+local function test_short_line()
+  dgn.map(scratch, nil)
+  dgn.map(scratch, "xxxxx")
+  dgn.map(scratch, "xx")
+  dgn.map(scratch, "x.x.x")
+  dgn.set_area(scratch, { glyphs = "...............", x1 = 0, y1 = 0,
+                          x2 = 4, y2 = 2 })
+  -- Padding would die, as it's alive with no number of neighbours it
+  -- survives.
+  dgn.cellular_step(scratch, { alive = " ", birth = "", survive = "" })
+  dgn.flood_fill(scratch, { x = 0, y = 0, passable = ". ", fill = "F" })
+  local lines = dgn.map(scratch)
+  assert(lines[2] == "FF", "short line changed length: " .. lines[2])
+  assert(dgn.get_area(scratch, { x1 = 2, y1 = 1, x2 = 4, y2 = 1 }) == "   ",
+         "padding past a short line was written")
+end
+
+for i = 1, iterations do
+  local grid = random_grid()
+  load_grid(grid)
+  check_area(grid)
+  test_counts(grid)
+  test_distance_map(grid)
+  test_set_area(grid)
+  test_cellular_step(grid, crawl.random_range(1, 3))
+  test_flood_fill(grid)
+end
+test_short_line()
@@ -19,9 +19,11 @@
 #include "branch.h"
 #include "command.h"
 #include "coord.h"
+#include "dbg-prof.h"
 #include "directn.h"
 #include "english.h"
 #include "env.h"
+#include "errors.h"
 #include "files.h"
 #include "item-name.h"
 #include "json.h"
@@ -76,14 +78,19 @@ static unsigned int get_milliseconds()
 TilesFramework tiles;
 
 TilesFramework::TilesFramework() :
+      m_packed_map(false),
+      m_writing_snapshot(false),
+      m_snapshot_valid(false),
       m_controlled_from_web(false),
       _send_lock(false),
+      m_packing(false),
       m_last_ui_state(UI_INIT),
       m_view_loaded(false),
       m_current_view(coord_def(GXM, GYM)),
       m_next_view(coord_def(GXM, GYM)),
       m_next_view_tl(0, 0),
       m_next_view_br(-1, -1),
+      m_dirty_cells(),
       m_current_flash_colour(BLACK),
       m_next_flash_colour(BLACK),
       m_need_full_map(true),
@@ -105,6 +112,10 @@ void TilesFramework::shutdown()
     if (m_sock_name.empty())
         return;
 
+    // Get the last messages (such as the exit reason) out, but don't hang a
+    // crashing process on it.
+    _send_queued(!CrawlIsCrashing);
+
     close(m_sock);
     remove(m_sock_name.c_str());
 }
@@ -179,6 +190,18 @@ void TilesFramework::write_message(const char *format, ...)
     m_msg_buf.append(buf);
 }
 
+// Non-primary destinations that fall this far behind lose their backlog and
+// get a full update once they catch up. Snapshots don't count towards it,
+// or one bigger than this could never be delivered.
+#define SPECTATOR_QUEUE_LIMIT (512 * 1024)
+// The primary destination (the player) is never dropped, but past this much
+// backlog we wait for it.
+#define PRIMARY_QUEUE_LIMIT (4 * 1024 * 1024)
+
+// Bump when the packed map cell layout changes; the webserver says which
+// version it reads when attaching, and the client checks it.
+#define PACKED_MAP_VERSION 1
+
 void TilesFramework::finish_message()
 {
     if (m_msg_buf.size() == 0)
@@ -195,82 +218,310 @@ void TilesFramework::finish_message()
     }
 
     m_msg_buf.append("\n");
-    const char* fragment_start = m_msg_buf.data();
-    const char* data_end = m_msg_buf.data() + m_msg_buf.size();
-    int fragments = 0;
-    while (fragment_start < data_end)
-    {
-        int fragment_size = data_end - fragment_start;
-        if (fragment_size > m_max_msg_size)
-            fragment_size = m_max_msg_size;
-        fragments++;
+    const shared_ptr<const string> msg = make_shared<const string>(move(m_msg_buf));
+    m_msg_buf.clear();
 
-        for (unsigned int i = 0; i < m_dest_addrs.size(); ++i)
+    if (m_writing_snapshot)
+    {
+        m_snapshot.push_back(msg);
+        _queue_to(m_snapshot_addr, msg);
+    }
+    else
+    {
+        // Server messages don't change what a snapshot would contain.
+        if ((*msg)[0] != '*')
         {
-            int retries = 30;
-            ssize_t sent = 0;
-            while (sent < fragment_size)
-            {
-                ssize_t retval = sendto(m_sock, fragment_start + sent,
-                    fragment_size - sent, 0, (sockaddr*) &m_dest_addrs[i],
-                    sizeof(sockaddr_un));
-#ifdef DEBUG_WEBSOCKETS
-                fprintf(stderr,
-                            "    trying to send fragment to client %d...", i);
-#endif
-                if (retval <= 0)
-                {
-                    const char *errmsg = retval == 0 ? "No bytes sent"
-                                                     : strerror(errno);
-                    if (--retries <= 0)
-                        die("Socket write error: %s", errmsg);
+            m_snapshot_valid = false;
+            m_snapshot.clear();
+        }
+        for (WebtilesDest &dest : m_dests)
+            _queue_message(dest, msg);
+    }
+    _send_queued();
 
-                    if (retval == 0 || errno == ENOBUFS || errno == EWOULDBLOCK
-                        || errno == EINTR || errno == EAGAIN)
-                    {
-                        // Wait for half a second at first (up to five), then
-                        // try again.
-                        const int sleep_time = retries > 25 ? 2 * 1000
-                                             : retries > 10 ? 500 * 1000
-                                             : 5000 * 1000;
+    m_need_flush = true;
 #ifdef DEBUG_WEBSOCKETS
-                        fprintf(stderr, "failed (%s), sleeping for %dms.\n",
-                                                    errmsg, sleep_time / 1000);
+    fprintf(stderr, "websocket: Queued %d bytes.\n", initial_buf_size);
 #endif
-                        usleep(sleep_time);
-                    }
-                    else if (errno == ECONNREFUSED || errno == ENOENT)
-                    {
-                        // the other side is dead
+}
+
+/**
+ * Queue a message for one destination.
+ *
+ * @param dest      the destination.
+ * @param msg       the message.
+ * @param snapshot  whether msg is part of a snapshot (or its begin/end
+ *                  markers). Those are always queued, and never dropped
+ *                  later, so that a snapshot arrives whole.
+ */
+void TilesFramework::_queue_message(WebtilesDest &dest,
+                                    const shared_ptr<const string> &msg,
+                                    bool snapshot)
+{
+    if (snapshot)
+    {
+        dest.queue.push_back(msg);
+        dest.queued_bytes += msg->size();
+        // Everything queued so far stays, so the snapshot can't be cut off
+        // by dropping what came before it.
+        dest.snapshot_msgs = dest.queue.size();
+        dest.backlog_bytes = 0;
+        return;
+    }
+
+    // Anything sent before the resync is superseded by it.
+    if (dest.needs_resync)
+        return;
+
+    if (!dest.primary
+        && dest.backlog_bytes + msg->size() > SPECTATOR_QUEUE_LIMIT)
+    {
 #ifdef DEBUG_WEBSOCKETS
-                        fprintf(stderr,
-                            "failed (%s), breaking.\n", errmsg);
+        fprintf(stderr, "websocket: dropping %u bytes for a slow reader.\n",
+                (unsigned int)dest.backlog_bytes);
 #endif
-                        m_dest_addrs.erase(m_dest_addrs.begin() + i);
-                        i--;
-                        break;
-                    }
-                    else
+        // A message that has been partly sent has to be finished, or the
+        // reader can't find where the next one starts.
+        const size_t keep = max<size_t>(dest.snapshot_msgs,
+                                        dest.front_sent ? 1 : 0);
+        while (dest.queue.size() > keep)
+        {
+            dest.queued_bytes -= dest.queue.back()->size();
+            dest.queue.pop_back();
+        }
+        dest.backlog_bytes = 0;
+        dest.needs_resync = true;
+        return;
+    }
+
+    dest.queue.push_back(msg);
+    dest.queued_bytes += msg->size();
+    dest.backlog_bytes += msg->size();
+}
+
+int TilesFramework::_find_dest(const sockaddr_un &addr) const
+{
+    for (unsigned int i = 0; i < m_dests.size(); ++i)
+    {
+        if (!strncmp(m_dests[i].addr.sun_path, addr.sun_path,
+                     sizeof(addr.sun_path)))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TilesFramework::_queue_to(const sockaddr_un &addr,
+                               const shared_ptr<const string> &msg)
+{
+    const int i = _find_dest(addr);
+    if (i >= 0)
+        _queue_message(m_dests[i], msg, true);
+}
+
+/**
+ * Send as much of a destination's queue as its socket will take.
+ *
+ * @param dest   the destination.
+ * @param block  if true, keep retrying (as the old synchronous sender did)
+ *               until the queue is empty.
+ * @return false if the other side has gone away.
+ */
+bool TilesFramework::_send_queued_to(WebtilesDest &dest, bool block)
+{
+    int retries = 30;
+    while (!dest.queue.empty())
+    {
+        const string &msg = *dest.queue.front();
+        while (dest.front_sent < msg.size())
+        {
+            const size_t fragment_size = min<size_t>(msg.size() - dest.front_sent,
+                                                     m_max_msg_size);
+            ssize_t retval = sendto(m_sock, msg.data() + dest.front_sent,
+                                    fragment_size, MSG_DONTWAIT,
+                                    (sockaddr*) &dest.addr,
+                                    sizeof(sockaddr_un));
+            if (retval > 0)
+            {
+                dest.front_sent += retval;
+                continue;
+            }
+
+            const char *errmsg = retval == 0 ? "No bytes sent"
+                                             : strerror(errno);
+            if (retval == 0 || errno == ENOBUFS || errno == EWOULDBLOCK
+                || errno == EINTR || errno == EAGAIN)
+            {
+                if (!block)
+                    return true;
+                if (--retries <= 0)
+                {
+                    if (dest.primary)
                         die("Socket write error: %s", errmsg);
+                    return true;
                 }
-                else
-                {
+                // Wait for half a second at first (up to five), then
+                // try again.
+                const int sleep_time = retries > 25 ? 2 * 1000
+                                     : retries > 10 ? 500 * 1000
+                                     : 5000 * 1000;
 #ifdef DEBUG_WEBSOCKETS
-                    fprintf(stderr, "fragment size %d sent.\n", fragment_size);
+                fprintf(stderr, "websocket: send failed (%s), sleeping for "
+                                "%dms.\n", errmsg, sleep_time / 1000);
 #endif
-                    sent += retval;
-                }
+                usleep(sleep_time);
+            }
+            else if (errno == ECONNREFUSED || errno == ENOENT)
+            {
+                // the other side is dead
+#ifdef DEBUG_WEBSOCKETS
+                fprintf(stderr, "websocket: send failed (%s), dropping "
+                                "receiver.\n", errmsg);
+#endif
+                return false;
             }
+            else
+                die("Socket write error: %s", errmsg);
         }
 
-        fragment_start += fragment_size;
+        dest.queued_bytes -= msg.size();
+        if (dest.snapshot_msgs)
+            --dest.snapshot_msgs;
+        else
+            dest.backlog_bytes -= msg.size();
+        dest.queue.pop_front();
+        dest.front_sent = 0;
+    }
+    return true;
+}
+
+// Send queued messages, to the primary destination first.
+void TilesFramework::_send_queued(bool block)
+{
+    for (int primary = 1; primary >= 0; --primary)
+    {
+        for (unsigned int i = 0; i < m_dests.size(); ++i)
+        {
+            WebtilesDest &dest = m_dests[i];
+            if (dest.primary != (primary == 1))
+                continue;
+
+            const bool finish = block
+                || dest.primary && dest.queued_bytes > PRIMARY_QUEUE_LIMIT;
+            if (!_send_queued_to(dest, finish))
+            {
+                m_dests.erase(m_dests.begin() + i);
+                i--;
+                _update_packed_map();
+            }
+        }
     }
-    m_msg_buf.clear();
-    m_need_flush = true;
-#ifdef DEBUG_WEBSOCKETS
-    fprintf(stderr, "websocket: Sent %d bytes in %d fragments.\n",
-                                                initial_buf_size, fragments);
-#endif
+}
+
+// All destinations share one stream, so map cells are only packed while
+// every one of them can read the packed encoding.
+void TilesFramework::_update_packed_map()
+{
+    bool packed = !m_dests.empty();
+    for (const WebtilesDest &dest : m_dests)
+        packed = packed && dest.packed_map;
+
+    if (packed == m_packed_map)
+        return;
+    m_packed_map = packed;
+    // A kept snapshot may be in the other encoding.
+    m_snapshot_valid = false;
+    m_snapshot.clear();
+}
+
+bool TilesFramework::_have_queued() const
+{
+    for (const WebtilesDest &dest : m_dests)
+        if (!dest.queue.empty())
+            return true;
+    return false;
+}
+
+// Once a reader whose backlog was dropped has caught up, bring it back in
+// sync. Several drops in a row are covered by a single snapshot.
+void TilesFramework::_resync_dropped()
+{
+    if (_send_lock)
+        return;
+
+    vector<sockaddr_un> resync;
+    for (WebtilesDest &dest : m_dests)
+    {
+        if (dest.needs_resync && dest.queue.empty())
+        {
+            dest.needs_resync = false;
+            resync.push_back(dest.addr);
+        }
+    }
+
+    for (const sockaddr_un &addr : resync)
+        _send_snapshot(addr, -1);
+}
+
+/**
+ * Bring one destination up to date without a full resend to the others.
+ *
+ * Pending changes first go out to everyone as usual, after which every
+ * receiver has exactly the shadow state. The snapshot is written from that
+ * state and queued for @p addr alone; until something else is broadcast,
+ * later joiners are sent the same messages without serializing them again.
+ *
+ * @param addr     the destination to bring up to date.
+ * @param watcher  the webserver's id for a newly joined watcher, so that it
+ *                 can pass the snapshot to that client only; -1 if all of
+ *                 the destination's clients need it.
+ */
+void TilesFramework::_send_snapshot(const sockaddr_un &addr, int watcher)
+{
+    if (_send_lock)
+        return;
+
+    redraw();
+    flush_messages();
+
+    // A snapshot for all of the destination's clients brings every one of
+    // them up to date, so any pending resync is covered by it. Only this
+    // destination is sent the full update; the others just get the usual
+    // changes from the redraw above.
+    const int dest = _find_dest(addr);
+    if (watcher < 0 && dest >= 0)
+        m_dests[dest].needs_resync = false;
+
+    if (watcher >= 0)
+    {
+        _queue_to(addr, make_shared<const string>(make_stringf(
+            "*{\"msg\":\"snapshot_begin\",\"watcher\":%d}\n", watcher)));
+    }
+
+    if (m_snapshot_valid)
+    {
+        for (const shared_ptr<const string> &msg : m_snapshot)
+            _queue_to(addr, msg);
+    }
+    else
+    {
+        m_snapshot.clear();
+        m_snapshot_addr = addr;
+        {
+            unwind_bool writing(m_writing_snapshot, true);
+            _send_everything();
+        }
+        m_snapshot_valid = true;
+    }
+
+    if (watcher >= 0)
+    {
+        _queue_to(addr, make_shared<const string>(
+            "*{\"msg\":\"snapshot_end\"}\n"));
+    }
+    _send_queued();
+    flush_messages();
 }
 
 void TilesFramework::send_message(const char *format, ...)
@@ -313,7 +564,7 @@ void TilesFramework::_await_connection()
     if (m_sock_name.empty())
         return;
 
-    while (m_dest_addrs.size() == 0)
+    while (m_dests.size() == 0)
         _receive_control_message();
 }
 
@@ -366,7 +617,20 @@ wint_t TilesFramework::_handle_control_message(sockaddr_un addr, string data)
         JsonWrapper primary = json_find_member(obj.node, "primary");
         primary.check(JSON_BOOL);
 
-        m_dest_addrs.push_back(addr);
+        WebtilesDest dest;
+        dest.addr = addr;
+        dest.primary = primary->bool_;
+        dest.queued_bytes = 0;
+        dest.front_sent = 0;
+        dest.needs_resync = false;
+        dest.snapshot_msgs = 0;
+        dest.backlog_bytes = 0;
+        // Servers that can take packed map cells say which version.
+        JsonWrapper packed_map = json_find_member(obj.node, "packed_map");
+        dest.packed_map = packed_map.node && packed_map->tag == JSON_NUMBER
+                          && packed_map->number_ == PACKED_MAP_VERSION;
+        m_dests.push_back(dest);
+        _update_packed_map();
         m_controlled_from_web = primary->bool_;
     }
     else if (msgtype == "key")
@@ -378,9 +642,13 @@ wint_t TilesFramework::_handle_control_message(sockaddr_un addr, string data)
     }
     else if (msgtype == "spectator_joined")
     {
-        flush_messages();
-        _send_everything();
-        flush_messages();
+        // Servers that don't say which watcher joined get the snapshot
+        // for all of their clients.
+        JsonWrapper watcher = json_find_member(obj.node, "watcher");
+        if (watcher.node && watcher->tag == JSON_NUMBER)
+            _send_snapshot(addr, (int) watcher->number_);
+        else
+            _send_snapshot(addr, -1);
     }
     else if (msgtype == "menu_scroll")
     {
@@ -471,6 +739,11 @@ bool TilesFramework::await_input(wint_t& c, bool block)
 
     while (true)
     {
+        _send_queued();
+        _resync_dropped();
+
+        // While anything is still queued, wake up now and then to send it.
+        const bool retry = _have_queued();
         do
         {
             FD_ZERO(&fds);
@@ -481,7 +754,12 @@ bool TilesFramework::await_input(wint_t& c, bool block)
             if (block)
             {
                 tiles.flush_messages();
-                result = select(maxfd + 1, &fds, nullptr, nullptr, nullptr);
+                timeval timeout;
+                timeout.tv_sec = 0;
+                timeout.tv_usec = 20 * 1000;
+
+                result = select(maxfd + 1, &fds, nullptr, nullptr,
+                                retry ? &timeout : nullptr);
             }
             else
             {
@@ -494,7 +772,9 @@ bool TilesFramework::await_input(wint_t& c, bool block)
         }
         while (result == -1 && errno == EINTR);
 
-        if (result == 0)
+        if (result == 0 && block)
+            continue;
+        else if (result == 0)
             return false;
         else if (result > 0)
         {
@@ -568,7 +848,11 @@ void TilesFramework::_send_version()
 #endif
 
     string title = CRAWL " " + string(Version::Long);
-    send_message("{\"msg\":\"version\",\"text\":\"%s\"}", title.c_str());
+    json_open_object();
+    json_write_string("msg", "version");
+    json_write_string("text", title);
+    json_close_object();
+    finish_message();
 }
 
 void TilesFramework::_send_options()
@@ -1304,6 +1588,87 @@ void TilesFramework::write_tileidx(tileidx_t t)
         tiles.write_message("[%d,%d]", lo, hi);
 }
 
+// Fields of a packed map cell. A cell is a varint bitmask of these followed
+// by the values of the set fields in bit order, so the bits must stay in the
+// order _send_cell writes them. webserver/game_data/static/packed_map.js has
+// the matching table.
+enum packed_field
+{
+    PF_FEAT,
+    PF_MON_NULL,
+    PF_MON_ID,
+    PF_MAP_FEAT,
+    PF_GLYPH,
+    PF_COLOUR,
+    PF_FG,
+    PF_BASE,
+    PF_BG,
+    PF_CLOUD,
+    PF_BLOODY,
+    PF_OLD_BLOOD,
+    PF_SILENCED,
+    PF_HALO,
+    PF_HIGHLIGHTED_SUMMONER,
+    PF_SANCTUARY,
+    PF_LIQUEFIED,
+    PF_ORB_GLOW,
+    PF_QUAD_GLOW,
+    PF_DISJUNCT,
+    PF_MANGROVE_WATER,
+    PF_AWAKENED_FOREST,
+    PF_BLOOD_ROTATION,
+    PF_TRAVEL_TRAIL,
+    PF_FLAVOUR,
+    PF_OVERLAYS,
+    PF_EXTRA,
+    NUM_PACKED_FIELDS
+};
+COMPILE_CHECK(NUM_PACKED_FIELDS <= 32);
+
+void TilesFramework::_pack_field(int field)
+{
+    // Values are read back in bit order.
+    ASSERT(!(m_packed_fields >> field));
+    m_packed_fields |= 1U << field;
+}
+
+void TilesFramework::_cell_int(int field, const string &name, int value)
+{
+    if (m_packing)
+    {
+        _pack_field(field);
+        append_varint(m_packed_cell, (uint32_t) value);
+    }
+    else
+        json_write_int(name, value);
+}
+
+void TilesFramework::_cell_bool(int field, const string &name, bool value)
+{
+    if (m_packing)
+    {
+        _pack_field(field);
+        append_varint(m_packed_cell, value);
+    }
+    else
+        json_write_bool(name, value);
+}
+
+void TilesFramework::_cell_tileidx(int field, const string &name,
+                                   tileidx_t t)
+{
+    if (m_packing)
+    {
+        _pack_field(field);
+        append_varint(m_packed_cell, t);
+    }
+    else
+    {
+        json_write_name(name);
+        write_tileidx(t);
+    }
+}
+
 void TilesFramework::_send_cell(const coord_def &gc,
                                 const screen_cell_t &current_sc, const screen_cell_t &next_sc,
                                 const map_cell &current_mc, const map_cell &next_mc,
@@ -1311,20 +1676,30 @@ void TilesFramework::_send_cell(const coord_def &gc,
                                 bool force_full)
 {
     if (current_mc.feat() != next_mc.feat())
-        json_write_int("f", next_mc.feat());
+        _cell_int(PF_FEAT, "f", next_mc.feat());
 
     if (next_mc.monsterinfo())
         _send_monster(gc, next_mc.monsterinfo(), new_monster_locs, force_full);
     else if (current_mc.monsterinfo())
-        json_write_null("mon");
+    {
+        if (m_packing)
+            _pack_field(PF_MON_NULL);
+        else
+            json_write_null("mon");
+    }
 
     map_feature mf = get_cell_map_feature(gc);
     if (get_cell_map_feature(current_mc) != mf)
-        json_write_int("mf", mf);
+        _cell_int(PF_MAP_FEAT, "mf", mf);
 
     // Glyph and colour
     char32_t glyph = next_sc.glyph;
-    if (current_sc.glyph != glyph)
+    if (current_sc.glyph != glyph && m_packing)
+    {
+        _pack_field(PF_GLYPH);
+        append_varint(m_packed_cell, glyph);
+    }
+    else if (current_sc.glyph != glyph)
     {
         char buf[5];
         buf[wctoutf8(buf, glyph)] = 0;
@@ -1335,7 +1710,7 @@ void TilesFramework::_send_cell(const coord_def &gc,
     {
         int col = next_sc.colour;
         col = (_get_brand(col) << 4) | macro_colour(col & 0xF);
-        json_write_int("col", col);
+        _cell_int(PF_COLOUR, "col", col);
     }
 
     json_open_object("t");
@@ -1353,69 +1728,74 @@ void TilesFramework::_send_cell(const coord_def &gc,
         {
             fg_changed = true;
 
-            json_write_name("fg");
-            write_tileidx(next_pc.fg);
+            _cell_tileidx(PF_FG, "fg", next_pc.fg);
             if (get_tile_texture(fg_idx) == TEX_DEFAULT)
-                json_write_int("base", (int) tileidx_known_base_item(fg_idx));
+            {
+                _cell_int(PF_BASE, "base",
+                          (int) tileidx_known_base_item(fg_idx));
+            }
         }
 
         if (next_pc.bg != current_pc.bg)
-        {
-            json_write_name("bg");
-            write_tileidx(next_pc.bg);
-        }
+            _cell_tileidx(PF_BG, "bg", next_pc.bg);
 
         if (next_pc.cloud != current_pc.cloud)
-        {
-            json_write_name("cloud");
-            write_tileidx(next_pc.cloud);
-        }
+            _cell_tileidx(PF_CLOUD, "cloud", next_pc.cloud);
 
         if (next_pc.is_bloody != current_pc.is_bloody)
-            json_write_bool("bloody", next_pc.is_bloody);
+            _cell_bool(PF_BLOODY, "bloody", next_pc.is_bloody);
 
         if (next_pc.old_blood != current_pc.old_blood)
-            json_write_bool("old_blood", next_pc.old_blood);
+            _cell_bool(PF_OLD_BLOOD, "old_blood", next_pc.old_blood);
 
         if (next_pc.is_silenced != current_pc.is_silenced)
-            json_write_bool("silenced", next_pc.is_silenced);
+            _cell_bool(PF_SILENCED, "silenced", next_pc.is_silenced);
 
         if (next_pc.halo != current_pc.halo)
-            json_write_int("halo", next_pc.halo);
+            _cell_int(PF_HALO, "halo", next_pc.halo);
 
         if (next_pc.is_highlighted_summoner
             != current_pc.is_highlighted_summoner)
         {
-            json_write_bool("highlighted_summoner",
-                            next_pc.is_highlighted_summoner);
+            _cell_bool(PF_HIGHLIGHTED_SUMMONER, "highlighted_summoner",
+                       next_pc.is_highlighted_summoner);
         }
 
         if (next_pc.is_sanctuary != current_pc.is_sanctuary)
-            json_write_bool("sanctuary", next_pc.is_sanctuary);
+            _cell_bool(PF_SANCTUARY, "sanctuary", next_pc.is_sanctuary);
 
         if (next_pc.is_liquefied != current_pc.is_liquefied)
-            json_write_bool("liquefied", next_pc.is_liquefied);
+            _cell_bool(PF_LIQUEFIED, "liquefied", next_pc.is_liquefied);
 
         if (next_pc.orb_glow != current_pc.orb_glow)
-            json_write_int("orb_glow", next_pc.orb_glow);
+            _cell_int(PF_ORB_GLOW, "orb_glow", next_pc.orb_glow);
 
         if (next_pc.quad_glow != current_pc.quad_glow)
-            json_write_bool("quad_glow", next_pc.quad_glow);
+            _cell_bool(PF_QUAD_GLOW, "quad_glow", next_pc.quad_glow);
 
         if (next_pc.disjunct != current_pc.disjunct)
-            json_write_bool("disjunct", next_pc.disjunct);
+            _cell_bool(PF_DISJUNCT, "disjunct", next_pc.disjunct);
 
         if (next_pc.mangrove_water != current_pc.mangrove_water)
-            json_write_bool("mangrove_water", next_pc.mangrove_water);
+        {
+            _cell_bool(PF_MANGROVE_WATER, "mangrove_water",
+                       next_pc.mangrove_water);
+        }
 
         if (next_pc.awakened_forest != current_pc.awakened_forest)
-            json_write_bool("awakened_forest", next_pc.awakened_forest);
+        {
+            _cell_bool(PF_AWAKENED_FOREST, "awakened_forest",
+                       next_pc.awakened_forest);
+        }
 
         if (next_pc.blood_rotation != current_pc.blood_rotation)
-            json_write_int("blood_rotation", next_pc.blood_rotation);
+        {
+            _cell_int(PF_BLOOD_ROTATION, "blood_rotation",
+                      next_pc.blood_rotation);
+        }
 
         if (next_pc.travel_trail != current_pc.travel_trail)
-            json_write_int("travel_trail", next_pc.travel_trail);
+            _cell_int(PF_TRAVEL_TRAIL, "travel_trail", next_pc.travel_trail);
 
         if (_needs_flavour(next_pc) &&
             (next_pc.flv.floor != current_pc.flv.floor
@@ -1423,11 +1803,20 @@ void TilesFramework::_send_cell(const coord_def &gc,
              || !_needs_flavour(current_pc)
              || force_full))
         {
-            json_open_object("flv");
-            json_write_int("f", next_pc.flv.floor);
-            if (next_pc.flv.special)
-                json_write_int("s", next_pc.flv.special);
-            json_close_object();
+            if (m_packing)
+            {
+                _pack_field(PF_FLAVOUR);
+                append_varint(m_packed_cell, next_pc.flv.floor);
+                append_varint(m_packed_cell, next_pc.flv.special);
+            }
+            else
+            {
+                json_open_object("flv");
+                json_write_int("f", next_pc.flv.floor);
+                if (next_pc.flv.special)
+                    json_write_int("s", next_pc.flv.special);
+                json_close_object();
+            }
         }
 
         if (fg_idx >= TILEP_MCACHE_START)
@@ -1450,7 +1839,8 @@ void TilesFramework::_send_cell(const coord_def &gc,
             bool player_doll_changed = false;
             dolls_data result = player_doll;
             fill_doll_equipment(result);
-            if (result != last_player_doll)
+            // A snapshot shows the doll the receivers already have.
+            if (result != last_player_doll && !m_writing_snapshot)
             {
                 player_doll_changed = true;
                 last_player_doll = result;
@@ -1520,7 +1910,17 @@ void TilesFramework::_send_cell(const coord_def &gc,
             }
         }
 
-        if (overlays_changed)
+        if (overlays_changed && m_packing)
+        {
+            _pack_field(PF_OVERLAYS);
+            append_varint(m_packed_cell, next_pc.num_dngn_overlay);
+            for (int i = 0; i < next_pc.num_dngn_overlay; ++i)
+            {
+                append_varint(m_packed_cell,
+                               (uint32_t) next_pc.dngn_overlay[i]);
+            }
+        }
+        else if (overlays_changed)
         {
             json_open_array("ov");
             for (int i = 0; i < next_pc.num_dngn_overlay; ++i)
@@ -1545,26 +1945,27 @@ void TilesFramework::_send_cursor(cursor_type type)
     }
 }
 
+void TilesFramework::_mcache_ref_cell(const coord_def &gc, bool inc)
+{
+    int fg_idx = m_current_view(gc).tile.fg & TILE_FLAG_MASK;
+    if (fg_idx >= TILEP_MCACHE_START)
+    {
+        mcache_entry *entry = mcache.get(fg_idx);
+        if (entry)
+        {
+            if (inc)
+                entry->inc_ref();
+            else
+                entry->dec_ref();
+        }
+    }
+}
+
 void TilesFramework::_mcache_ref(bool inc)
 {
     for (int y = 0; y < GYM; y++)
         for (int x = 0; x < GXM; x++)
-        {
-            coord_def gc(x, y);
-
-            int fg_idx = m_current_view(gc).tile.fg & TILE_FLAG_MASK;
-            if (fg_idx >= TILEP_MCACHE_START)
-            {
-                mcache_entry *entry = mcache.get(fg_idx);
-                if (entry)
-                {
-                    if (inc)
-                        entry->inc_ref();
-                    else
-                        entry->dec_ref();
-                }
-            }
-        }
+            _mcache_ref_cell(coord_def(x, y), inc);
 }
 
 void TilesFramework::_send_map(bool force_full)
@@ -1577,8 +1978,19 @@ void TilesFramework::_send_map(bool force_full)
 
     map<uint32_t, coord_def> new_monster_locs;
 
-    force_full = force_full || m_need_full_map;
-    m_need_full_map = false;
+    // A snapshot repeats the map the receivers already have, from the
+    // shadow copies, and leaves all change tracking alone.
+    const bool snapshot = m_writing_snapshot;
+    // Nothing has been sent yet, so there is nothing to repeat.
+    const bool no_cells = snapshot && m_origin.equals(-1, -1);
+
+    if (snapshot)
+        force_full = true;
+    else
+    {
+        force_full = force_full || m_need_full_map;
+        m_need_full_map = false;
+    }
 
     json_open_object();
     json_write_string("msg", "map");
@@ -1587,13 +1999,24 @@ void TilesFramework::_send_map(bool force_full)
     if (force_full)
         json_write_bool("clear", true);
 
-    if (force_full || you.on_current_level != m_player_on_level)
+    if (snapshot)
+    {
+        json_write_bool("player_on_level", m_player_on_level);
+        if (!no_cells)
+        {
+            json_open_object("vgrdc");
+            json_write_int("x", m_current_gc.x - m_origin.x);
+            json_write_int("y", m_current_gc.y - m_origin.y);
+            json_close_object();
+        }
+    }
+    else if (force_full || you.on_current_level != m_player_on_level)
     {
         json_write_bool("player_on_level", you.on_current_level);
         m_player_on_level = you.on_current_level;
     }
 
-    if (force_full || m_current_gc != m_next_gc)
+    if (!snapshot && (force_full || m_current_gc != m_next_gc))
     {
         if (m_origin.equals(-1, -1))
             m_origin = m_next_gc;
@@ -1613,16 +2036,42 @@ void TilesFramework::_send_map(bool force_full)
     coord_def last_gc(0, 0);
     bool send_gc = true;
 
-    json_open_array("cells");
-    for (int y = 0; y < GYM; y++)
-        for (int x = 0; x < GXM; x++)
+    m_sent_cells.clear();
+
+    // In the packed encoding the cells go out as one base64 string "p":
+    // a header of varints (format version, map width, origin x and y), then
+    // runs of consecutive cells, each a varint count of cells skipped since
+    // the previous run, a varint run length and that many packed cells.
+    // Cells whose monster or doll needs more than an id keep that part as
+    // JSON in the "x" array, referenced by index from PF_EXTRA.
+    unwind_bool packing(m_packing, m_packed_map);
+    string packed;
+    string run;
+    int run_start = 0;
+    int run_end = 0;
+    int extras = 0;
+
+    json_open_array(m_packing ? "x" : "cells");
+    for (int w = 0; w < DIRTY_WORDS; ++w)
+    {
+        // Re-read the word after each cell: drawing one cell may dirty a
+        // later one, which should still go out in this pass.
+        int b = 0;
+        while (b < 64)
         {
-            coord_def gc(x, y);
-
-            if (!is_dirty(gc) && !force_full)
-                continue;
-
-            if (cell_needs_redraw(gc))
+            const uint64_t bits = (no_cells ? 0
+                                   : force_full ? ~0ULL
+                                   : m_dirty_cells[w]) >> b;
+            if (!bits)
+                break;
+            b += __builtin_ctzll(bits);
+            const int i = w * 64 + b++;
+            if (i >= GXM * GYM)
+                break;
+
+            const coord_def gc(i % GXM, i / GXM);
+
+            if (!snapshot && cell_needs_redraw(gc))
             {
                 screen_cell_t *cell = &m_next_view(gc);
 
@@ -1630,18 +2079,26 @@ void TilesFramework::_send_map(bool force_full)
                 pack_cell_overlays(gc, m_next_view);
             }
 
-            mark_clean(gc);
+            if (!snapshot)
+                mark_clean(gc);
+            if (!force_full)
+                m_sent_cells.push_back(gc);
 
             if (m_origin.equals(-1, -1))
                 m_origin = gc;
 
             json_open_object();
-            if (send_gc
-                || last_gc.x + 1 != gc.x
-                || last_gc.y != gc.y)
+            if (m_packing)
             {
-                json_write_int("x", x - m_origin.x);
-                json_write_int("y", y - m_origin.y);
+                m_packed_fields = 0;
+                m_packed_cell.clear();
+            }
+            else if (send_gc
+                     || last_gc.x + 1 != gc.x
+                     || last_gc.y != gc.y)
+            {
+                json_write_int("x", gc.x - m_origin.x);
+                json_write_int("y", gc.y - m_origin.y);
                 json_treat_as_empty();
             }
 
@@ -1651,10 +2108,41 @@ void TilesFramework::_send_map(bool force_full)
                 : m_current_map_knowledge(gc);
             _send_cell(gc,
                        sc,
-                       m_next_view(gc),
-                       mc, env.map_knowledge(gc),
+                       snapshot ? m_current_view(gc) : m_next_view(gc),
+                       mc,
+                       snapshot ? m_current_map_knowledge(gc)
+                                : env.map_knowledge(gc),
                        new_monster_locs, force_full);
 
+            if (m_packing)
+            {
+                if (!json_is_empty())
+                {
+                    _pack_field(PF_EXTRA);
+                    append_varint(m_packed_cell, extras++);
+                }
+                json_close_object(true);
+
+                if (!m_packed_fields)
+                    continue;
+
+                if (run.empty() || i != run_end)
+                {
+                    if (!run.empty())
+                    {
+                        append_varint(packed, run_end - run_start);
+                        packed += run;
+                        run.clear();
+                    }
+                    append_varint(packed, i - run_end);
+                    run_start = i;
+                }
+                append_varint(run, m_packed_fields);
+                run += m_packed_cell;
+                run_end = i + 1;
+                continue;
+            }
+
             if (!json_is_empty())
             {
                 send_gc = false;
@@ -1662,23 +2150,64 @@ void TilesFramework::_send_map(bool force_full)
             }
             json_close_object(true);
         }
+    }
     json_close_array(true);
 
+    if (!run.empty())
+    {
+        append_varint(packed, run_end - run_start);
+        packed += run;
+
+        string header;
+        append_varint(header, PACKED_MAP_VERSION);
+        append_varint(header, GXM);
+        append_varint(header, m_origin.x);
+        append_varint(header, m_origin.y);
+        json_write_string("p", base64_encode(header + packed));
+    }
+
     json_close_object(true);
 
     finish_message();
 
+    if (snapshot)
+    {
+        _send_cursor(CURSOR_MAP);
+        return;
+    }
+
     if (force_full)
+    {
         _send_cursor(CURSOR_MAP);
 
-    if (m_mcache_ref_done)
-        _mcache_ref(false);
+        if (m_mcache_ref_done)
+            _mcache_ref(false);
+        m_mcache_ref_done = false;
 
-    m_current_map_knowledge = env.map_knowledge;
-    m_current_view = m_next_view;
+        m_current_map_knowledge = env.map_knowledge;
+        m_current_view = m_next_view;
+    }
+    else
+    {
+        // Only cells that were just sent advance their shadow copies. The
+        // rest keep what the client actually has, so a change that has not
+        // been marked dirty yet is still diffed correctly when it is.
+        for (const coord_def &gc : m_sent_cells)
+        {
+            if (m_mcache_ref_done)
+                _mcache_ref_cell(gc, false);
+            m_current_map_knowledge(gc) = env.map_knowledge(gc);
+            m_current_view(gc) = m_next_view(gc);
+            if (m_mcache_ref_done)
+                _mcache_ref_cell(gc, true);
+        }
+    }
 
-    _mcache_ref(true);
-    m_mcache_ref_done = true;
+    if (!m_mcache_ref_done)
+    {
+        _mcache_ref(true);
+        m_mcache_ref_done = true;
+    }
 
     m_monster_locs = new_monster_locs;
 }
@@ -1694,6 +2223,7 @@ void TilesFramework::_send_monster(const coord_def &gc, const monster_info* m,
         json_treat_as_empty();
         new_monster_locs[m->client_id] = gc;
     }
+    const size_t fields_start = m_msg_buf.size();
 
     const monster_info* last = nullptr;
     auto it = m_monster_locs.find(m->client_id);
@@ -1746,6 +2276,20 @@ void TilesFramework::_send_monster(const coord_def &gc, const monster_info* m,
     if (m->is_named())
         json_write_int("clientid", m->client_id);
 
+    if (m_packing && m->client_id && m_msg_buf.size() == fields_start)
+    {
+        // Nothing but the id: the client already knows this monster, so a
+        // reference into its monster table will do.
+        const bool send_id = !json_is_empty();
+        json_abandon();
+        if (send_id)
+        {
+            _pack_field(PF_MON_ID);
+            append_varint(m_packed_cell, m->client_id);
+        }
+        return;
+    }
+
     json_close_object(true);
 }
 
@@ -1839,7 +2383,8 @@ void TilesFramework::_send_messages()
 }
 
 /*
-  Send everything a newly joined spectator needs
+  Send everything a newly joined spectator needs. This is the body of a
+  snapshot; see _send_snapshot.
  */
 void TilesFramework::_send_everything()
 {
@@ -1934,6 +2479,8 @@ void TilesFramework::cgotoxy(int x, int y, GotoRegion region)
 
 void TilesFramework::redraw()
 {
+    PROFILE_STAGE(PROF_TILEWEB_SEND);
+
     if (!has_receivers())
     {
         if (m_mcache_ref_done)
@@ -2144,18 +2691,21 @@ void TilesFramework::mark_for_redraw(const coord_def& gc)
 
 void TilesFramework::mark_dirty(const coord_def& gc)
 {
-    m_dirty_cells[gc.y * GXM + gc.x] = true;
+    const int i = gc.y * GXM + gc.x;
+    m_dirty_cells[i / 64] |= 1ULL << (i % 64);
 }
 
 void TilesFramework::mark_clean(const coord_def& gc)
 {
-    m_cells_needing_redraw[gc.y * GXM + gc.x] = false;
-    m_dirty_cells[gc.y * GXM + gc.x] = false;
+    const int i = gc.y * GXM + gc.x;
+    m_cells_needing_redraw[i] = false;
+    m_dirty_cells[i / 64] &= ~(1ULL << (i % 64));
 }
 
 bool TilesFramework::is_dirty(const coord_def& gc)
 {
-    return m_dirty_cells[gc.y * GXM + gc.x];
+    const int i = gc.y * GXM + gc.x;
+    return m_dirty_cells[i / 64] >> (i % 64) & 1;
 }
 
 bool TilesFramework::cell_needs_redraw(const coord_def& gc)
@@ -2234,6 +2784,16 @@ void TilesFramework::json_close(bool erase_if_empty, char type)
     m_json_stack.pop_back();
 }
 
+// Drop the innermost object or array along with everything written to it.
+void TilesFramework::json_abandon()
+{
+    if (m_json_stack.empty())
+        die("json error: attempting to abandon object/array on empty stack");
+
+    m_msg_buf.resize(m_json_stack.back().start);
+    m_json_stack.pop_back();
+}
+
 void TilesFramework::json_open_object(const string& name)
 {
     json_open(name, '{', '}');
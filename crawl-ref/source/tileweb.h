@@ -8,7 +8,9 @@
 #ifdef USE_TILE_WEB
 
 #include <bitset>
+#include <deque>
 #include <map>
+#include <memory>
 #include <sys/un.h>
 
 #include "cursor-type.h"
@@ -147,7 +149,7 @@ public:
     void send_message(PRINTF(1, ));
     void flush_messages();
 
-    bool has_receivers() { return !m_dest_addrs.empty(); }
+    bool has_receivers() { return !m_dests.empty(); }
     bool is_controlled_from_web() { return m_controlled_from_web; }
 
     /* Webtiles can receive input both via stdin, and on the
@@ -194,6 +196,9 @@ public:
 
     string m_sock_name;
     bool m_await_connection;
+    // Send map cells in the packed encoding rather than as JSON objects;
+    // only while every destination said on attaching that it reads them.
+    bool m_packed_map;
 
     void set_text_cursor(bool enabled);
     void set_ui_state(WebtilesUIState state);
@@ -214,7 +219,47 @@ protected:
     int m_sock;
     int m_max_msg_size;
     string m_msg_buf;
-    vector<sockaddr_un> m_dest_addrs;
+
+    // A socket we send to. Messages are queued per destination and sent
+    // without blocking, so that one slow reader can't stall the game.
+    struct WebtilesDest
+    {
+        sockaddr_un addr;
+        bool primary;
+        deque<shared_ptr<const string>> queue;
+        size_t queued_bytes;
+        size_t front_sent;  // bytes of queue.front() already sent
+        bool needs_resync;  // messages were dropped; send a full update
+        // The first snapshot_msgs messages, up to the end of the last
+        // snapshot queued, are never dropped; only the backlog_bytes after
+        // them count against SPECTATOR_QUEUE_LIMIT.
+        size_t snapshot_msgs;
+        size_t backlog_bytes;
+        bool packed_map;    // reads (or decodes for its clients) packed maps
+    };
+    vector<WebtilesDest> m_dests;
+    void _update_packed_map();
+
+    void _queue_message(WebtilesDest &dest,
+                        const shared_ptr<const string> &msg,
+                        bool snapshot = false);
+    bool _send_queued_to(WebtilesDest &dest, bool block);
+    void _send_queued(bool block = false);
+    bool _have_queued() const;
+    void _resync_dropped();
+    int _find_dest(const sockaddr_un &addr) const;
+    void _queue_to(const sockaddr_un &addr,
+                   const shared_ptr<const string> &msg);
+
+    // While a snapshot is written, messages describe what the receivers
+    // already have (the shadow copies) and go only to m_snapshot_addr.
+    // They are kept in m_snapshot, which stays valid until the next
+    // broadcast, so the next joiner can be sent the same messages.
+    bool m_writing_snapshot;
+    sockaddr_un m_snapshot_addr;
+    vector<shared_ptr<const string>> m_snapshot;
+    bool m_snapshot_valid;
+    void _send_snapshot(const sockaddr_un &addr, int watcher);
 
     bool m_controlled_from_web;
     bool m_need_flush;
@@ -235,6 +280,18 @@ protected:
 
     void json_open(const string& name, char opener, char type);
     void json_close(bool erase_if_empty, char type);
+    void json_abandon();
+
+    // Packed map cells: while m_packing, _send_cell puts plain fields into
+    // m_packed_cell (flagged in m_packed_fields) and leaves only monsters
+    // and dolls to the JSON writer. See _send_map for the layout.
+    bool m_packing;
+    uint32_t m_packed_fields;
+    string m_packed_cell;
+    void _pack_field(int field);
+    void _cell_int(int field, const string &name, int value);
+    void _cell_bool(int field, const string &name, bool value);
+    void _cell_tileidx(int field, const string &name, tileidx_t t);
 
     struct UIStackFrame
     {
@@ -267,8 +324,14 @@ protected:
     coord_def m_next_view_tl;
     coord_def m_next_view_br;
 
-    bitset<GXM * GYM> m_dirty_cells;
+    // One bit per cell in row-major order, kept as plain words so that
+    // _send_map can skip clean stretches of the map 64 cells at a time.
+    static const int DIRTY_WORDS = (GXM * GYM + 63) / 64;
+    uint64_t m_dirty_cells[DIRTY_WORDS];
     bitset<GXM * GYM> m_cells_needing_redraw;
+    // Cells written by the current _send_map, whose shadow copies are
+    // brought up to date once the message is out.
+    vector<coord_def> m_sent_cells;
     void mark_dirty(const coord_def& gc);
     void mark_clean(const coord_def& gc);
     bool is_dirty(const coord_def& gc);
@@ -308,6 +371,7 @@ protected:
 
     bool m_mcache_ref_done;
     void _mcache_ref(bool inc);
+    void _mcache_ref_cell(const coord_def &gc, bool inc);
 
     void _send_cursor(cursor_type type);
     void _send_map(bool force_full = false);
@@ -22,6 +22,7 @@
 #include "coord.h"
 #include "coordit.h"
 #include "database.h"
+#include "dbg-prof.h"
 #include "delay.h"
 #include "dgn-overview.h"
 #include "directn.h"
@@ -506,6 +507,8 @@ static void _maybe_gozag_incite(vector<monster*> monsters)
 
 void update_monsters_in_view()
 {
+    PROFILE_STAGE(PROF_MONSTERS_IN_VIEW);
+
     int num_hostile = 0;
     vector<string> msgs;
     vector<monster*> monsters;
@@ -1339,6 +1342,8 @@ static bool _viewwindow_should_render()
  */
 void viewwindow(bool show_updates, bool tiles_only, animation *a, view_renderer *renderer)
 {
+    PROFILE_STAGE(PROF_VIEWWINDOW);
+
     if (_view_is_updating)
     {
         // recursive calls to this function can lead to memory corruption or
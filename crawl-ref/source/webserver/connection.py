@@ -13,6 +13,7 @@ from tornado.escape import to_unicode
 from tornado.escape import utf8
 from tornado.ioloop import IOLoop
 
+import packed_map
 from config import server_socket_path
 
 
@@ -71,7 +72,10 @@ class WebtilesSocketConnection(object):
 
         msg = json_encode({
                 "msg": "attach",
-                "primary": primary
+                "primary": primary,
+                # Clients that can't read packed map cells are sent them
+                # unpacked by the process handler.
+                "packed_map": packed_map.VERSION,
                 })
 
         self.open = True
@@ -1,7 +1,7 @@
 define(["jquery", "comm", "./map_knowledge", "./view_data", "./monster_list",
-        "./minimap", "./dungeon_renderer"],
+        "./minimap", "./dungeon_renderer", "./packed_map"],
 function ($, comm, map_knowledge, view_data, monster_list, minimap,
-          dungeon_renderer) {
+          dungeon_renderer, packed_map) {
     "use strict";
 
     function invalidate(minimap_too)
@@ -89,6 +89,8 @@ function ($, comm, map_knowledge, view_data, monster_list, minimap,
 
         if (data.cells)
             map_knowledge.merge(data.cells);
+        else if (data.p)
+            map_knowledge.merge(packed_map.unpack(data.p, data.x || []));
 
         // Mark cells overlapped by dirty cells as dirty
         $.each(map_knowledge.dirty().slice(), function (i, loc) {
@@ -108,6 +110,13 @@ function ($, comm, map_knowledge, view_data, monster_list, minimap,
     {
     }
 
+    // Until the webserver hears this, it unpacks map cells for us.
+    $(document).off("game_init.display")
+        .on("game_init.display", function () {
+            comm.send_message("client_caps",
+                              { packed_map: packed_map.VERSION });
+        });
+
     comm.register_handlers({
         "map": handle_map_message,
     });
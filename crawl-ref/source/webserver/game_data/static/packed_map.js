@@ -0,0 +1,167 @@
+define(function () {
+    "use strict";
+
+    // Must match PACKED_MAP_VERSION in tileweb.cc.
+    var VERSION = 1;
+
+    var INT = 0, BOOL = 1, TILE = 2, GLYPH = 3, MON_NULL = 4, MON_ID = 5,
+        FLAVOUR = 6, LIST = 7, EXTRA = 8;
+
+    // The packed_field enum in tileweb.cc, in bit order. Fields with in_t
+    // set belong in the cell's "t" object.
+    var fields = [
+        { name: "f", type: INT },
+        { name: "mon", type: MON_NULL },
+        { name: "mon", type: MON_ID },
+        { name: "mf", type: INT },
+        { name: "g", type: GLYPH },
+        { name: "col", type: INT },
+        { name: "fg", type: TILE, in_t: true },
+        { name: "base", type: INT, in_t: true },
+        { name: "bg", type: TILE, in_t: true },
+        { name: "cloud", type: TILE, in_t: true },
+        { name: "bloody", type: BOOL, in_t: true },
+        { name: "old_blood", type: BOOL, in_t: true },
+        { name: "silenced", type: BOOL, in_t: true },
+        { name: "halo", type: INT, in_t: true },
+        { name: "highlighted_summoner", type: BOOL, in_t: true },
+        { name: "sanctuary", type: BOOL, in_t: true },
+        { name: "liquefied", type: BOOL, in_t: true },
+        { name: "orb_glow", type: INT, in_t: true },
+        { name: "quad_glow", type: BOOL, in_t: true },
+        { name: "disjunct", type: BOOL, in_t: true },
+        { name: "mangrove_water", type: BOOL, in_t: true },
+        { name: "awakened_forest", type: BOOL, in_t: true },
+        { name: "blood_rotation", type: INT, in_t: true },
+        { name: "travel_trail", type: INT, in_t: true },
+        { name: "flv", type: FLAVOUR, in_t: true },
+        { name: "ov", type: LIST, in_t: true },
+        { name: "", type: EXTRA },
+    ];
+
+    // Turns the "p" string and "x" array of a packed map message into the
+    // same cell objects the JSON encoding would have sent.
+    function unpack(data, extras)
+    {
+        var raw = atob(data);
+        var bytes = new Uint8Array(raw.length);
+        for (var i = 0; i < raw.length; i++)
+            bytes[i] = raw.charCodeAt(i);
+        var pos = 0;
+
+        // Varints can carry 64-bit tile indices, which the JSON encoding
+        // splits into [lo, hi] signed 32-bit halves.
+        var hi;
+        function varint()
+        {
+            var lo = 0, shift = 0, b;
+            hi = 0;
+            do
+            {
+                b = bytes[pos++];
+                var v = b & 0x7f;
+                if (shift < 28)
+                    lo |= v << shift;
+                else if (shift == 28)
+                {
+                    lo |= v << 28;
+                    hi |= v >>> 4;
+                }
+                else
+                    hi |= v << (shift - 32);
+                shift += 7;
+            } while (b & 0x80);
+            hi |= 0;
+            return lo | 0;
+        }
+
+        if (varint() != VERSION)
+            throw new Error("Unknown packed map version");
+        var width = varint();
+        var ox = varint();
+        var oy = varint();
+
+        var cells = [];
+        var index = 0;
+        while (pos < bytes.length)
+        {
+            index += varint();
+            var count = varint();
+            for (var n = 0; n < count; n++, index++)
+            {
+                var cell = {
+                    x: index % width - ox,
+                    y: Math.floor(index / width) - oy,
+                };
+                var mask = varint();
+                for (var bit = 0; bit < fields.length; bit++)
+                {
+                    if (!(mask & (1 << bit)))
+                        continue;
+
+                    var field = fields[bit];
+                    var obj = cell;
+                    if (field.in_t)
+                        obj = cell.t = cell.t || {};
+
+                    switch (field.type)
+                    {
+                    case INT:
+                        obj[field.name] = varint();
+                        break;
+                    case BOOL:
+                        obj[field.name] = varint() != 0;
+                        break;
+                    case TILE:
+                        var lo = varint();
+                        obj[field.name] = hi ? [lo, hi] : lo;
+                        break;
+                    case GLYPH:
+                        obj[field.name] = String.fromCodePoint(varint());
+                        break;
+                    case MON_NULL:
+                        obj[field.name] = null;
+                        break;
+                    case MON_ID:
+                        obj[field.name] = { id: varint() };
+                        break;
+                    case FLAVOUR:
+                        var flv = { f: varint() };
+                        var s = varint();
+                        if (s)
+                            flv.s = s;
+                        obj[field.name] = flv;
+                        break;
+                    case LIST:
+                        var list = [];
+                        for (var len = varint(); len > 0; len--)
+                            list.push(varint());
+                        obj[field.name] = list;
+                        break;
+                    case EXTRA:
+                        var extra = extras[varint()];
+                        for (var prop in extra)
+                        {
+                            if (prop == "t")
+                            {
+                                cell.t = cell.t || {};
+                                for (var tprop in extra.t)
+                                    cell.t[tprop] = extra.t[tprop];
+                            }
+                            else
+                                cell[prop] = extra[prop];
+                        }
+                        break;
+                    }
+                }
+                cells.push(cell);
+            }
+        }
+        return cells;
+    }
+
+    return {
+        VERSION: VERSION,
+        unpack: unpack,
+    };
+});
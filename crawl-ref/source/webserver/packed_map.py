@@ -0,0 +1,165 @@
+"""Unpacking of the packed map cells sent by crawl.
+
+Crawl packs the cells of its map messages (see _send_map in tileweb.cc)
+once the webserver says on attaching that it can read them. Clients that
+advertise support get the packed messages as they are; for the others,
+unpack_message() turns them back into the "cells" array of the plain JSON
+encoding. This mirrors game_data/static/packed_map.js.
+"""
+
+import base64
+
+from tornado.escape import json_decode
+from tornado.escape import json_encode
+
+try:
+    from typing import Any, Dict, List
+except ImportError:
+    pass
+
+# Must match PACKED_MAP_VERSION in tileweb.cc.
+VERSION = 1
+
+INT, BOOL, TILE, GLYPH, MON_NULL, MON_ID, FLAVOUR, LIST, EXTRA = range(9)
+
+# The packed_field enum in tileweb.cc, in bit order: name, type and whether
+# the field belongs in the cell's "t" object.
+FIELDS = [
+    ("f", INT, False),
+    ("mon", MON_NULL, False),
+    ("mon", MON_ID, False),
+    ("mf", INT, False),
+    ("g", GLYPH, False),
+    ("col", INT, False),
+    ("fg", TILE, True),
+    ("base", INT, True),
+    ("bg", TILE, True),
+    ("cloud", TILE, True),
+    ("bloody", BOOL, True),
+    ("old_blood", BOOL, True),
+    ("silenced", BOOL, True),
+    ("halo", INT, True),
+    ("highlighted_summoner", BOOL, True),
+    ("sanctuary", BOOL, True),
+    ("liquefied", BOOL, True),
+    ("orb_glow", INT, True),
+    ("quad_glow", BOOL, True),
+    ("disjunct", BOOL, True),
+    ("mangrove_water", BOOL, True),
+    ("awakened_forest", BOOL, True),
+    ("blood_rotation", INT, True),
+    ("travel_trail", INT, True),
+    ("flv", FLAVOUR, True),
+    ("ov", LIST, True),
+    ("", EXTRA, False),
+]
+
+
+def _signed32(v):  # type: (int) -> int
+    v &= 0xFFFFFFFF
+    return v - 0x100000000 if v & 0x80000000 else v
+
+
+class _Reader(object):
+    def __init__(self, data):  # type: (str) -> None
+        self.bytes = bytearray(base64.b64decode(data))
+        self.pos = 0
+
+    def more(self):  # type: () -> bool
+        return self.pos < len(self.bytes)
+
+    def varint(self):  # type: () -> int
+        value = 0
+        shift = 0
+        while True:
+            b = self.bytes[self.pos]
+            self.pos += 1
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+
+def _unichr(c):  # type: (int) -> str
+    try:
+        return unichr(c)  # type: ignore # noqa: F821 (python 2)
+    except NameError:
+        return chr(c)
+
+
+def _tile(v):  # type: (int) -> Any
+    # As the JSON encoding does, split indices past 32 bits into [lo, hi]
+    # signed halves.
+    lo = _signed32(v)
+    hi = _signed32(v >> 32)
+    return [lo, hi] if hi else lo
+
+
+def unpack(data, extras):
+    # type: (str, List[Dict[str, Any]]) -> List[Dict[str, Any]]
+    """Rebuild the cell objects of a packed map message's "p" and "x"."""
+    r = _Reader(data)
+    if r.varint() != VERSION:
+        raise ValueError("Unknown packed map version")
+    width = r.varint()
+    ox = r.varint()
+    oy = r.varint()
+
+    cells = []
+    index = 0
+    while r.more():
+        index += r.varint()
+        count = r.varint()
+        for _ in range(count):
+            cell = {"x": index % width - ox, "y": index // width - oy}
+            index += 1
+            mask = r.varint()
+            for bit, (name, kind, in_t) in enumerate(FIELDS):
+                if not mask & (1 << bit):
+                    continue
+
+                obj = cell.setdefault("t", {}) if in_t else cell
+                if kind == INT:
+                    obj[name] = _signed32(r.varint())
+                elif kind == BOOL:
+                    obj[name] = r.varint() != 0
+                elif kind == TILE:
+                    obj[name] = _tile(r.varint())
+                elif kind == GLYPH:
+                    obj[name] = _unichr(r.varint())
+                elif kind == MON_NULL:
+                    obj[name] = None
+                elif kind == MON_ID:
+                    obj[name] = {"id": _signed32(r.varint())}
+                elif kind == FLAVOUR:
+                    flv = {"f": _signed32(r.varint())}
+                    s = _signed32(r.varint())
+                    if s:
+                        flv["s"] = s
+                    obj[name] = flv
+                elif kind == LIST:
+                    obj[name] = [_signed32(r.varint())
+                                 for _ in range(r.varint())]
+                elif kind == EXTRA:
+                    extra = extras[r.varint()]
+                    for prop, value in extra.items():
+                        if prop == "t":
+                            cell.setdefault("t", {}).update(value)
+                        else:
+                            cell[prop] = value
+            cells.append(cell)
+    return cells
+
+
+def is_packed(msg):  # type: (str) -> bool
+    """Whether a message from crawl is a map message with packed cells."""
+    return msg.startswith('{"msg":"map"') and '"p":"' in msg
+
+
+def unpack_message(msg):  # type: (str) -> str
+    """Turn a packed map message into its plain JSON encoding."""
+    obj = json_decode(msg)
+    if "p" not in obj:
+        return msg
+    obj["cells"] = unpack(obj.pop("p"), obj.pop("x", []))
+    return json_encode(obj)
@@ -0,0 +1,68 @@
+import json
+import os.path
+import subprocess
+
+try:
+    from shutil import which
+except ImportError:
+    from distutils.spawn import find_executable as which
+
+import pytest
+
+import packed_map
+
+# The cells that catch2-tests/test_stringutil.cc packs with crawl's own
+# encoder, so the two sides can't drift apart.
+PACKED = "AVADBFUCcQcj/////w+FgICAEISAgDisAgIAAugHAgADAQI="
+EXTRAS = [{"mf": 5, "t": {"doll": [[1, 32]]}}]
+CELLS = [
+    {"x": 2, "y": -3, "f": 7, "g": "#", "col": -1, "t": {"fg": [5, 1]}},
+    {"x": 3, "y": -3, "mon": {"id": 300}, "mf": 5,
+     "t": {"flv": {"f": 2}, "ov": [1000, 2], "doll": [[1, 32]]}},
+    {"x": 7, "y": -3, "mon": None},
+]
+
+PACKED_MAP_JS = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             "game_data", "static", "packed_map.js")
+
+# Loads the AMD module and prints what it unpacks from argv.
+NODE_SCRIPT = """
+var fs = require("fs");
+if (typeof atob === "undefined")
+    atob = function (s) { return Buffer.from(s, "base64").toString("binary"); };
+var module;
+function define(f) { module = f(); }
+eval(fs.readFileSync(process.argv[1], "utf8"));
+var args = JSON.parse(process.argv[2]);
+console.log(JSON.stringify(module.unpack(args[0], args[1])));
+"""
+
+
+def test_unpack():
+    assert packed_map.unpack(PACKED, EXTRAS) == CELLS
+
+
+def test_unpack_rejects_other_versions():
+    with pytest.raises(ValueError):
+        packed_map.unpack("Ag==", [])
+
+
+def test_unpack_message():
+    msg = json.dumps({"msg": "map", "clear": True, "p": PACKED,
+                      "x": EXTRAS}, separators=(",", ":"))
+    assert packed_map.is_packed(msg)
+    assert json.loads(packed_map.unpack_message(msg)) == {
+        "msg": "map", "clear": True, "cells": CELLS}
+
+
+def test_plain_messages_pass_through():
+    msg = '{"msg":"map","cells":[{"x":0,"y":0,"f":1}]}'
+    assert not packed_map.is_packed(msg)
+    assert packed_map.unpack_message(msg) == msg
+
+
+@pytest.mark.skipif(not which("node"), reason="node is not installed")
+def test_packed_map_js_agrees():
+    out = subprocess.check_output(["node", "-e", NODE_SCRIPT, PACKED_MAP_JS,
+                                   json.dumps([PACKED, EXTRAS])])
+    assert json.loads(out.decode("utf-8")) == CELLS
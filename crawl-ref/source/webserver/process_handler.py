@@ -18,6 +18,7 @@ from tornado.ioloop import IOLoop
 from tornado.ioloop import PeriodicCallback
 
 import config
+import packed_map
 from connection import WebtilesSocketConnection
 from game_data_handler import GameDataHandler
 from inotify import DirectoryWatcher
@@ -177,8 +178,17 @@ class CrawlProcessHandlerBase(object):
             receiver.flush_messages()
 
     def write_to_all(self, msg, send): # type: (str, bool) -> None
+        # Receivers whose client can't read packed map cells share one
+        # unpacked copy.
+        unpacked = None
         for receiver in self._receivers:
-            receiver.append_message(msg, send)
+            if (receiver.packed_map_version == packed_map.VERSION
+                    or not packed_map.is_packed(msg)):
+                receiver.append_message(msg, send)
+            else:
+                if unpacked is None:
+                    unpacked = packed_map.unpack_message(msg)
+                receiver.append_message(unpacked, send)
 
     def send_to_all(self, msg, **data): # type: (str, Any) -> None
         for receiver in self._receivers:
@@ -486,6 +496,8 @@ class CrawlProcessHandlerBase(object):
         loader = DynamicTemplateLoader.get(templ_path)
         templ = loader.load("game.html")
         game_html = to_unicode(templ.generate(version = v))
+        # The new client says for itself whether it reads packed maps
+        watcher.packed_map_version = None
         watcher.send_message("game_client", version = v, content = game_html)
 
     def stop(self):
@@ -605,6 +617,12 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
         self.exit_message = None
         self.exit_dump_url = None
 
+        # Watchers waiting for their snapshot, by the id crawl was given
+        self._joining_watchers = {} # type: Dict[int, Any]
+        self._next_watcher_id = 0
+        self._in_snapshot = False
+        self._snapshot_target = None
+
         self._stale_pid = None
         self._stale_lockfile = None
         self._purging_timer = None
@@ -854,7 +872,23 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
         super(CrawlProcessHandler, self).add_watcher(watcher)
 
         if self.conn and self.conn.open:
-            self.conn.send_message('{"msg":"spectator_joined"}')
+            # crawl answers with a snapshot of the game for this watcher
+            # alone, bracketed by snapshot_begin/snapshot_end
+            self._next_watcher_id += 1
+            self._joining_watchers[self._next_watcher_id] = watcher
+            self.conn.send_message(json_encode({
+                "msg": "spectator_joined",
+                "watcher": self._next_watcher_id,
+            }))
+
+    def remove_watcher(self, watcher):
+        super(CrawlProcessHandler, self).remove_watcher(watcher)
+
+        for watcher_id, w in list(self._joining_watchers.items()):
+            if w is watcher:
+                del self._joining_watchers[watcher_id]
+        if self._snapshot_target is watcher:
+            self._snapshot_target = None
 
     def handle_input(self, msg): # type: (str) -> None
         obj = json_decode(msg)
@@ -961,6 +995,14 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
                         self.send_to_all("dump", url = url)
                     else:
                         self.exit_dump_url = url
+            elif msgobj["msg"] == "snapshot_begin":
+                watcher_id = msgobj["watcher"]
+                self._in_snapshot = True
+                self._snapshot_target = self._joining_watchers.pop(watcher_id,
+                                                                   None)
+            elif msgobj["msg"] == "snapshot_end":
+                self._in_snapshot = False
+                self._snapshot_target = None
             elif msgobj["msg"] == "exit_reason":
                 self.exit_reason = msgobj["type"]
                 if "message" in msgobj:
@@ -980,7 +1022,16 @@ class CrawlProcessHandler(CrawlProcessHandlerBase):
                 # want that to reset idle time.
                 self.note_activity()
 
-            self.write_to_all(msg, not self.queue_messages)
+            if self._in_snapshot:
+                # Everyone else is already up to date
+                target = self._snapshot_target
+                if target is not None:
+                    if (target.packed_map_version != packed_map.VERSION
+                            and packed_map.is_packed(msg)):
+                        msg = packed_map.unpack_message(msg)
+                    target.append_message(msg, not self.queue_messages)
+            else:
+                self.write_to_all(msg, not self.queue_messages)
 
 
 
@@ -160,6 +160,8 @@ class CrawlWebSocket(tornado.websocket.WebSocketHandler):
         self.game_id = None
         self.received_pong = None
         self.save_info = dict()
+        # The packed map version the game client reads, if it said so
+        self.packed_map_version = None
 
         tornado.ioloop.IOLoop.current()
 
@@ -190,6 +192,7 @@ class CrawlWebSocket(tornado.websocket.WebSocketHandler):
             "forget_login_cookie": self.forget_login_cookie,
             "play": self.start_crawl,
             "pong": self.pong,
+            "client_caps": self.client_caps,
             "watch": self.watch,
             "chat_msg": self.post_chat_message,
             "register": self.register,
@@ -637,6 +640,9 @@ class CrawlWebSocket(tornado.websocket.WebSocketHandler):
     def pong(self):
         self.received_pong = True
 
+    def client_caps(self, packed_map=None, **kwargs):
+        self.packed_map_version = packed_map
+
     def rcfile_path(self, game_id):
         if game_id not in config.games: return None
         if not self.username: return None
@@ -13,6 +13,7 @@
 #include "cio.h" // cursor_control
 #include "clua.h"
 #include "command.h" // show_keyhelp_menu
+#include "dbg-prof.h"
 #include "dbg-util.h"
 #include "dgn-shoals.h" // wizard_mod_tide
 #include "files.h" // save_game
@@ -121,7 +122,11 @@ static void _do_wizard_command(int wiz_command)
     // case CONTROL('M'): break; // XXX do not use, menu command
 
     // case 'n': break;
+#ifdef TURN_PROFILE
+    case 'N': wizard_dump_turn_profile(); break;
+#else
     // case 'N': break;
+#endif
     // case CONTROL('N'): break;
 
     case 'o': wizard_create_spec_object(); break;
@@ -499,6 +504,9 @@ int list_wizard_commands(bool do_redraw_screen)
                        "<w>Ctrl-T</w> dungeon (D)Lua interpreter\n"
                        "<w>Ctrl-U</w> client (C)Lua interpreter\n"
                        "<w>Ctrl-X</w> Xom effect stats\n"
+#ifdef TURN_PROFILE
+                       "<w>N</w>      dump turn and monster profiles\n"
+#endif
 #ifdef DEBUG_DIAGNOSTICS
                        "<w>Ctrl-Q</w> make some debug messages quiet\n"
 #endif